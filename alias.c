@@ -0,0 +1,535 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/alias.h"
+#include "include/config.h"
+
+struct osh_alias {
+	char *name;
+	// Definition as given, lexed the first time it's used
+	char *text;
+	int func;
+	// Tokens of 'text' with their strings in one block, words keep their
+	// $ for the expansion at each use
+	struct osh_tok *toks;
+	int ntok;
+	// 'text' doesn't lex, used as a plain word
+	int bad;
+	struct osh_alias *next;
+};
+
+// Tokens being built for one expanded line
+struct alias_out {
+	struct osh_arena *a;
+	struct osh_tok *v;
+	int n;
+	int cap;
+};
+
+static struct osh_alias **alias_tab;
+static size_t alias_tab_size;
+static size_t alias_tab_used;
+
+// Names being expanded, a word naming one of them is left alone
+static const struct osh_alias *alias_stack[OSH_ALIAS_DEPTH];
+
+// Positional parameters of the innermost function call
+static char **alias_args;
+static int alias_nargs;
+
+// Scratch for lexing definitions, reset after each
+static struct osh_arena alias_arena;
+static int alias_arena_ready;
+
+static unsigned long alias_hash(const char *s){
+	// FNV-1a
+	unsigned long h = 2166136261UL;
+
+	while (*s){
+		h ^= (unsigned char)*s++;
+		h *= 16777619UL;
+	}
+
+	return h;
+}
+
+static int alias_grow(void){
+	size_t size = alias_tab_size ? alias_tab_size * 2 : 32;
+	struct osh_alias **tab;
+	size_t i;
+
+	if ((tab = calloc(size, sizeof(*tab))) == NULL)
+		return -1;
+
+	for (i = 0; i < alias_tab_size; i++){
+		struct osh_alias *e = alias_tab[i];
+
+		while (e){
+			struct osh_alias *next = e->next;
+			size_t b = alias_hash(e->name) & (size - 1);
+
+			e->next = tab[b];
+			tab[b] = e;
+			e = next;
+		}
+	}
+
+	free(alias_tab);
+	alias_tab = tab;
+	alias_tab_size = size;
+
+	return 0;
+}
+
+static struct osh_alias **alias_slot(const char *name){
+	struct osh_alias **pe;
+
+	if (alias_tab_size == 0)
+		return NULL;
+
+	for (pe = &alias_tab[alias_hash(name) & (alias_tab_size - 1)]; *pe; pe = &(*pe)->next)
+		if (!strcmp((*pe)->name, name))
+			return pe;
+
+	return NULL;
+}
+
+static struct osh_alias *alias_find(const char *name){
+	struct osh_alias **pe;
+
+	if (alias_tab_used == 0)
+		return NULL;
+
+	return (pe = alias_slot(name)) ? *pe : NULL;
+}
+
+static void alias_free_entry(struct osh_alias *e){
+	free(e->name);
+	free(e->text);
+	free(e->toks);
+	free(e);
+}
+
+static int alias_define(const char *name, const char *text, int func){
+	struct osh_alias *e;
+	char *t;
+	size_t b;
+
+	if (*name == '\0' || strchr(name, '/') || strchr(name, '='))
+		return -1;
+
+	if ((t = strdup(text)) == NULL)
+		return -1;
+
+	// Redefined, forget the old tokens
+	if ((e = alias_find(name)) != NULL){
+		free(e->text);
+		free(e->toks);
+		e->text = t;
+		e->func = func;
+		e->toks = NULL;
+		e->ntok = 0;
+		e->bad = 0;
+		return 0;
+	}
+
+	if ((alias_tab_used >= alias_tab_size && alias_grow() < 0) ||
+	    (e = calloc(1, sizeof(*e))) == NULL || (e->name = strdup(name)) == NULL){
+		free(e);
+		free(t);
+		return -1;
+	}
+
+	e->text = t;
+	e->func = func;
+
+	b = alias_hash(name) & (alias_tab_size - 1);
+	e->next = alias_tab[b];
+	alias_tab[b] = e;
+	alias_tab_used++;
+
+	return 0;
+}
+
+int osh_alias_set(const char *name, const char *text){
+	return alias_define(name, text, 0);
+}
+
+int osh_alias_set_function(const char *name, const char *text){
+	return alias_define(name, text, 1);
+}
+
+int osh_alias_unset(const char *name){
+	struct osh_alias **pe, *e;
+
+	if ((pe = alias_slot(name)) == NULL)
+		return -1;
+
+	e = *pe;
+	*pe = e->next;
+	alias_free_entry(e);
+	alias_tab_used--;
+
+	return 0;
+}
+
+// Lex the definition once and keep the tokens in a single block
+static int alias_compile(struct osh_alias *e){
+	struct osh_tok *t, *toks;
+	size_t size;
+	char *s, *p;
+	int n, i;
+
+	if (e->toks || e->bad)
+		return e->bad ? -1 : 0;
+
+	if (!alias_arena_ready){
+		osh_arena_init(&alias_arena);
+		alias_arena_ready = 1;
+	}
+	osh_arena_reset(&alias_arena);
+
+	if ((s = osh_arena_strndup(&alias_arena, e->text, strlen(e->text))) == NULL ||
+	    (t = osh_lex(&alias_arena, s, &n, OSH_LEX_RAW)) == NULL){
+		printf("oshean: %s: bad definition\n", e->name);
+		e->bad = 1;
+		return -1;
+	}
+
+	size = (n ? n : 1) * sizeof(*t);
+	for (i = 0; i < n; i++)
+		if (t[i].str)
+			size += strlen(t[i].str) + 1;
+
+	if ((toks = malloc(size)) == NULL)
+		return -1;
+
+	p = (char*)(toks + (n ? n : 1));
+
+	for (i = 0; i < n; i++){
+		toks[i] = t[i];
+
+		if (t[i].str){
+			size_t len = strlen(t[i].str) + 1;
+
+			toks[i].str = memcpy(p, t[i].str, len);
+			p += len;
+		}
+	}
+
+	e->toks = toks;
+	e->ntok = n;
+
+	return 0;
+}
+
+static int alias_push(struct alias_out *o, enum osh_tok_type type, char *str){
+	if (o->n == o->cap){
+		int cap = o->cap ? o->cap * 2 : 16;
+		struct osh_tok *v = osh_arena_grow(o->a, o->v, o->cap * sizeof(*v), cap * sizeof(*v));
+
+		if (v == NULL)
+			return -1;
+		o->v = v;
+		o->cap = cap;
+	}
+
+	o->v[o->n].type = type;
+	o->v[o->n].str = str;
+	o->v[o->n].expand = 0;
+	o->v[o->n].fd = -1;
+	o->n++;
+
+	return 0;
+}
+
+// Word as the command will see it, raw words get their $ expanded now
+static char *alias_word(struct osh_arena *a, const struct osh_tok *t){
+	return t->expand ? osh_lex_expand(a, t->str) : t->str;
+}
+
+// Whether the next word starts a command
+static int alias_at_start(const struct alias_out *o){
+	const struct osh_tok *last = o->n ? &o->v[o->n - 1] : NULL;
+
+	return last == NULL || last->type == OSH_TOK_PIPE ||
+		(o->n == 1 && last->type == OSH_TOK_WORD && !strcmp(last->str, "time"));
+}
+
+static int alias_on_stack(const struct osh_alias *e, int depth){
+	int i;
+
+	for (i = 0; i < depth; i++)
+		if (alias_stack[i] == e)
+			return 1;
+
+	return 0;
+}
+
+static int alias_emit(struct alias_out *o, const struct osh_tok *t, int n, int depth);
+
+// Body of function 'e' with the words after its name as $1 to $N
+static int alias_call(struct alias_out *o, struct osh_alias *e,
+		const struct osh_tok *args, int nargs, int depth){
+	char **argv, **saved = alias_args;
+	int saved_n = alias_nargs, i, ret;
+
+	if ((argv = osh_arena_alloc(o->a, (nargs + 1) * sizeof(*argv))) == NULL)
+		return -1;
+
+	for (i = 0; i < nargs; i++)
+		if ((argv[i] = alias_word(o->a, &args[i])) == NULL)
+			return -1;
+	argv[nargs] = NULL;
+
+	alias_args = argv;
+	alias_nargs = nargs;
+	osh_lex_set_args(nargs, argv);
+
+	ret = alias_emit(o, e->toks, e->ntok, depth + 1);
+
+	alias_args = saved;
+	alias_nargs = saved_n;
+	osh_lex_set_args(saved_n, saved);
+
+	return ret;
+}
+
+static int alias_emit(struct alias_out *o, const struct osh_tok *t, int n, int depth){
+	static const char all_args[] = { OSH_LEX_VAR, '@', '\0' };
+	struct osh_alias *e;
+	int i = 0, j;
+
+	while (i < n){
+		if (t[i].type != OSH_TOK_WORD){
+			if (alias_push(o, t[i].type, NULL) < 0)
+				return -1;
+			o->v[o->n - 1].fd = t[i].fd;
+			i++;
+			continue;
+		}
+
+		if (alias_at_start(o) && !t[i].expand && (e = alias_find(t[i].str)) != NULL &&
+		    !alias_on_stack(e, depth) && alias_compile(e) == 0){
+			if (depth == OSH_ALIAS_DEPTH){
+				printf("oshean: %s: alias expansion too deep\n", t[i].str);
+				return -1;
+			}
+
+			alias_stack[depth] = e;
+
+			if (!e->func){
+				if (alias_emit(o, e->toks, e->ntok, depth + 1) < 0)
+					return -1;
+				i++;
+				continue;
+			}
+
+			for (j = i + 1; j < n && t[j].type == OSH_TOK_WORD; j++)
+				;
+			if (alias_call(o, e, t + i + 1, j - i - 1, depth) < 0)
+				return -1;
+			i = j;
+			continue;
+		}
+
+		// $@ in a function body gives each argument its own word
+		if (t[i].expand && alias_args && !strcmp(t[i].str, all_args)){
+			for (j = 0; j < alias_nargs; j++)
+				if (alias_push(o, OSH_TOK_WORD, alias_args[j]) < 0)
+					return -1;
+			i++;
+			continue;
+		}
+
+		{
+			char *w = alias_word(o->a, &t[i]);
+
+			if (w == NULL || alias_push(o, OSH_TOK_WORD, w) < 0)
+				return -1;
+		}
+		i++;
+	}
+
+	return 0;
+}
+
+struct osh_tok *osh_alias_expand(struct osh_arena *a, struct osh_tok *t, int *n){
+	struct alias_out o;
+	int i, hit = 0;
+
+	if (alias_tab_used == 0)
+		return t;
+
+	// Most lines name no alias, hand those back untouched
+	for (i = 0; i < *n && !hit; i++){
+		if (t[i].type != OSH_TOK_WORD || (i > 0 && t[i-1].type != OSH_TOK_PIPE &&
+		    !(i == 1 && t[0].type == OSH_TOK_WORD && !strcmp(t[0].str, "time"))))
+			continue;
+		hit = alias_find(t[i].str) != NULL;
+	}
+
+	if (!hit)
+		return t;
+
+	o.a = a;
+	o.v = NULL;
+	o.n = o.cap = 0;
+
+	if (alias_emit(&o, t, *n, 0) < 0)
+		return NULL;
+
+	// Never hand back NULL for a line that expanded to nothing
+	if (o.v == NULL && (o.v = osh_arena_alloc(a, sizeof(*o.v))) == NULL)
+		return NULL;
+
+	*n = o.n;
+	return o.v;
+}
+
+static void alias_config(const char *name, const char *val, void *arg){
+	alias_define(name, val, arg != NULL);
+}
+
+void osh_alias_init(void){
+	osh_config_each("alias ", alias_config, NULL);
+	osh_config_each("function ", alias_config, (void*)1);
+}
+
+void osh_alias_free(void){
+	size_t i;
+
+	for (i = 0; i < alias_tab_size; i++){
+		struct osh_alias *e = alias_tab[i];
+
+		while (e){
+			struct osh_alias *next = e->next;
+
+			alias_free_entry(e);
+			e = next;
+		}
+	}
+
+	free(alias_tab);
+	alias_tab = NULL;
+	alias_tab_size = alias_tab_used = 0;
+
+	if (alias_arena_ready){
+		osh_arena_free(&alias_arena);
+		alias_arena_ready = 0;
+	}
+}
+
+static int alias_cmp(const void *a, const void *b){
+	return strcmp((*(struct osh_alias* const*)a)->name, (*(struct osh_alias* const*)b)->name);
+}
+
+// Every alias or every function, sorted by name
+static void alias_list(int func){
+	struct osh_alias **v, *e;
+	size_t i, n = 0;
+
+	if (alias_tab_used == 0 || (v = malloc(alias_tab_used * sizeof(*v))) == NULL)
+		return;
+
+	for (i = 0; i < alias_tab_size; i++)
+		for (e = alias_tab[i]; e; e = e->next)
+			if (e->func == func)
+				v[n++] = e;
+
+	qsort(v, n, sizeof(*v), alias_cmp);
+
+	for (i = 0; i < n; i++)
+		printf(func ? "function %s '%s'\n" : "alias %s='%s'\n", v[i]->name, v[i]->text);
+
+	free(v);
+}
+
+// alias [name[=text] ...]
+int osh_alias_builtin(int argc, char **argv){
+	int i, ret = 0;
+
+	if (argc < 2){
+		alias_list(0);
+		return 0;
+	}
+
+	for (i = 1; i < argc; i++){
+		char *eq = strchr(argv[i], '=');
+		struct osh_alias *e;
+
+		if (eq == NULL){
+			if ((e = alias_find(argv[i])) == NULL || e->func){
+				printf("alias: %s: not found\n", argv[i]);
+				ret = 1;
+			} else {
+				printf("alias %s='%s'\n", e->name, e->text);
+			}
+			continue;
+		}
+
+		*eq = '\0';
+		if (alias_define(argv[i], eq + 1, 0) < 0){
+			printf("alias: %s: invalid name\n", argv[i]);
+			ret = 1;
+		}
+		*eq = '=';
+	}
+
+	return ret;
+}
+
+// function [name [body ...]]
+int osh_alias_function_builtin(int argc, char **argv){
+	struct osh_alias *e;
+	size_t len = 0;
+	char *body;
+	int i, ret;
+
+	if (argc < 2){
+		alias_list(1);
+		return 0;
+	}
+
+	if (argc == 2){
+		if ((e = alias_find(argv[1])) == NULL || !e->func){
+			printf("function: %s: not found\n", argv[1]);
+			return 1;
+		}
+		printf("function %s '%s'\n", e->name, e->text);
+		return 0;
+	}
+
+	for (i = 2; i < argc; i++)
+		len += strlen(argv[i]) + 1;
+
+	if ((body = malloc(len)) == NULL)
+		return 1;
+
+	body[0] = '\0';
+	for (i = 2; i < argc; i++){
+		if (i > 2)
+			strcat(body, " ");
+		strcat(body, argv[i]);
+	}
+
+	if ((ret = alias_define(argv[1], body, 1)) < 0)
+		printf("function: %s: invalid name\n", argv[1]);
+
+	free(body);
+
+	return ret < 0;
+}
+
+int osh_alias_unalias_builtin(int argc, char **argv){
+	int i, ret = 0;
+
+	for (i = 1; i < argc; i++){
+		if (osh_alias_unset(argv[i]) < 0){
+			printf("unalias: %s: not found\n", argv[i]);
+			ret = 1;
+		}
+	}
+
+	return ret;
+}
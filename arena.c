@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/arena.h"
+
+#define OSH_ARENA_CHUNK 4096
+#define OSH_ARENA_ALIGN 16
+// Largest chunk a reset keeps, a bigger one was grown by some unusual
+// line and goes back instead of staying for the rest of the session
+#define OSH_ARENA_KEEP (64 * 1024)
+
+static size_t arena_align(size_t size){
+	return (size + OSH_ARENA_ALIGN - 1) & ~(size_t)(OSH_ARENA_ALIGN - 1);
+}
+
+void osh_arena_init(struct osh_arena *a){
+	a->chunk = NULL;
+}
+
+static struct osh_arena_chunk *arena_chunk(struct osh_arena *a, size_t size){
+	struct osh_arena_chunk *c;
+	size_t csize = a->chunk ? a->chunk->size * 2 : OSH_ARENA_CHUNK;
+
+	while (csize < size)
+		csize *= 2;
+
+	if ((c = malloc(sizeof(*c) + csize)) == NULL)
+		return NULL;
+
+	c->size = csize;
+	c->used = 0;
+	c->next = a->chunk;
+	a->chunk = c;
+
+	return c;
+}
+
+void *osh_arena_alloc(struct osh_arena *a, size_t size){
+	struct osh_arena_chunk *c = a->chunk;
+	void *p;
+
+	size = arena_align(size ? size : 1);
+
+	if (c == NULL || c->size - c->used < size)
+		if ((c = arena_chunk(a, size)) == NULL)
+			return NULL;
+
+	p = c->data + c->used;
+	c->used += size;
+
+	return p;
+}
+
+void *osh_arena_grow(struct osh_arena *a, void *ptr, size_t old, size_t size){
+	struct osh_arena_chunk *c = a->chunk;
+	void *p;
+
+	old = arena_align(old);
+
+	// Latest allocation with room behind it, just bump the offset
+	if (ptr && c && (char*)ptr + old == c->data + c->used &&
+	    c->size - c->used + old >= arena_align(size)){
+		c->used += arena_align(size) - old;
+		return ptr;
+	}
+
+	if ((p = osh_arena_alloc(a, size)) == NULL)
+		return NULL;
+
+	if (ptr)
+		memcpy(p, ptr, old < size ? old : size);
+
+	return p;
+}
+
+char *osh_arena_strndup(struct osh_arena *a, const char *s, size_t len){
+	char *p = osh_arena_alloc(a, len + 1);
+
+	if (p == NULL)
+		return NULL;
+
+	memcpy(p, s, len);
+	p[len] = '\0';
+
+	return p;
+}
+
+void osh_arena_reset(struct osh_arena *a){
+	struct osh_arena_chunk *c = a->chunk;
+
+	if (c == NULL)
+		return;
+
+	// Newest chunk is the largest one, keep it and drop the rest
+	while (c->next){
+		struct osh_arena_chunk *next = c->next->next;
+
+		free(c->next);
+		c->next = next;
+	}
+
+	if (c->size > OSH_ARENA_KEEP){
+		free(c);
+		a->chunk = NULL;
+		return;
+	}
+
+	c->used = 0;
+}
+
+void osh_arena_free(struct osh_arena *a){
+	osh_arena_reset(a);
+	free(a->chunk);
+	a->chunk = NULL;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Monotonic clock in nanoseconds
+long bench_now(void);
+// One JSON object per line, {"bench": name, "iters": n, "ns_per_op": x}
+// followed by the "key": value pairs already formatted in 'extra'
+void bench_report(const char *name, long iters, long ns, const char *extra);
+
+// osh_lex and osh_parse on short, quoted and 4 KB lines
+void bench_lex(void);
+// posix_spawn against fork + execve, and whole cmd_exec_oshean runs
+void bench_spawn(void);
+// refreshMultiLine on 4 KB lines, full redraws and single edits
+void bench_refresh(void);
+// History add, index and search at 100k entries
+void bench_history(void);
+// Width functions over ASCII, CJK, emoji and mixed lines
+void bench_utf8(void);
+// A key trace replayed through the editor, time, bytes and write() calls
+// per key
+void bench_replay(void);
+// Exec of the shell to its first prompt, with and without a long history
+void bench_startup(void);
@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/arena.h"
+#include "../include/lex.h"
+#include "../include/parse.h"
+#include "bench.h"
+
+// The lexer works in place, every round lexes a fresh copy of the line
+// from a buffer kept for the whole run, the copy is part of the time
+
+#define BENCH_LEX_ROUNDS 200000
+#define BENCH_LEX_LONG 4096
+
+struct lex_sample {
+	const char *name;
+	const char *line;
+	long rounds;
+};
+
+static size_t bench_lex_fill(char *line, size_t size){
+	static const char word[] = "word$HOME 'quoted text' \"dq $USER\" ";
+	size_t len = 0;
+
+	while (len + sizeof(word) < size){
+		memcpy(line + len, word, sizeof(word) - 1);
+		len += sizeof(word) - 1;
+	}
+	line[len] = '\0';
+
+	return len;
+}
+
+void bench_lex(void){
+	static char long_line[BENCH_LEX_LONG];
+	struct lex_sample samples[] = {
+		{ "simple", "ls -la /tmp", BENCH_LEX_ROUNDS },
+		{ "pipeline", "cat \"$HOME/notes\" | grep -v '^#' | sort -u >out 2>&1", BENCH_LEX_ROUNDS },
+		{ "4k", long_line, BENCH_LEX_ROUNDS / 100 },
+	};
+	struct osh_arena a;
+	char *copy;
+	size_t s;
+
+	bench_lex_fill(long_line, sizeof(long_line));
+	osh_arena_init(&a);
+
+	if ((copy = malloc(BENCH_LEX_LONG)) == NULL)
+		return;
+
+	for (s = 0; s < sizeof(samples) / sizeof(samples[0]); s++){
+		size_t len = strlen(samples[s].line) + 1;
+		char name[64], extra[64];
+		long r, start, ns;
+		int ntok = 0;
+
+		start = bench_now();
+		for (r = 0; r < samples[s].rounds; r++){
+			memcpy(copy, samples[s].line, len);
+			osh_arena_reset(&a);
+			osh_lex(&a, copy, &ntok, 0);
+		}
+		ns = bench_now() - start;
+
+		snprintf(name, sizeof(name), "lex_%s", samples[s].name);
+		snprintf(extra, sizeof(extra), "\"bytes\": %zu, \"tokens\": %d", len - 1, ntok);
+		bench_report(name, samples[s].rounds, ns, extra);
+
+		start = bench_now();
+		for (r = 0; r < samples[s].rounds; r++){
+			memcpy(copy, samples[s].line, len);
+			osh_arena_reset(&a);
+			osh_parse(&a, copy);
+		}
+		ns = bench_now() - start;
+
+		snprintf(name, sizeof(name), "parse_%s", samples[s].name);
+		snprintf(extra, sizeof(extra), "\"bytes\": %zu", len - 1);
+		bench_report(name, samples[s].rounds, ns, extra);
+	}
+
+	free(copy);
+	osh_arena_free(&a);
+}
@@ -0,0 +1,196 @@
+/* Refreshes and history searches are static to the editor, so this file
+ * is built with linenoise.c itself instead of linking it. */
+#include "../linenoise.c"
+#include "../include/utf8.h"
+#include "bench.h"
+
+#define BENCH_REFRESH_ROUNDS 20000
+#define BENCH_REFRESH_LINE 4096
+#define BENCH_REFRESH_COLS 120
+#define BENCH_HISTORY 100000
+#define BENCH_SEARCH_ROUNDS 2000
+
+static const char bench_prompt[] = "<user ~/src/oshean (main)> ";
+
+/* Editor state as linenoiseEdit() sets it up, writing to /dev/null */
+static void bench_refresh_state(struct linenoiseState *l, int fd, const char *text){
+    static char line[BENCH_REFRESH_LINE];
+    size_t tlen = strlen(text), len = 0;
+
+    while (len + tlen < BENCH_REFRESH_LINE) {
+        memcpy(line+len,text,tlen);
+        len += tlen;
+    }
+
+    if (edit_buf == NULL) {
+        edit_buf = malloc(LINENOISE_LINE_MIN);
+        edit_cap = LINENOISE_LINE_MIN;
+    }
+
+    memset(l,0,sizeof(*l));
+    l->ifd = -1;
+    l->ofd = fd;
+    l->buf = edit_buf;
+    l->buflen = edit_cap-1;
+    l->prompt = bench_prompt;
+    l->plen = strlen(bench_prompt);
+    l->cols = BENCH_REFRESH_COLS;
+    l->search_seq = HISTORY_SEQ_NONE;
+    l->pwidth = promptTextColumnLen(bench_prompt,l->plen);
+    l->layout_cols = l->cols;
+
+    linenoiseEditSet(l,line,len);
+    frame_valid = 0;
+    refreshMultiLine(l);
+}
+
+static void bench_refresh_sample(const char *name, const char *text, int fd){
+    struct linenoiseState l;
+    char bench[64], extra[64];
+    size_t bytes = 0;
+    long r, start, ns;
+
+    bench_refresh_state(&l,fd,text);
+
+    /* Whole line redrawn, as after a resize or a history recall */
+    start = bench_now();
+    for (r = 0; r < BENCH_REFRESH_ROUNDS; r++) {
+        frame_valid = 0;
+        refreshMultiLine(&l);
+        bytes += refresh_ab.len;
+    }
+    ns = bench_now()-start;
+    snprintf(bench,sizeof(bench),"refresh_full_%s",name);
+    snprintf(extra,sizeof(extra),"\"bytes\": %zu, \"bytes_per_refresh\": %zu",
+        l.len, bytes/BENCH_REFRESH_ROUNDS);
+    bench_report(bench,BENCH_REFRESH_ROUNDS,ns,extra);
+
+    /* A key typed at the end and erased again, two refreshes a round */
+    bytes = 0;
+    start = bench_now();
+    for (r = 0; r < BENCH_REFRESH_ROUNDS; r++) {
+        linenoiseEditInsert(&l,"x",1);
+        bytes += refresh_ab.len;
+        linenoiseEditBackspace(&l);
+        bytes += refresh_ab.len;
+    }
+    ns = bench_now()-start;
+    snprintf(bench,sizeof(bench),"refresh_type_end_%s",name);
+    snprintf(extra,sizeof(extra),"\"bytes\": %zu, \"bytes_per_refresh\": %zu",
+        l.len, bytes/(2*BENCH_REFRESH_ROUNDS));
+    bench_report(bench,2*BENCH_REFRESH_ROUNDS,ns,extra);
+
+    /* The same in the middle of the line, the tail is redrawn */
+    l.pos = nextCharLen(l.buf,l.len,0,NULL);
+    while (l.pos < l.len/2) l.pos += nextCharLen(l.buf,l.len,l.pos,NULL);
+    bytes = 0;
+    start = bench_now();
+    for (r = 0; r < BENCH_REFRESH_ROUNDS; r++) {
+        linenoiseEditInsert(&l,"x",1);
+        bytes += refresh_ab.len;
+        linenoiseEditBackspace(&l);
+        bytes += refresh_ab.len;
+    }
+    ns = bench_now()-start;
+    snprintf(bench,sizeof(bench),"refresh_type_mid_%s",name);
+    snprintf(extra,sizeof(extra),"\"bytes\": %zu, \"bytes_per_refresh\": %zu",
+        l.len, bytes/(2*BENCH_REFRESH_ROUNDS));
+    bench_report(bench,2*BENCH_REFRESH_ROUNDS,ns,extra);
+
+    /* Cursor moves only */
+    bytes = 0;
+    start = bench_now();
+    for (r = 0; r < BENCH_REFRESH_ROUNDS; r++) {
+        linenoiseEditMoveLeft(&l);
+        bytes += refresh_ab.len;
+        linenoiseEditMoveRight(&l);
+        bytes += refresh_ab.len;
+    }
+    ns = bench_now()-start;
+    snprintf(bench,sizeof(bench),"refresh_move_%s",name);
+    snprintf(extra,sizeof(extra),"\"bytes\": %zu, \"bytes_per_refresh\": %zu",
+        l.len, bytes/(2*BENCH_REFRESH_ROUNDS));
+    bench_report(bench,2*BENCH_REFRESH_ROUNDS,ns,extra);
+}
+
+void bench_refresh(void){
+    int fd = open("/dev/null",O_WRONLY);
+
+    if (fd == -1) return;
+
+    linenoiseSetMultiLine(1);
+    linenoiseSetEncodingFunctions(
+        linenoiseUtf8PrevCharLen,
+        linenoiseUtf8NextCharLen,
+        linenoiseUtf8ReadCode);
+
+    bench_refresh_sample("ascii_4k","git commit -m 'fix the thing' && make -j8 ",fd);
+    bench_refresh_sample("mixed_4k",
+        "ls \xe6\x96\x87\xe4\xbb\xb6 e\xcc\x81t\xc3\xa9 \xf0\x9f\x93\x81 dir/ ",fd);
+
+    close(fd);
+}
+
+struct bench_query {
+    const char *name;
+    const char *q;
+    int prefix;
+};
+
+void bench_history(void){
+    static const struct bench_query queries[] = {
+        { "rare", "change 42420 ", 0 },
+        { "common", "make -j", 0 },
+        { "miss", "zzqx", 0 },
+        { "short_prefix", "gi", 1 },
+    };
+    char line[128], extra[64];
+    unsigned cur;
+    long i, start, ns, found;
+    size_t q;
+
+    linenoiseHistorySetMaxLen(BENCH_HISTORY);
+
+    start = bench_now();
+    for (i = 0; i < BENCH_HISTORY; i++) {
+        snprintf(line,sizeof(line),"git commit -m 'change %ld ' && make -j%ld target%ld",
+            i,i%16,i%977);
+        linenoiseHistoryAdd(line);
+    }
+    ns = bench_now()-start;
+    bench_report("history_add_100k",BENCH_HISTORY,ns,NULL);
+
+    /* A full ring drops its oldest entry on every add */
+    start = bench_now();
+    for (i = 0; i < BENCH_HISTORY/10; i++) {
+        snprintf(line,sizeof(line),"cd /srv/build-%ld && ./configure",i);
+        linenoiseHistoryAdd(line);
+    }
+    ns = bench_now()-start;
+    bench_report("history_add_evict",BENCH_HISTORY/10,ns,NULL);
+
+    /* The edited line, searches never match it */
+    linenoiseHistoryAdd("");
+    cur = history_seq_base+history_len-1;
+
+    start = bench_now();
+    historyIndexSync(HISTORY_SEQ_NONE);
+    ns = bench_now()-start;
+    bench_report("history_index_100k",history_len,ns,NULL);
+
+    for (q = 0; q < sizeof(queries)/sizeof(queries[0]); q++) {
+        char bench[64];
+
+        found = 0;
+        start = bench_now();
+        for (i = 0; i < BENCH_SEARCH_ROUNDS; i++)
+            found += historySearch(queries[q].q,strlen(queries[q].q),queries[q].prefix,
+                cur,-1) != HISTORY_SEQ_NONE;
+        ns = bench_now()-start;
+
+        snprintf(bench,sizeof(bench),"history_search_%s",queries[q].name);
+        snprintf(extra,sizeof(extra),"\"entries\": %d, \"found\": %s",
+            history_len,found ? "true" : "false");
+        bench_report(bench,BENCH_SEARCH_ROUNDS,ns,extra);
+    }
+}
@@ -0,0 +1,70 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include "../include/sh.h"
+#include "bench.h"
+
+// Micro benchmarks of the shell's hot paths: make bench, or oshean_bench
+// with the names of the groups to run. Every result is one JSON object on
+// its own line so runs can be kept and compared across releases.
+
+struct bench_group {
+	const char *name;
+	void (*fn)(void);
+};
+
+static const struct bench_group groups[] = {
+	{ "lex", bench_lex },
+	{ "spawn", bench_spawn },
+	{ "refresh", bench_refresh },
+	{ "history", bench_history },
+	{ "utf8", bench_utf8 },
+	{ "replay", bench_replay },
+	{ "startup", bench_startup },
+};
+
+long bench_now(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+void bench_report(const char *name, long iters, long ns, const char *extra){
+	printf("{\"bench\": \"%s\", \"iters\": %ld, \"ns_per_op\": %.1f%s%s}\n",
+		name, iters, iters ? (double)ns / iters : 0.0, extra ? ", " : "", extra ? extra : "");
+	fflush(stdout);
+}
+
+int main(int argc, char **argv){
+	size_t g;
+	int i;
+
+	setlocale(LC_ALL, "");
+	osh_init_shell(0);
+
+	for (i = 1; i < argc; i++){
+		for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+			if (!strcmp(argv[i], groups[g].name))
+				break;
+
+		if (g == sizeof(groups) / sizeof(groups[0])){
+			fprintf(stderr, "oshean_bench: %s: unknown group\n", argv[i]);
+			return 2;
+		}
+	}
+
+	for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++){
+		int run = argc == 1;
+
+		for (i = 1; i < argc && !run; i++)
+			run = !strcmp(argv[i], groups[g].name);
+
+		if (run)
+			groups[g].fn();
+	}
+
+	return 0;
+}
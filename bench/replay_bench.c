@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "../include/linenoise.h"
+#include "../include/complete.h"
+#include "../include/utf8.h"
+#include "bench.h"
+
+// Keystrokes fed to the editor set up as in the shell, rendered to
+// /dev/null. The trace is $OSH_BENCH_TRACE when set, raw bytes as typed,
+// e.g. recorded with script -I trace -c oshean, or a built-in session
+// otherwise. $OSH_BENCH_KEYS also prints every key on its own.
+
+#define BENCH_REPLAY_COLS 120
+
+enum replay_class {
+	REPLAY_INSERT,
+	REPLAY_DELETE,
+	REPLAY_ESCAPE,
+	REPLAY_ENTER,
+	REPLAY_OTHER,
+	REPLAY_ALL,
+	REPLAY_CLASSES
+};
+
+static const char *replay_names[REPLAY_CLASSES] = {
+	"insert", "delete", "escape", "enter", "other", "all"
+};
+
+struct replay_stats {
+	long *ns;
+	long n;
+	long cap;
+	size_t bytes;
+	long writes;
+	int max_writes;
+};
+
+struct replay_run {
+	struct replay_stats cls[REPLAY_CLASSES];
+	int print_keys;
+};
+
+static enum replay_class replay_class(int key){
+	switch (key){
+	case 8: case 127: case 4: case 11: case 21: case 23:
+		return REPLAY_DELETE;
+	case 27:
+		return REPLAY_ESCAPE;
+	case 13:
+		return REPLAY_ENTER;
+	}
+
+	return key >= 32 ? REPLAY_INSERT : REPLAY_OTHER;
+}
+
+static void replay_add(struct replay_stats *s, const linenoiseKeyStat *ks){
+	if (s->n == s->cap){
+		long cap = s->cap ? s->cap * 2 : 1024;
+		long *ns = realloc(s->ns, cap * sizeof(*ns));
+
+		if (ns == NULL)
+			return;
+		s->ns = ns;
+		s->cap = cap;
+	}
+
+	s->ns[s->n++] = ks->ns;
+	s->bytes += ks->bytes;
+	s->writes += ks->writes;
+	if (ks->writes > s->max_writes)
+		s->max_writes = ks->writes;
+}
+
+static void replay_key(const linenoiseKeyStat *ks, void *arg){
+	struct replay_run *run = arg;
+
+	replay_add(&run->cls[replay_class(ks->key)], ks);
+	replay_add(&run->cls[REPLAY_ALL], ks);
+
+	if (run->print_keys)
+		printf("{\"bench\": \"replay_key\", \"key\": %d, \"ns\": %ld, \"bytes\": %zu, \"writes\": %d}\n",
+			ks->key, ks->ns, ks->bytes, ks->writes);
+}
+
+static int replay_cmp(const void *a, const void *b){
+	long x = *(const long*)a, y = *(const long*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void replay_report(const char *name, struct replay_stats *s){
+	char bench[64], extra[256];
+	long total = 0, i;
+
+	if (s->n == 0)
+		return;
+
+	for (i = 0; i < s->n; i++)
+		total += s->ns[i];
+	qsort(s->ns, s->n, sizeof(*s->ns), replay_cmp);
+
+	snprintf(bench, sizeof(bench), "replay_%s", name);
+	snprintf(extra, sizeof(extra), "\"p50_ns\": %ld, \"p99_ns\": %ld, \"max_ns\": %ld, "
+		"\"bytes_per_key\": %.1f, \"writes_per_key\": %.2f, \"max_writes\": %d",
+		s->ns[s->n / 2], s->ns[s->n * 99 / 100], s->ns[s->n - 1],
+		(double)s->bytes / s->n, (double)s->writes / s->n, s->max_writes);
+	bench_report(bench, s->n, total, extra);
+}
+
+static void replay_put(FILE *f, const char *s, int times){
+	while (times-- > 0)
+		fputs(s, f);
+}
+
+// A session: short commands, a 4 KB line typed and edited, history
+// recalls, an 8 KB bracketed paste and a reverse search
+static int replay_builtin_trace(void){
+	FILE *f = tmpfile();
+	int fd;
+
+	if (f == NULL)
+		return -1;
+
+	fputs("ls -la /tmp\r", f);
+	fputs("git status --porcelain\r", f);
+
+	replay_put(f, "echo segment ", 4096 / 13);
+	replay_put(f, "\x1b[D", 40);
+	fputs("x", f);
+	fputs("\x01\x05", f);
+	replay_put(f, "\x17", 3);
+	replay_put(f, "\x7f", 20);
+	fputs("\r", f);
+
+	replay_put(f, "\x1b[A", 3);
+	fputs("\r", f);
+
+	fputs("\x1b[200~", f);
+	replay_put(f, "cat /var/log/build.log | grep -v ok ", 8192 / 36);
+	fputs("\x1b[201~", f);
+	fputs("\x15\r", f);
+
+	fputs("\x12ls\r", f);
+
+	fflush(f);
+	fd = dup(fileno(f));
+	fclose(f);
+	if (fd >= 0)
+		lseek(fd, 0, SEEK_SET);
+
+	return fd;
+}
+
+void bench_replay(void){
+	const char *trace = getenv("OSH_BENCH_TRACE");
+	struct replay_run run = { 0 };
+	int ifd, ofd, i, lines;
+	long start, ns;
+	char extra[64];
+
+	ifd = trace ? open(trace, O_RDONLY) : replay_builtin_trace();
+	ofd = open("/dev/null", O_WRONLY);
+
+	if (ifd < 0 || ofd < 0){
+		fprintf(stderr, "oshean_bench: no key trace %s\n", trace ? trace : "");
+		if (ifd >= 0)
+			close(ifd);
+		if (ofd >= 0)
+			close(ofd);
+		return;
+	}
+
+	run.print_keys = getenv("OSH_BENCH_KEYS") != NULL;
+
+	linenoiseSetMultiLine(1);
+	linenoiseSetHintsProvider(osh_complete_hint);
+	linenoiseSetFreeHintsCallback(free);
+	linenoiseSetCompletionCallback(osh_complete);
+	linenoiseSetEncodingFunctions(
+		linenoiseUtf8PrevCharLen,
+		linenoiseUtf8NextCharLen,
+		linenoiseUtf8ReadCode);
+
+	start = bench_now();
+	lines = linenoiseReplay(ifd, ofd, "<user ~/src/oshean (main)> ", BENCH_REPLAY_COLS,
+		LINENOISE_REPLAY_IDLE, replay_key, &run);
+	ns = bench_now() - start;
+
+	snprintf(extra, sizeof(extra), "\"keys\": %ld", run.cls[REPLAY_ALL].n);
+	bench_report("replay_lines", lines, ns, extra);
+
+	for (i = 0; i < REPLAY_CLASSES; i++){
+		replay_report(replay_names[i], &run.cls[i]);
+		free(run.cls[i].ns);
+	}
+
+	linenoiseSetHintsProvider(NULL);
+	linenoiseSetCompletionCallback(NULL);
+	close(ifd);
+	close(ofd);
+}
@@ -0,0 +1,83 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "../include/arena.h"
+#include "../include/env.h"
+#include "../include/path.h"
+#include "../include/parse.h"
+#include "../include/cmd.h"
+#include "bench.h"
+
+// Launch latency of true(1): start to reaped, with stdout on /dev/null
+
+#define BENCH_SPAWN_ROUNDS 500
+
+static long bench_spawn_launch(const char *path, int flags, int fd_out){
+	char *argv[] = { "true", NULL };
+	struct osh_launch l = { 0 };
+	long r, start;
+
+	l.path = (char*)path;
+	l.argv = argv;
+	l.argc = 1;
+	l.envp = osh_env_vec();
+	l.fd_in = -1;
+	l.fd_out = fd_out;
+	l.pgid = -1;
+	l.flags = flags;
+
+	start = bench_now();
+	for (r = 0; r < BENCH_SPAWN_ROUNDS; r++){
+		pid_t pid = cmd_launch_oshean(&l);
+		int status;
+
+		if (pid > 0)
+			waitpid(pid, &status, 0);
+	}
+
+	return bench_now() - start;
+}
+
+static long bench_spawn_exec(const char *line){
+	struct osh_arena a;
+	char buf[128];
+	long r, start;
+
+	osh_arena_init(&a);
+
+	start = bench_now();
+	for (r = 0; r < BENCH_SPAWN_ROUNDS; r++){
+		struct osh_pipeline *pl;
+
+		snprintf(buf, sizeof(buf), "%s", line);
+		osh_arena_reset(&a);
+		if ((pl = osh_parse(&a, buf)) != NULL)
+			cmd_exec_oshean(pl);
+	}
+
+	osh_arena_free(&a);
+	return bench_now() - start;
+}
+
+void bench_spawn(void){
+	const char *path = osh_path_lookup("true");
+	FILE *null = fopen("/dev/null", "w");
+
+	if (path == NULL || null == NULL){
+		fprintf(stderr, "oshean_bench: no true(1) to spawn\n");
+		if (null)
+			fclose(null);
+		return;
+	}
+
+	bench_report("spawn_posix_spawn", BENCH_SPAWN_ROUNDS, bench_spawn_launch(path, 0, fileno(null)), NULL);
+	bench_report("spawn_fork_exec", BENCH_SPAWN_ROUNDS,
+		bench_spawn_launch(path, OSH_LAUNCH_FORK, fileno(null)), NULL);
+	bench_report("exec_true", BENCH_SPAWN_ROUNDS, bench_spawn_exec("true"), NULL);
+	bench_report("exec_pipeline_3", BENCH_SPAWN_ROUNDS, bench_spawn_exec("true | true | true"), NULL);
+	bench_report("exec_builtin", BENCH_SPAWN_ROUNDS, bench_spawn_exec("export OSH_BENCH=1"), NULL);
+
+	fclose(null);
+}
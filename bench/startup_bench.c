@@ -0,0 +1,180 @@
+#define _XOPEN_SOURCE 700
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+// Exec of the shell to its first prompt on a pseudo terminal, once with
+// an empty history and once with a long one. HOME and XDG_CONFIG_HOME
+// point to a scratch directory so the user's own files stay out of it.
+// The shell is $OSH_BENCH_SHELL, the oshean built beside the benchmarks
+// otherwise.
+
+#define BENCH_STARTUP_RUNS 20
+#define BENCH_STARTUP_HISTORY 100000
+// Longest wait for the prompt, or for the shell to go after exit
+#define BENCH_STARTUP_WAIT_MS 2000
+
+#ifndef BENCH_OSHEAN
+#define BENCH_OSHEAN "oshean"
+#endif
+
+// Read from 'fd' until 'text' shows up, or anything up to the end when
+// it's NULL. Returns 0 once found or at the end, -1 on timeout.
+static int startup_wait(int fd, const char *text){
+	size_t tlen = text ? strlen(text) : 0, keep = 0;
+	char buf[4096];
+	ssize_t n;
+
+	for (;;){
+		struct pollfd p = { fd, POLLIN, 0 };
+
+		if (poll(&p, 1, BENCH_STARTUP_WAIT_MS) <= 0)
+			return -1;
+		if ((n = read(fd, buf + keep, sizeof(buf) - 1 - keep)) <= 0)
+			return 0;
+		if (text == NULL)
+			continue;
+
+		n += keep;
+		buf[n] = '\0';
+		if (strstr(buf, text))
+			return 0;
+
+		// The text may be split between two reads
+		keep = tlen - 1 < (size_t)n ? tlen - 1 : (size_t)n;
+		memmove(buf, buf + n - keep, keep);
+	}
+}
+
+// Nanoseconds from fork to the prompt, -1 if the shell never showed one
+static long startup_run(const char *shell, const char *dir){
+	struct winsize ws = { 40, 120, 0, 0 };
+	long start, ns = -1;
+	int master, slave;
+	pid_t pid;
+
+	if ((master = posix_openpt(O_RDWR|O_NOCTTY)) < 0)
+		return -1;
+	if (grantpt(master) < 0 || unlockpt(master) < 0){
+		close(master);
+		return -1;
+	}
+	// A known width, the editor does not need to ask the terminal
+	ioctl(master, TIOCSWINSZ, &ws);
+
+	start = bench_now();
+	if ((pid = fork()) == 0){
+		setsid();
+		if ((slave = open(ptsname(master), O_RDWR)) < 0)
+			_exit(127);
+		dup2(slave, 0);
+		dup2(slave, 1);
+		dup2(slave, 2);
+		close(slave);
+		close(master);
+		setenv("HOME", dir, 1);
+		setenv("XDG_CONFIG_HOME", dir, 1);
+		execl(shell, "oshean", (char*)NULL);
+		_exit(127);
+	}
+
+	if (pid > 0){
+		if (startup_wait(master, "> ") == 0)
+			ns = bench_now() - start;
+
+		if (write(master, "exit\r", 5) < 0 || startup_wait(master, NULL) < 0)
+			kill(pid, SIGKILL);
+		waitpid(pid, NULL, 0);
+	}
+
+	close(master);
+	return ns;
+}
+
+static int startup_cmp(const void *a, const void *b){
+	long x = *(const long*)a, y = *(const long*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int startup_history(const char *path, long lines){
+	FILE *f = fopen(path, "w");
+	long i;
+
+	if (f == NULL)
+		return -1;
+
+	for (i = 0; i < lines; i++)
+		fprintf(f, "git commit -m 'change %ld' && make -j%ld target%ld\n", i, i % 16, i % 977);
+
+	return fclose(f);
+}
+
+static void startup_case(const char *name, const char *shell, const char *dir,
+		const char *history, long lines){
+	long ns[BENCH_STARTUP_RUNS], total = 0;
+	char extra[128];
+	int i;
+
+	if (startup_history(history, lines) < 0)
+		return;
+
+	for (i = 0; i < BENCH_STARTUP_RUNS; i++){
+		if ((ns[i] = startup_run(shell, dir)) < 0){
+			fprintf(stderr, "oshean_bench: %s: no prompt\n", shell);
+			return;
+		}
+		total += ns[i];
+	}
+
+	qsort(ns, BENCH_STARTUP_RUNS, sizeof(*ns), startup_cmp);
+	snprintf(extra, sizeof(extra), "\"history\": %ld, \"p50_ns\": %ld, \"max_ns\": %ld",
+		lines, ns[BENCH_STARTUP_RUNS / 2], ns[BENCH_STARTUP_RUNS - 1]);
+	bench_report(name, BENCH_STARTUP_RUNS, total, extra);
+}
+
+void bench_startup(void){
+	const char *shell = getenv("OSH_BENCH_SHELL");
+	char dir[] = "/tmp/oshean_bench.XXXXXX";
+	// Sized for what is appended to 'dir', snprintf never truncates
+	char conf_dir[sizeof(dir) + sizeof("/oshean")];
+	char conf[sizeof(conf_dir) + sizeof("/config.snap")];
+	char history[sizeof(dir) + sizeof("/history")];
+	FILE *f;
+
+	if (shell == NULL)
+		shell = BENCH_OSHEAN;
+
+	if (mkdtemp(dir) == NULL)
+		return;
+
+	snprintf(conf_dir, sizeof(conf_dir), "%s/oshean", dir);
+	snprintf(conf, sizeof(conf), "%s/config", conf_dir);
+	snprintf(history, sizeof(history), "%s/history", dir);
+
+	if (mkdir(conf_dir, 0700) == 0 && (f = fopen(conf, "w")) != NULL){
+		fprintf(f, "history_file = %s\n", history);
+		fclose(f);
+
+		startup_case("startup_empty", shell, dir, history, 0);
+		startup_case("startup_history", shell, dir, history, BENCH_STARTUP_HISTORY);
+	}
+
+	unlink(history);
+	unlink(conf);
+	// The shell's cached config snapshot
+	strcat(conf, ".snap");
+	unlink(conf);
+	rmdir(conf_dir);
+	rmdir(dir);
+}
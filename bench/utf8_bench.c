@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/utf8.h"
+#include "bench.h"
+
+// Width functions over 4 KB lines of one script each, the way a refresh
+// walks the line one grapheme at a time
+
+#define BENCH_LINE 4096
+#define BENCH_ROUNDS 2000
+
+struct utf8_sample {
+	const char *name;
+	const char *text;
+};
+
+static const struct utf8_sample samples[] = {
+	{ "ascii", "git commit -m 'fix the thing' && make -j8 " },
+	{ "cjk", "\xe6\xbc\xa2\xe5\xad\x97\xe3\x81\x8b\xe3\x81\xaa\xed\x95\x9c\xea\xb8\x80" },
+	{ "emoji", "\xf0\x9f\x98\x80\xf0\x9f\x9a\x80\xf0\x9f\x8e\x89\xf0\x9f\x91\x8d" },
+	{ "mixed", "ls \xe6\x96\x87\xe4\xbb\xb6 e\xcc\x81t\xc3\xa9 \xf0\x9f\x93\x81 dir/" },
+};
+
+static void bench_fill(char *line, const char *text){
+	size_t tlen = strlen(text), len = 0;
+
+	while (len + tlen < BENCH_LINE){
+		memcpy(line + len, text, tlen);
+		len += tlen;
+	}
+	line[len] = '\0';
+}
+
+void bench_utf8(void){
+	static char line[BENCH_LINE];
+	size_t i, s;
+
+	for (s = 0; s < sizeof(samples) / sizeof(samples[0]); s++){
+		char name[64], extra[64];
+		size_t len, cols = 0;
+		long start, ns;
+		int r;
+
+		bench_fill(line, samples[s].text);
+		len = strlen(line);
+
+		start = bench_now();
+		for (r = 0; r < BENCH_ROUNDS; r++){
+			for (i = 0; i < len; ){
+				size_t col;
+
+				i += linenoiseUtf8NextCharLen(line, len, i, &col);
+				cols += col;
+			}
+		}
+		ns = bench_now() - start;
+
+		snprintf(name, sizeof(name), "utf8_next_%s", samples[s].name);
+		snprintf(extra, sizeof(extra), "\"bytes\": %zu, \"cols\": %zu", len, cols / BENCH_ROUNDS);
+		bench_report(name, BENCH_ROUNDS, ns, extra);
+
+		start = bench_now();
+		for (r = 0; r < BENCH_ROUNDS; r++){
+			for (i = len; i > 0; ){
+				size_t col;
+
+				i -= linenoiseUtf8PrevCharLen(line, len, i, &col);
+				cols += col;
+			}
+		}
+		ns = bench_now() - start;
+
+		snprintf(name, sizeof(name), "utf8_prev_%s", samples[s].name);
+		snprintf(extra, sizeof(extra), "\"bytes\": %zu", len);
+		bench_report(name, BENCH_ROUNDS, ns, extra);
+	}
+}
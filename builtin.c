@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include "include/builtin.h"
+#include "include/linenoise.h"
+#include "include/env.h"
+#include "include/path.h"
+#include "include/cmd.h"
+#include "include/job.h"
+#include "include/prompt.h"
+#include "include/alias.h"
+#include "include/parallel.h"
+#include "include/cache.h"
+#include "include/stats.h"
+
+static int builtin_cd(int argc, char **argv){
+	const char *dir = argc > 1 ? argv[1] : osh_env_get("HOME");
+
+	if (dir == NULL){
+		printf("cd: HOME not set\n");
+		return 1;
+	}
+
+	if (chdir(dir) < 0){
+		printf("%s\n", strerror(errno));
+		return 1;
+	}
+
+	osh_prompt_cwd_changed();
+
+	return 0;
+}
+
+// clear screen, basically
+static int builtin_clear(int argc, char **argv){
+	(void)argc;
+	(void)argv;
+
+	linenoiseClearScreen();
+	return 0;
+}
+
+static int builtin_exit(int argc, char **argv){
+	osh_stats_exit();
+	fflush(stdout);
+	exit(argc > 1 ? atoi(argv[1]) : 0);
+}
+
+static int builtin_history(int argc, char **argv){
+	int i, len = linenoiseHistoryLen();
+
+	(void)argc;
+	(void)argv;
+
+	for (i = 0; i < len; i++)
+		printf("%5d  %s\n", i + 1, linenoiseHistoryGet(i));
+
+	return 0;
+}
+
+// ZWFzdGVyIGVnZy4uLg==
+static int builtin_hello(int argc, char **argv){
+	(void)argc;
+	(void)argv;
+
+	printf("Hello, hello? Uh, I wanted to record a message for you to help you get settled "
+		"in your tutorial. Um, I actually developer of oshean. "
+		"I'm finishing up my last commits now, as a matter of fact. "
+		"So, I know it can be a bit weird, "
+		"but I'm here to tell you there's nothing to worry about usage. "
+		"Uh, you'll do fine. "
+		"So, let's just focus on getting you through commands. Okay?\n");
+
+	return 0;
+}
+
+// Keep sorted by strcmp order, looked up with a binary search
+static const struct osh_builtin builtins[] = {
+	{ "Hello", builtin_hello },
+	{ "alias", osh_alias_builtin },
+	{ "bg", osh_job_bg_builtin },
+	{ "cache", osh_cache_builtin },
+	{ "cd", builtin_cd },
+	{ "clear", builtin_clear },
+	{ "exit", builtin_exit },
+	{ "export", osh_env_export_builtin },
+	{ "fg", osh_job_fg_builtin },
+	{ "function", osh_alias_function_builtin },
+	{ "hash", osh_path_hash_builtin },
+	{ "history", builtin_history },
+	{ "jobs", osh_job_jobs_builtin },
+	{ "parallel", osh_parallel_builtin },
+	{ "stats", osh_stats_builtin },
+	{ "unalias", osh_alias_unalias_builtin },
+	{ "unset", osh_env_unset_builtin },
+};
+
+const struct osh_builtin *osh_builtin_list(size_t *n){
+	*n = sizeof(builtins) / sizeof(builtins[0]);
+	return builtins;
+}
+
+const struct osh_builtin *osh_builtin_find(const char *name){
+	size_t lo = 0, hi = sizeof(builtins) / sizeof(builtins[0]);
+
+	while (lo < hi){
+		size_t mid = (lo + hi) / 2;
+		int cmp = strcmp(name, builtins[mid].name);
+
+		if (cmp == 0)
+			return &builtins[mid];
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
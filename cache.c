@@ -0,0 +1,574 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "include/cache.h"
+#include "include/config.h"
+#include "include/env.h"
+#include "include/path.h"
+#include "include/builtin.h"
+#include "include/cmd.h"
+
+// One memoized run. The key is the argv words, cwd and the stat of every
+// declared file, so touching one of them makes a new key and the stale
+// entry just ages out of the LRU.
+struct cache_entry {
+	struct cache_entry *next;
+	// Most recently used first
+	struct cache_entry *newer;
+	struct cache_entry *older;
+	unsigned long hash;
+	size_t keylen;
+	// Bytes of 'data' holding the argv words, for listing
+	size_t argvlen;
+	size_t len;
+	int status;
+	unsigned long hits;
+	// Key, then the output
+	char data[];
+};
+
+// Config rule, commands starting with 'words' are memoized keyed by 'files'
+struct cache_rule {
+	char **words;
+	int nwords;
+	char **files;
+	int nfiles;
+	char *buf;
+};
+
+// Growable byte buffer for keys and captured output
+struct cache_buf {
+	char *buf;
+	size_t len;
+	size_t cap;
+};
+
+static struct cache_entry **cache_tab;
+static size_t cache_tab_size;
+static size_t cache_tab_used;
+static struct cache_entry *cache_newest;
+static struct cache_entry *cache_oldest;
+// Bytes held by entries against the cap
+static size_t cache_bytes;
+static size_t cache_cap = OSH_CACHE_SIZE;
+static unsigned long cache_hits;
+static unsigned long cache_misses;
+
+static struct cache_rule *cache_rules;
+static int cache_nrules;
+
+// Reused between runs, hits never allocate
+static struct cache_buf cache_key;
+static struct cache_buf cache_out;
+
+static unsigned long cache_hash(const char *s, size_t len){
+	// FNV-1a
+	unsigned long h = 2166136261UL;
+
+	while (len--){
+		h ^= (unsigned char)*s++;
+		h *= 16777619UL;
+	}
+
+	return h;
+}
+
+static int cache_append(struct cache_buf *b, const void *s, size_t len){
+	if (b->len + len > b->cap){
+		size_t cap = b->cap ? b->cap * 2 : 256;
+		char *buf;
+
+		while (cap < b->len + len)
+			cap *= 2;
+		if ((buf = realloc(b->buf, cap)) == NULL)
+			return -1;
+		b->buf = buf;
+		b->cap = cap;
+	}
+
+	memcpy(b->buf + b->len, s, len);
+	b->len += len;
+
+	return 0;
+}
+
+static size_t cache_cost(const struct cache_entry *e){
+	return sizeof(*e) + e->keylen + e->len;
+}
+
+static void cache_unlink(struct cache_entry *e){
+	if (e->newer)
+		e->newer->older = e->older;
+	else
+		cache_newest = e->older;
+
+	if (e->older)
+		e->older->newer = e->newer;
+	else
+		cache_oldest = e->newer;
+
+	e->newer = e->older = NULL;
+}
+
+static void cache_push(struct cache_entry *e){
+	e->newer = NULL;
+	e->older = cache_newest;
+
+	if (cache_newest)
+		cache_newest->newer = e;
+	else
+		cache_oldest = e;
+
+	cache_newest = e;
+}
+
+static void cache_drop(struct cache_entry *e){
+	struct cache_entry **pe = &cache_tab[e->hash & (cache_tab_size - 1)];
+
+	while (*pe != e)
+		pe = &(*pe)->next;
+	*pe = e->next;
+
+	cache_unlink(e);
+	cache_bytes -= cache_cost(e);
+	cache_tab_used--;
+	free(e);
+}
+
+static int cache_grow(void){
+	size_t size = cache_tab_size ? cache_tab_size * 2 : 64;
+	struct cache_entry **tab;
+	size_t i;
+
+	if ((tab = calloc(size, sizeof(*tab))) == NULL)
+		return -1;
+
+	for (i = 0; i < cache_tab_size; i++){
+		struct cache_entry *e = cache_tab[i];
+
+		while (e){
+			struct cache_entry *next = e->next;
+			size_t b = e->hash & (size - 1);
+
+			e->next = tab[b];
+			tab[b] = e;
+			e = next;
+		}
+	}
+
+	free(cache_tab);
+	cache_tab = tab;
+	cache_tab_size = size;
+
+	return 0;
+}
+
+static struct cache_entry *cache_find(const char *key, size_t len, unsigned long h){
+	struct cache_entry *e;
+
+	if (cache_tab_size == 0)
+		return NULL;
+
+	for (e = cache_tab[h & (cache_tab_size - 1)]; e; e = e->next)
+		if (e->hash == h && e->keylen == len && !memcmp(e->data, key, len))
+			return e;
+
+	return NULL;
+}
+
+// Keep a finished run, evicting from the old end to stay under the cap
+static void cache_store(const char *key, size_t keylen, size_t argvlen, unsigned long h,
+		const char *out, size_t len, int status){
+	struct cache_entry *e;
+	size_t b;
+
+	if (sizeof(*e) + keylen + len > cache_cap)
+		return;
+
+	if (cache_tab_used >= cache_tab_size && cache_grow() < 0)
+		return;
+
+	if ((e = malloc(sizeof(*e) + keylen + len)) == NULL)
+		return;
+
+	e->hash = h;
+	e->keylen = keylen;
+	e->argvlen = argvlen;
+	e->len = len;
+	e->status = status;
+	e->hits = 0;
+	memcpy(e->data, key, keylen);
+	memcpy(e->data + keylen, out, len);
+
+	while (cache_oldest && cache_bytes + cache_cost(e) > cache_cap)
+		cache_drop(cache_oldest);
+
+	b = h & (cache_tab_size - 1);
+	e->next = cache_tab[b];
+	cache_tab[b] = e;
+	cache_push(e);
+	cache_bytes += cache_cost(e);
+	cache_tab_used++;
+}
+
+// argv words, cwd and for each file its name with inode, size and mtime,
+// all \0 separated. Returns the length of the argv part.
+static size_t cache_make_key(char **argv, char **files, int nfiles){
+	char cwd[PATH_MAX];
+	size_t argvlen;
+	int i;
+
+	cache_key.len = 0;
+
+	for (i = 0; argv[i]; i++)
+		cache_append(&cache_key, argv[i], strlen(argv[i]) + 1);
+	argvlen = cache_key.len;
+	cache_append(&cache_key, "", 1);
+
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		cwd[0] = '\0';
+	cache_append(&cache_key, cwd, strlen(cwd) + 1);
+
+	for (i = 0; i < nfiles; i++){
+		struct stat st;
+		long v[4] = { 0 };
+
+		if (stat(files[i], &st) == 0){
+			v[0] = st.st_ino;
+			v[1] = st.st_size;
+			v[2] = st.st_mtim.tv_sec;
+			v[3] = st.st_mtim.tv_nsec;
+		}
+
+		cache_append(&cache_key, files[i], strlen(files[i]) + 1);
+		cache_append(&cache_key, v, sizeof(v));
+	}
+
+	return argvlen;
+}
+
+// Run argv with stdout into cache_out, copied to 'fd_out' as it comes
+static int cache_exec(char **argv, int fd_out, int *status){
+	struct osh_launch l = { 0 };
+	char buf[16384];
+	ssize_t r;
+	pid_t pid;
+	int p[2];
+
+	if ((l.path = osh_path_lookup(argv[0])) == NULL){
+		printf("%s: command not found\n", argv[0]);
+		return -1;
+	}
+
+	if (pipe2(p, O_CLOEXEC) < 0){
+		printf("%s: pipe\n", strerror(errno));
+		return -1;
+	}
+
+	for (l.argc = 0; argv[l.argc]; l.argc++)
+		;
+	l.argv = argv;
+	l.envp = osh_env_vec();
+	l.fd_in = -1;
+	l.fd_out = p[1];
+	l.pgid = -1;
+
+	fflush(stdout);
+	pid = cmd_launch_oshean(&l);
+	close(p[1]);
+
+	if (pid < 0){
+		close(p[0]);
+		return -1;
+	}
+
+	cache_out.len = 0;
+
+	while ((r = read(p[0], buf, sizeof(buf))) != 0){
+		if (r < 0){
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		cache_append(&cache_out, buf, r);
+		if (fd_out >= 0 && write(fd_out, buf, r) < 0)
+			fd_out = -1;
+	}
+	close(p[0]);
+
+	while (waitpid(pid, status, 0) < 0 && errno == EINTR)
+		;
+
+	return 0;
+}
+
+int osh_cache_run(char **argv, char **files, int nfiles, int fd_out, struct osh_cache_result *r){
+	struct cache_entry *e;
+	size_t argvlen = cache_make_key(argv, files, nfiles);
+	unsigned long h = cache_hash(cache_key.buf, cache_key.len);
+	int status;
+
+	if ((e = cache_find(cache_key.buf, cache_key.len, h)) != NULL){
+		cache_unlink(e);
+		cache_push(e);
+		e->hits++;
+		cache_hits++;
+
+		r->out = e->data + e->keylen;
+		r->len = e->len;
+		r->status = e->status;
+		r->hit = 1;
+
+		if (fd_out >= 0 && r->len){
+			const char *s = r->out;
+			size_t len = r->len;
+
+			while (len){
+				ssize_t w = write(fd_out, s, len);
+
+				if (w < 0){
+					if (errno == EINTR)
+						continue;
+					break;
+				}
+				s += w;
+				len -= w;
+			}
+		}
+
+		return 0;
+	}
+
+	cache_misses++;
+
+	if (cache_exec(argv, fd_out, &status) < 0)
+		return -1;
+
+	r->out = cache_out.buf;
+	r->len = cache_out.len;
+	r->hit = 0;
+
+	// Interrupted runs are not their command's answer
+	if (WIFSIGNALED(status)){
+		r->status = 128 + WTERMSIG(status);
+		return 0;
+	}
+
+	r->status = WEXITSTATUS(status);
+	cache_store(cache_key.buf, cache_key.len, argvlen, h, cache_out.buf, cache_out.len, r->status);
+
+	return 0;
+}
+
+// Split 's' on blanks in place, the vector is malloc'ed
+static char **cache_split(char *s, int *n){
+	char **v;
+	int cap = 1, i = 0;
+	char *p;
+
+	for (p = s; *p; p++)
+		if (*p == ' ' || *p == '\t')
+			cap++;
+
+	if ((v = malloc((cap + 1) * sizeof(*v))) == NULL)
+		return NULL;
+
+	for (p = strtok(s, " \t"); p; p = strtok(NULL, " \t"))
+		v[i++] = p;
+	v[i] = NULL;
+
+	*n = i;
+	return v;
+}
+
+static void cache_config(const char *name, const char *val, void *arg){
+	struct cache_rule *rules, *r;
+	size_t nlen = strlen(name) + 1;
+
+	(void)arg;
+
+	if ((rules = realloc(cache_rules, (cache_nrules + 1) * sizeof(*rules))) == NULL)
+		return;
+	cache_rules = rules;
+	r = &cache_rules[cache_nrules];
+
+	if ((r->buf = malloc(nlen + strlen(val) + 1)) == NULL)
+		return;
+	memcpy(r->buf, name, nlen);
+	strcpy(r->buf + nlen, val);
+
+	r->words = cache_split(r->buf, &r->nwords);
+	r->files = cache_split(r->buf + nlen, &r->nfiles);
+
+	if (r->words == NULL || r->files == NULL || r->nwords == 0){
+		free(r->words);
+		free(r->files);
+		free(r->buf);
+		return;
+	}
+
+	cache_nrules++;
+}
+
+void osh_cache_init(void){
+	long cap = osh_config_long("cache_size", OSH_CACHE_SIZE);
+
+	if (cap > 0)
+		cache_cap = cap;
+
+	osh_config_each("cache ", cache_config, NULL);
+}
+
+static void cache_clear(void){
+	while (cache_oldest)
+		cache_drop(cache_oldest);
+}
+
+void osh_cache_free(void){
+	int i;
+
+	cache_clear();
+	free(cache_tab);
+	cache_tab = NULL;
+	cache_tab_size = 0;
+
+	for (i = 0; i < cache_nrules; i++){
+		free(cache_rules[i].words);
+		free(cache_rules[i].files);
+		free(cache_rules[i].buf);
+	}
+	free(cache_rules);
+	cache_rules = NULL;
+	cache_nrules = 0;
+
+	free(cache_key.buf);
+	free(cache_out.buf);
+	cache_key = cache_out = (struct cache_buf){ 0 };
+}
+
+// The longest rule argv starts with, NULL for none
+static struct cache_rule *cache_rule_find(int argc, char **argv){
+	struct cache_rule *best = NULL;
+	int i, j;
+
+	for (i = 0; i < cache_nrules; i++){
+		struct cache_rule *r = &cache_rules[i];
+
+		if (r->nwords > argc || (best && best->nwords >= r->nwords))
+			continue;
+
+		for (j = 0; j < r->nwords && !strcmp(r->words[j], argv[j]); j++)
+			;
+		if (j == r->nwords)
+			best = r;
+	}
+
+	return best;
+}
+
+int osh_cache_rule_match(int argc, char **argv){
+	return cache_nrules && cache_rule_find(argc, argv) != NULL;
+}
+
+static int cache_list(void){
+	struct cache_entry *e;
+
+	for (e = cache_newest; e; e = e->older){
+		size_t i;
+
+		printf("%6lu %8zu  ", e->hits, e->len);
+		for (i = 0; i + 1 < e->argvlen; i++)
+			putchar(e->data[i] ? e->data[i] : ' ');
+		putchar('\n');
+	}
+
+	printf("%zu entries, %zu of %zu bytes, %lu hits, %lu misses\n",
+		cache_tab_used, cache_bytes, cache_cap, cache_hits, cache_misses);
+
+	return 0;
+}
+
+static int cache_run_builtin(char **argv, char **files, int nfiles){
+	const struct osh_builtin *b;
+	struct osh_cache_result r;
+	int argc;
+
+	// Builtins are cheap and may change the shell, never memoized
+	if ((b = osh_builtin_find(argv[0])) != NULL){
+		for (argc = 0; argv[argc]; argc++)
+			;
+		return b->fn(argc, argv);
+	}
+
+	if (osh_cache_run(argv, files, nfiles, STDOUT_FILENO, &r) < 0)
+		return 127;
+
+	return r.status;
+}
+
+int osh_cache_builtin(int argc, char **argv){
+	struct cache_rule *rule;
+	char **files;
+	int i, nfiles = 0, ret;
+
+	if (argc == 1)
+		return cache_list();
+
+	if (argc == 2 && !strcmp(argv[1], "-c")){
+		cache_clear();
+		cache_hits = cache_misses = 0;
+		return 0;
+	}
+
+	if ((files = malloc(argc * sizeof(*files))) == NULL){
+		printf("NULL Memory Allocation\n");
+		return 1;
+	}
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++){
+		if (!strcmp(argv[i], "--")){
+			i++;
+			break;
+		} else if (!strcmp(argv[i], "-f") && i + 1 < argc){
+			files[nfiles++] = argv[++i];
+		} else if (!strncmp(argv[i], "-f", 2) && argv[i][2]){
+			files[nfiles++] = argv[i] + 2;
+		} else {
+			printf("cache: %s: unknown option\n", argv[i]);
+			free(files);
+			return 2;
+		}
+	}
+
+	if (i == argc){
+		printf("usage: cache [-f FILE]... command ...\n");
+		free(files);
+		return 2;
+	}
+
+	// No files given, a matching rule still knows what the command reads
+	if (nfiles == 0 && (rule = cache_rule_find(argc - i, argv + i)) != NULL)
+		ret = cache_run_builtin(argv + i, rule->files, rule->nfiles);
+	else
+		ret = cache_run_builtin(argv + i, files, nfiles);
+
+	free(files);
+	return ret;
+}
+
+int osh_cache_rule_builtin(int argc, char **argv){
+	struct cache_rule *rule = cache_rule_find(argc, argv);
+
+	if (rule == NULL)
+		return cache_run_builtin(argv, NULL, 0);
+
+	return cache_run_builtin(argv, rule->files, rule->nfiles);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Print what 'group' got wrong, printf style, and count it: returns 1
+int check_fail(const char *group, const char *fmt, ...);
+
+// Width tables against their previous form on every code point, and
+// character lengths in scripts with combining marks
+int check_utf8(void);
+// Pipelines, background jobs and syntax errors from osh_parse, with and
+// without aliases
+int check_parse(void);
+// Pipelines run for real, builtins in them must leave the shell alone
+int check_exec(void);
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/parse.h"
+#include "../include/cmd.h"
+#include "check.h"
+
+// Lines run through cmd_exec_oshean with the status they end with. None
+// of them may move the shell out of its directory, or end it.
+static const struct {
+	const char *line;
+	int status;
+} exec_cases[] = {
+	{ "true", 0 },
+	{ "false", 1 },
+	// Builtins in a pipeline run in a subshell of their own
+	{ "cd / | cat", 0 },
+	{ "true | cd /", 0 },
+	{ "cd / | cd / | true", 0 },
+	{ "exit 3 | cat", 0 },
+	{ "true | exit 3", 3 },
+	{ "echo a | cat > /dev/null", 0 },
+};
+
+int check_exec(void){
+	struct osh_arena a;
+	char cwd[4096], now[4096];
+	size_t i;
+	int fails = 0;
+
+	if (getcwd(cwd, sizeof(cwd)) == NULL)
+		return check_fail("exec", "no working directory");
+
+	osh_arena_init(&a);
+
+	for (i = 0; i < sizeof(exec_cases) / sizeof(exec_cases[0]); i++){
+		struct osh_pipeline *pl;
+		char line[256];
+		int status;
+
+		osh_arena_reset(&a);
+		snprintf(line, sizeof(line), "%s", exec_cases[i].line);
+
+		if ((pl = osh_parse(&a, line)) == NULL){
+			fails += check_fail("exec", "\"%s\": syntax error", exec_cases[i].line);
+			continue;
+		}
+
+		fflush(stdout);
+		status = cmd_exec_oshean(pl);
+
+		if (status != exec_cases[i].status)
+			fails += check_fail("exec", "\"%s\": status %d, want %d", exec_cases[i].line,
+				status, exec_cases[i].status);
+
+		if (getcwd(now, sizeof(now)) == NULL || strcmp(now, cwd)){
+			fails += check_fail("exec", "\"%s\": moved the shell to %s", exec_cases[i].line, now);
+			if (chdir(cwd) < 0)
+				break;
+		}
+	}
+
+	osh_arena_free(&a);
+
+	return fails;
+}
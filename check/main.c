@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include "../include/sh.h"
+#include "check.h"
+
+// Regression checks for behaviour that broke before without anything
+// noticing: make check, ctest, or oshean_check with the names of the
+// groups to run. Each group prints its failures and the exit status is
+// non-zero if there were any.
+
+struct check_group {
+	const char *name;
+	// Returns the number of failures
+	int (*fn)(void);
+};
+
+static const struct check_group groups[] = {
+	{ "utf8", check_utf8 },
+	{ "parse", check_parse },
+	{ "exec", check_exec },
+};
+
+int check_fail(const char *group, const char *fmt, ...){
+	va_list ap;
+
+	printf("%s: FAIL ", group);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+
+	return 1;
+}
+
+int main(int argc, char **argv){
+	size_t g;
+	int i, fails = 0;
+
+	osh_init_shell(0);
+
+	for (i = 1; i < argc; i++){
+		for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++)
+			if (!strcmp(argv[i], groups[g].name))
+				break;
+
+		if (g == sizeof(groups) / sizeof(groups[0])){
+			fprintf(stderr, "oshean_check: %s: unknown group\n", argv[i]);
+			return 2;
+		}
+	}
+
+	for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++){
+		int run = argc == 1, n;
+
+		for (i = 1; i < argc && !run; i++)
+			run = !strcmp(argv[i], groups[g].name);
+
+		if (!run)
+			continue;
+
+		n = groups[g].fn();
+		printf("%s: %s\n", groups[g].name, n ? "FAILED" : "ok");
+		fails += n;
+	}
+
+	return fails != 0;
+}
@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/parse.h"
+#include "../include/alias.h"
+#include "../include/env.h"
+#include "check.h"
+
+// What osh_parse makes of a line: the words of every stage in brackets
+// followed by its redirections as descriptor, operator and [word], stages
+// separated by " | ", then " &" for background, or NULL for a syntax
+// error. n<&m and n>&m are the same dup and both show as >&. $OSH_CHECK is "x y", $OSH_CHECK_UNSET is not set.
+static const struct {
+	const char *line;
+	const char *want;
+} parse_cases[] = {
+	{ "echo a", "[echo] [a]" },
+	{ "  echo\ta  ", "[echo] [a]" },
+	{ "", "" },
+	{ "echo a | cat", "[echo] [a] | [cat]" },
+	{ "echo a|cat", "[echo] [a] | [cat]" },
+	{ "sleep 1 &", "[sleep] [1] &" },
+	{ "a | b &", "[a] | [b] &" },
+	{ "cmd > out arg", "[cmd] [arg] 1>[out]" },
+	{ "time a | b", "[a] | [b]" },
+	// Quotes and backslashes, none of them splits a word
+	{ "echo 'a b' c", "[echo] [a b] [c]" },
+	{ "echo \"a b\"", "[echo] [a b]" },
+	{ "echo 'a'\"b\"c", "[echo] [abc]" },
+	{ "echo '' \"\"", "[echo] [] []" },
+	{ "echo 'a\"b' \"a'b\"", "[echo] [a\"b] [a'b]" },
+	{ "echo 'a\\b'", "[echo] [a\\b]" },
+	{ "echo a\\ b \\'", "[echo] [a b] [']" },
+	{ "echo \"a\\\"b\\\\c\\$d\\n\"", "[echo] [a\"b\\c$d\\n]" },
+	{ "echo 'a|b' \"c&d\" e\\>f", "[echo] [a|b] [c&d] [e>f]" },
+	{ "echo 'a", NULL },
+	{ "echo \"a", NULL },
+	// Variables, expanded outside single quotes and never split
+	{ "echo $OSH_CHECK", "[echo] [x y]" },
+	{ "echo \"<$OSH_CHECK>\"", "[echo] [<x y>]" },
+	{ "echo ${OSH_CHECK}z", "[echo] [x yz]" },
+	{ "echo '$OSH_CHECK' \\$OSH_CHECK", "[echo] [$OSH_CHECK] [$OSH_CHECK]" },
+	{ "echo a$OSH_CHECK_UNSET.", "[echo] [a.]" },
+	{ "echo $ \"$\"", "[echo] [$] [$]" },
+	// # starts a comment only at the start of a word
+	{ "echo a # b", "[echo] [a]" },
+	{ "echo a#b '#' \\#", "[echo] [a#b] [#] [#]" },
+	{ "# echo a", "" },
+	// Redirections, applied left to right
+	{ "cmd > out", "[cmd] 1>[out]" },
+	{ "cmd >> log", "[cmd] 1>>[log]" },
+	{ "cmd < in", "[cmd] 0<[in]" },
+	{ "cmd >out<in", "[cmd] 1>[out] 0<[in]" },
+	{ "cmd 2>err", "[cmd] 2>[err]" },
+	{ "cmd > out 2>&1", "[cmd] 1>[out] 2>&[1]" },
+	{ "cmd 0<&3 3<&-", "[cmd] 0>&[3] 3>&[-]" },
+	{ "cmd >&2", "[cmd] 1>&[2]" },
+	{ "cat <<< 'a b'", "[cat] 0<<<[a b]" },
+	{ "cat 3<<<a", "[cat] 3<<<[a]" },
+	{ "cmd > 'a b' > $OSH_CHECK", "[cmd] 1>[a b] 1>[x y]" },
+	{ "a 2>&1 | b > out", "[a] 2>&[1] | [b] 1>[out]" },
+	{ "> out", " 1>[out]" },
+	// Only a single bare digit names the descriptor
+	{ "echo 12> f", "[echo] [12] 1>[f]" },
+	{ "echo 2 > f", "[echo] [2] 1>[f]" },
+	{ "echo '2'> f \\3> g", "[echo] [2] [3] 1>[f] 1>[g]" },
+	{ "echo a2>f", "[echo] [a2] 1>[f]" },
+	{ "cmd >", NULL },
+	{ "cmd > > f", NULL },
+	{ "cmd 2>&", NULL },
+	{ "cmd <<< | b", NULL },
+	// & in the middle of a line is no pipe
+	{ "echo a & echo b", NULL },
+	{ "echo a & | cat", NULL },
+	{ "echo a && echo b", NULL },
+	{ "& echo a", NULL },
+	{ "&", NULL },
+	{ "echo a |", NULL },
+	{ "| echo a", NULL },
+	{ "cat <", NULL },
+	// Expanded aliases follow the same rules
+	{ "ll &", "[ls] [-l] &" },
+	{ "ll | ll", "[ls] [-l] | [ls] [-l]" },
+	{ "bgtrue", "[true] &" },
+	{ "bgtrue | cat", NULL },
+};
+
+static const char *parse_redir_op(enum osh_redir_type type){
+	switch (type){
+	case OSH_REDIR_IN:
+		return "<";
+	case OSH_REDIR_APPEND:
+		return ">>";
+	case OSH_REDIR_DUP:
+		return ">&";
+	case OSH_REDIR_STRING:
+		return "<<<";
+	default:
+		return ">";
+	}
+}
+
+static void parse_words(const struct osh_pipeline *pl, char *out, size_t len){
+	size_t used = 0;
+	int c, i;
+
+	out[0] = '\0';
+	for (c = 0; c < pl->ncmds; c++){
+		const struct osh_cmd *cmd = &pl->cmds[c];
+
+		if (c)
+			used += snprintf(out + used, used < len ? len - used : 0, " | ");
+		for (i = 0; i < cmd->argc; i++)
+			used += snprintf(out + used, used < len ? len - used : 0, "%s[%s]",
+				i ? " " : "", cmd->argv[i]);
+		for (i = 0; i < cmd->nredirs; i++)
+			used += snprintf(out + used, used < len ? len - used : 0, " %d%s[%s]",
+				cmd->redirs[i].fd, parse_redir_op(cmd->redirs[i].type), cmd->redirs[i].word);
+	}
+	if (pl->background)
+		snprintf(out + used, used < len ? len - used : 0, " &");
+}
+
+int check_parse(void){
+	// The builtin splits its arguments in place
+	char name[] = "alias", ll[] = "ll=ls -l", bgtrue[] = "bgtrue=true &";
+	char *argv[] = { name, ll, bgtrue, NULL };
+	struct osh_arena a;
+	size_t i;
+	int fails = 0;
+
+	osh_arena_init(&a);
+	osh_alias_builtin(3, argv);
+	osh_env_set("OSH_CHECK", "x y");
+	osh_env_unset("OSH_CHECK_UNSET");
+
+	for (i = 0; i < sizeof(parse_cases) / sizeof(parse_cases[0]); i++){
+		struct osh_pipeline *pl;
+		char line[256], got[256];
+
+		osh_arena_reset(&a);
+		snprintf(line, sizeof(line), "%s", parse_cases[i].line);
+
+		if ((pl = osh_parse(&a, line)) != NULL)
+			parse_words(pl, got, sizeof(got));
+
+		if (pl == NULL && parse_cases[i].want == NULL)
+			continue;
+		if (pl != NULL && parse_cases[i].want != NULL && !strcmp(got, parse_cases[i].want))
+			continue;
+
+		fails += check_fail("parse", "\"%s\": got %s%s%s, want %s", parse_cases[i].line,
+			pl ? "\"" : "", pl ? got : "a syntax error", pl ? "\"" : "",
+			parse_cases[i].want ? parse_cases[i].want : "a syntax error");
+	}
+
+	osh_alias_free();
+	osh_env_unset("OSH_CHECK");
+	osh_arena_free(&a);
+
+	return fails;
+}
@@ -1,65 +1,636 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <signal.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/wait.h>
 #include <errno.h>
 #include <string.h>
 #include "include/linenoise.h"
 #include "include/std.h"
 #include "include/env.h"
+#include "include/path.h"
+#include "include/parse.h"
+#include "include/builtin.h"
+#include "include/job.h"
+#include "include/cache.h"
+#include "include/stats.h"
+#include "include/cmd.h"
 
-extern char **environ;
+// Pipe buffer size asked for in pipelines longer than two stages
+#define OSH_PIPE_SIZE (256 * 1024)
 
-int cmd_exec_oshean(char *input_cmd_oshean, char **args){
-	char *cmd;
-	char *env_val[100];
-	pid_t pid_exec;
-		
-	set_env_var(env_val, environ);
+// Which launch path every external command took
+struct osh_launch_stats osh_launch_stats;
 
-	cmd = (char*)malloc(strlen(input_cmd_oshean)+9+1+sizeof(args)+1);
+// Commands named by a "cache" config rule run as if given to the builtin
+static const struct osh_builtin cmd_cached = { "cache", osh_cache_rule_builtin };
 
-	// Memory check
-	if (cmd == NULL){
-		printf("NULL Memory Allocation\n");
+void cmd_init_oshean(int interactive){
+	// Builtins write to pipe readers that may be gone, take EPIPE instead
+	signal(SIGPIPE, SIG_IGN);
+
+	// SIGCHLD reaping, process groups and terminal hand over
+	osh_job_init(interactive);
+}
+
+// Signals the shell may ignore, children start with the default actions
+static void cmd_child_sigset(sigset_t *set){
+	sigemptyset(set);
+	sigaddset(set, SIGTTOU);
+	sigaddset(set, SIGTTIN);
+	sigaddset(set, SIGTSTP);
+	sigaddset(set, SIGINT);
+	sigaddset(set, SIGQUIT);
+	sigaddset(set, SIGPIPE);
+}
+
+static int cmd_write_all(int fd, const char *s, size_t len){
+	while (len){
+		ssize_t w = write(fd, s, len);
+
+		if (w < 0){
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		s += w;
+		len -= w;
+	}
+
+	return 0;
+}
+
+// Here-string text and its newline in a memfd, or in a pipe that has to
+// hold all of it where memfd_create is missing. Never a temporary file.
+static int cmd_herestring(const char *word){
+	size_t len = strlen(word);
+	int fd, p[2];
+
+	if ((fd = memfd_create("oshean-herestring", MFD_CLOEXEC)) >= 0){
+		if (cmd_write_all(fd, word, len) < 0 || cmd_write_all(fd, "\n", 1) < 0 ||
+		    lseek(fd, 0, SEEK_SET) < 0){
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	if (pipe2(p, O_CLOEXEC) < 0)
+		return -1;
+
+	// Nobody reads before the child starts, a full pipe must not block us
+	if (len + 1 > 65536)
+		fcntl(p[1], F_SETPIPE_SZ, (int)(len + 1));
+	fcntl(p[1], F_SETFL, O_NONBLOCK);
+
+	if (cmd_write_all(p[1], word, len) < 0 || cmd_write_all(p[1], "\n", 1) < 0){
+		close(p[0]);
+		close(p[1]);
+		errno = EFBIG;
+		return -1;
+	}
+
+	close(p[1]);
+	return p[0];
+}
+
+// Open what the redirections of 'c' name, in the shell so errors are ours
+// to report. Every source is moved to OSH_REDIR_FDS or above, so putting
+// one in place in the child never overwrites the source of the next.
+// 'fd_in' and 'fd_out' are where the pipeline already points 0 and 1.
+// Returns the number of entries in 'map', or -1 once the error is printed.
+static int cmd_redirs(const struct osh_cmd *c, int fd_in, int fd_out, struct osh_fdmap *map){
+	// Source of each child descriptor, -2 while it's left alone
+	int cur[OSH_REDIR_FDS];
+	int i, n = 0;
+
+	for (i = 0; i < OSH_REDIR_FDS; i++)
+		cur[i] = -2;
+
+	for (i = 0; i < c->nredirs; i++){
+		const struct osh_redir *r = &c->redirs[i];
+		int src = -1, from;
+
+		switch (r->type){
+		case OSH_REDIR_IN:
+			src = open(r->word, O_RDONLY | O_CLOEXEC);
+			break;
+		case OSH_REDIR_OUT:
+			src = open(r->word, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+			break;
+		case OSH_REDIR_APPEND:
+			src = open(r->word, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+			break;
+		case OSH_REDIR_STRING:
+			src = cmd_herestring(r->word);
+			break;
+		case OSH_REDIR_DUP:
+			if (!strcmp(r->word, "-"))
+				break;
+
+			if (r->word[0] < '0' || r->word[0] > '9' || r->word[1] != '\0'){
+				printf("oshean: %s: ambiguous redirect\n", r->word);
+				goto fail;
+			}
+
+			from = r->word[0] - '0';
+			if (cur[from] != -2)
+				from = cur[from];
+			else if (from == 0 && fd_in >= 0)
+				from = fd_in;
+			else if (from == 1 && fd_out >= 0)
+				from = fd_out;
+
+			if (from < 0 || (src = fcntl(from, F_DUPFD_CLOEXEC, OSH_REDIR_FDS)) < 0){
+				printf("oshean: %s: %s\n", r->word, strerror(EBADF));
+				goto fail;
+			}
+			break;
+		}
+
+		if (src < 0 && r->type != OSH_REDIR_DUP){
+			printf("oshean: %s: %s\n", r->word, strerror(errno));
+			goto fail;
+		}
+
+		if (src >= 0 && src < OSH_REDIR_FDS){
+			int moved = fcntl(src, F_DUPFD_CLOEXEC, OSH_REDIR_FDS);
+
+			close(src);
+			if ((src = moved) < 0){
+				printf("oshean: %s: %s\n", r->word, strerror(errno));
+				goto fail;
+			}
+		}
+
+		if (cur[r->fd] >= 0)
+			close(cur[r->fd]);
+		cur[r->fd] = src;
+	}
+
+	for (i = 0; i < OSH_REDIR_FDS; i++){
+		if (cur[i] == -2)
+			continue;
+		map[n].fd = i;
+		map[n].src = cur[i];
+		n++;
 	}
 
-	if (!strcmp(input_cmd_oshean, "exit")){
-		exit(0);
+	return n;
+
+fail:
+	for (i = 0; i < OSH_REDIR_FDS; i++)
+		if (cur[i] >= 0)
+			close(cur[i]);
+
+	return -1;
+}
+
+static void cmd_redirs_close(struct osh_fdmap *map, int n){
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (map[i].src >= 0)
+			close(map[i].src);
+}
+
+// Classic fork + execve, only for children that need arbitrary setup code
+// between fork and exec which posix_spawn can't express
+static pid_t cmd_launch_fork(struct osh_launch *l){
+	pid_t pid;
+
+	if ((pid = fork()) < 0){
+		printf("Error can't fork()\n");
+		return -1;
+	}
+
+	if (pid == 0){
+		sigset_t set;
+		int sig, i, err;
+
+		if (l->pgid >= 0){
+			setpgid(0, l->pgid);
+			if (l->foreground)
+				tcsetpgrp(STDIN_FILENO, getpgrp());
+		}
+
+		cmd_child_sigset(&set);
+		for (sig = 1; sig < NSIG; sig++)
+			if (sigismember(&set, sig))
+				signal(sig, SIG_DFL);
+
+		if (l->fd_in >= 0)
+			dup2(l->fd_in, STDIN_FILENO);
+		if (l->fd_out >= 0)
+			dup2(l->fd_out, STDOUT_FILENO);
+
+		for (i = 0; i < l->nfdmap; i++){
+			if (l->fdmap[i].src < 0)
+				close(l->fdmap[i].fd);
+			else
+				dup2(l->fdmap[i].src, l->fdmap[i].fd);
+		}
+
+		if (l->builtin){
+			int ret = l->builtin(l->argc, l->argv);
+
+			fflush(stdout);
+			_exit(ret);
+		}
+
+		execve(l->path, l->argv, l->envp);
+		// Straight to the descriptor, _exit would drop anything buffered
+		err = errno;
+		dprintf(STDERR_FILENO, "%s: %s\n", strerror(err), l->path);
+		_exit(err == ENOENT ? 127 : 126);
+	}
+
+	osh_launch_stats.fork++;
+	return pid;
+}
+
+// posix_spawn fast path, glibc implements it with clone(CLONE_VM|CLONE_VFORK)
+// so the shell's page tables are never copied no matter how large it grows
+static pid_t cmd_launch_spawn(struct osh_launch *l){
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t attr;
+	sigset_t set;
+	short flags = POSIX_SPAWN_SETSIGDEF;
+	pid_t pid;
+	int err, i;
+
+	posix_spawn_file_actions_init(&fa);
+	posix_spawnattr_init(&attr);
+
+#ifdef OSH_HAVE_SPAWN_TCSETPGRP
+	// The child takes the terminal itself before exec, from the parent it
+	// could already be reading in the background and stop on SIGTTIN. It
+	// comes first, while stdin is still the terminal, and runs after the
+	// child joined its process group.
+	if (l->foreground && l->pgid >= 0)
+		posix_spawn_file_actions_addtcsetpgrp_np(&fa, STDIN_FILENO);
+#endif
+
+	if (l->fd_in >= 0)
+		posix_spawn_file_actions_adddup2(&fa, l->fd_in, STDIN_FILENO);
+	if (l->fd_out >= 0)
+		posix_spawn_file_actions_adddup2(&fa, l->fd_out, STDOUT_FILENO);
+
+	// Sources sit above every target, so the order given is safe
+	for (i = 0; i < l->nfdmap; i++){
+		if (l->fdmap[i].src < 0)
+			posix_spawn_file_actions_addclose(&fa, l->fdmap[i].fd);
+		else
+			posix_spawn_file_actions_adddup2(&fa, l->fdmap[i].src, l->fdmap[i].fd);
 	}
 
-	if (input_cmd_oshean < 0 || input_cmd_oshean == NULL){
+	if (l->pgid >= 0){
+		flags |= POSIX_SPAWN_SETPGROUP;
+		posix_spawnattr_setpgroup(&attr, l->pgid);
+	}
+
+	cmd_child_sigset(&set);
+	posix_spawnattr_setsigdefault(&attr, &set);
+	posix_spawnattr_setflags(&attr, flags);
+
+	err = posix_spawn(&pid, l->path, &fa, &attr, l->argv, l->envp);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&fa);
+
+	if (err != 0){
+		printf("%s: %s\n", strerror(err), l->path);
+		errno = err;
+		return -1;
+	}
+
+	osh_launch_stats.spawn++;
+	return pid;
+}
+
+pid_t cmd_launch_oshean(struct osh_launch *l){
+	int fork_only = l->flags & OSH_LAUNCH_FORK;
+	pid_t pid;
+
+#ifndef OSH_HAVE_SPAWN_TCSETPGRP
+	// posix_spawn can't hand the terminal over, the forked child does it
+	// before exec
+	if (l->foreground && l->pgid >= 0)
+		fork_only = 1;
+#endif
+
+	if (fork_only)
+		pid = cmd_launch_fork(l);
+	else
+		pid = cmd_launch_spawn(l);
+	OSH_STATS_EXEC();
+
+	if (pid < 0 || l->pgid < 0)
+		return pid;
+
+	// Also done from the parent so the group exists before the next stage
+	// joins it, whichever of the two runs first. The child has taken the
+	// terminal already, this only covers a failed hand over.
+	setpgid(pid, l->pgid ? l->pgid : pid);
+	if (l->foreground)
+		tcsetpgrp(STDIN_FILENO, l->pgid ? l->pgid : pid);
+
+	return pid;
+}
+
+// Run a builtin inside the shell with its stdin, stdout and redirections
+// in place for the duration of the call
+static int cmd_run_builtin(const struct osh_builtin *b, struct osh_cmd *c, int fd_in, int fd_out,
+		const struct osh_fdmap *map, int nmap){
+	// The shell's own descriptors, -2 for untouched and -1 for not open
+	int saved[OSH_REDIR_FDS];
+	struct osh_fdmap all[OSH_REDIR_FDS + 2];
+	int i, n = 0, ret;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	if (fd_in >= 0)
+		all[n].fd = STDIN_FILENO, all[n++].src = fd_in;
+	if (fd_out >= 0)
+		all[n].fd = STDOUT_FILENO, all[n++].src = fd_out;
+	for (i = 0; i < nmap; i++)
+		all[n++] = map[i];
+
+	for (i = 0; i < OSH_REDIR_FDS; i++)
+		saved[i] = -2;
+
+	for (i = 0; i < n; i++){
+		int fd = all[i].fd;
+
+		if (saved[fd] == -2)
+			saved[fd] = fcntl(fd, F_DUPFD_CLOEXEC, OSH_REDIR_FDS);
+
+		if (all[i].src < 0)
+			close(fd);
+		else
+			dup2(all[i].src, fd);
+	}
+
+	ret = b->fn(c->argc, c->argv);
+
+	fflush(stdout);
+	clearerr(stdout);
+	fflush(stderr);
+
+	for (i = 0; i < OSH_REDIR_FDS; i++){
+		if (saved[i] == -2)
+			continue;
+
+		if (saved[i] >= 0){
+			dup2(saved[i], i);
+			close(saved[i]);
+		} else {
+			close(i);
+		}
+	}
+
+	return ret;
+}
+
+int cmd_exec_oshean(struct osh_pipeline *pl){
+	pid_t pgid = osh_job_control ? 0 : -1;
+	const struct osh_builtin *b;
+	struct osh_job *j;
+	int (*fds)[2];
+	pid_t *pids;
+	pid_t pids_last;
+	int i, n, status = 0;
+
+	if (pl == NULL || pl->ncmds == 0){
 		printf("NULL input\n");
 		exit(1);
 	}
 
-	// Fork process
-	pid_exec = fork();
+	n = pl->ncmds;
 
-	// Format string
-	if (sprintf(cmd, "/usr/bin/%s", input_cmd_oshean) < 0){
-		printf("What the hell is it?: %s\n", cmd);
-		exit(1);
+	// Lone builtins never allocate nor fork, nor do memoized commands served
+	// from the cache
+	if (n == 1 && !pl->background && pl->cmds[0].argc &&
+	    ((b = osh_builtin_find(pl->cmds[0].argv[0])) != NULL ||
+	     (osh_cache_rule_match(pl->cmds[0].argc, pl->cmds[0].argv) && (b = &cmd_cached)))){
+		struct osh_fdmap map[OSH_REDIR_FDS];
+		int nmap;
+
+		OSH_STATS_INC(builtin);
+		OSH_STATS_EXEC();
+		if (pl->cmds[0].nredirs == 0)
+			return b->fn(pl->cmds[0].argc, pl->cmds[0].argv);
+
+		if ((nmap = cmd_redirs(&pl->cmds[0], -1, -1, map)) < 0)
+			return 1;
+		status = cmd_run_builtin(b, &pl->cmds[0], -1, -1, map, nmap);
+		cmd_redirs_close(map, nmap);
+		return status;
 	}
-	
-	// If process has error
-	if (pid_exec < 0){
-		printf("Error can't fork()\n");
+
+	// Children write straight to the descriptors, don't let our own
+	// buffered output show up after theirs
+	fflush(stdout);
+
+	// Gone with the line, the job keeps its own copy of the pids
+	pids = osh_arena_alloc(pl->arena, n * sizeof(*pids));
+	fds = osh_arena_alloc(pl->arena, n * sizeof(*fds));
+
+	if (pids == NULL || fds == NULL){
+		printf("NULL Memory Allocation\n");
+		return 1;
 	}
-	
-	// Success
-	else if (pid_exec == 0){
-		if (execve(cmd, args, env_val) < 0){
-			printf("%s: %s\n", strerror(errno), cmd);
-			kill(getpid(), SIGKILL);
+
+	// All pipes exist before anything runs
+	for (i = 0; i < n; i++){
+		fds[i][0] = fds[i][1] = -1;
+		pids[i] = -1;
+
+		if (i < n - 1){
+			if (pipe2(fds[i], O_CLOEXEC) < 0){
+				printf("%s: pipe\n", strerror(errno));
+				n = i + 1;
+				break;
+			}
+
+			if (n > 2)
+				fcntl(fds[i][1], F_SETPIPE_SZ, OSH_PIPE_SIZE);
 		}
 	}
 
-	// Parent process
-	else {
-		free(cmd);
-		wait(NULL);
-	}	
+	// Start every external stage at once, data flows between them through
+	// the kernel and never passes through the shell
+	for (i = 0; i < n; i++){
+		struct osh_cmd *c = &pl->cmds[i];
+		struct osh_fdmap map[OSH_REDIR_FDS];
+		struct osh_launch l;
+		int nmap = 0;
+
+		// Redirections alone, the files are made and nothing runs
+		if (c->argc == 0){
+			if ((nmap = cmd_redirs(c, -1, -1, map)) >= 0)
+				cmd_redirs_close(map, nmap);
+			if (i == n - 1)
+				status = nmap < 0;
+			continue;
+		}
+
+		l.argv = c->argv;
+		l.argc = c->argc;
+		l.envp = osh_env_vec();
+		l.fd_in = i > 0 ? fds[i-1][0] : -1;
+		l.fd_out = fds[i][1];
+		l.pgid = pgid;
+		l.foreground = osh_job_control && !pl->background;
+		l.builtin = NULL;
+		l.flags = 0;
+
+		l.fdmap = map;
+		l.nfdmap = 0;
+
+		if ((b = osh_builtin_find(c->argv[0])) != NULL){
+			// A subshell of its own like any POSIX shell, cd or exit in a
+			// pipeline must not touch the shell itself
+			l.path = c->argv[0];
+			l.builtin = b->fn;
+			l.flags = OSH_LAUNCH_FORK;
+		} else if ((l.path = osh_path_lookup(c->argv[0])) == NULL){
+			// Resolve through the $PATH cache before launching
+			printf("%s: command not found\n", c->argv[0]);
+			if (i == n - 1)
+				status = 127;
+			continue;
+		}
+
+		if ((nmap = cmd_redirs(c, l.fd_in, l.fd_out, map)) < 0){
+			if (i == n - 1)
+				status = 1;
+			continue;
+		}
+		l.nfdmap = nmap;
+
+		if ((pids[i] = cmd_launch_oshean(&l)) > 0 && pgid == 0)
+			pgid = pids[i];
+		cmd_redirs_close(map, nmap);
+	}
+
+	// The children have their own copies of the pipe ends
+	for (i = 0; i < n; i++){
+		if (fds[i][0] >= 0)
+			close(fds[i][0]);
+		if (fds[i][1] >= 0)
+			close(fds[i][1]);
+	}
+
+	pids_last = pids[n - 1];
+	j = osh_job_new(pgid, pids, n);
+
+	if (j == NULL)
+		return status;
+
+	if (j->npids == 0){
+		osh_job_free(j);
+		return status;
+	}
+
+	if (pl->background){
+		j->text = osh_pipeline_text(pl);
+		printf("[%d] %d\n", j->id, j->pgid ? j->pgid : j->pids[j->npids - 1]);
 		return 0;
+	}
+
+	i = osh_job_wait_fg(j, pl);
+
+	// The last stage decides, unless it never started
+	if (pids_last > 0)
+		status = i;
+
+	return status;
 }
+
+pid_t cmd_start_oshean(struct osh_pipeline *pl, int fd_in, int fd_out, pid_t pgid){
+	struct osh_cmd *c = &pl->cmds[0];
+	struct osh_fdmap map[OSH_REDIR_FDS + 1];
+	const struct osh_builtin *b = NULL;
+	struct osh_launch l;
+	pid_t pid;
+	int nmap, i;
+
+	fflush(stdout);
+
+	// Pipelines and bare redirections need the whole shell, in a copy
+	if (pl->ncmds > 1 || c->argc == 0){
+		if ((pid = fork()) < 0){
+			printf("Error can't fork()\n");
+			return -1;
+		}
+
+		if (pid == 0){
+			sigset_t set;
+			int sig;
+
+			if (pgid >= 0)
+				setpgid(0, pgid);
+			cmd_child_sigset(&set);
+			for (sig = 1; sig < NSIG; sig++)
+				if (sigismember(&set, sig))
+					signal(sig, SIG_DFL);
+
+			// The copy leaves the terminal alone
+			osh_job_control = 0;
+			if (fd_in >= 0)
+				dup2(fd_in, STDIN_FILENO);
+			dup2(fd_out, STDOUT_FILENO);
+			dup2(fd_out, STDERR_FILENO);
+			_exit(cmd_exec_oshean(pl));
+		}
+
+		if (pgid >= 0)
+			setpgid(pid, pgid ? pgid : pid);
+		osh_launch_stats.fork++;
+		return pid;
+	}
+
+	l.argv = c->argv;
+	l.argc = c->argc;
+	l.envp = osh_env_vec();
+	l.fd_in = fd_in;
+	l.fd_out = fd_out;
+	l.pgid = pgid;
+	l.foreground = 0;
+	l.builtin = NULL;
+	l.flags = 0;
+
+	if ((b = osh_builtin_find(c->argv[0])) != NULL){
+		l.path = c->argv[0];
+		l.builtin = b->fn;
+		l.flags = OSH_LAUNCH_FORK;
+	} else if ((l.path = osh_path_lookup(c->argv[0])) == NULL){
+		// Said where the job's output goes, like any other error of it
+		dprintf(fd_out, "%s: command not found\n", c->argv[0]);
+		return -1;
+	}
+
+	if ((nmap = cmd_redirs(c, fd_in, fd_out, map)) < 0)
+		return -1;
+
+	// stderr joins stdout unless the command sends it elsewhere
+	for (i = 0; i < nmap && map[i].fd != STDERR_FILENO; i++)
+		;
+	if (i == nmap && (map[nmap].src = fcntl(fd_out, F_DUPFD_CLOEXEC, OSH_REDIR_FDS)) >= 0)
+		map[nmap++].fd = STDERR_FILENO;
+
+	l.fdmap = map;
+	l.nfdmap = nmap;
+	pid = cmd_launch_oshean(&l);
+	cmd_redirs_close(map, nmap);
+
+	return pid;
+}
+
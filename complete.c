@@ -0,0 +1,692 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "include/complete.h"
+#include "include/dirindex.h"
+#include "include/builtin.h"
+#include "include/path.h"
+#include "include/arena.h"
+#include "include/config.h"
+#include "include/stats.h"
+
+#define OSH_COMPLETE_WORDS 16
+
+static const char *git_cmds[] = {
+	"add", "am", "bisect", "blame", "branch", "checkout", "cherry-pick",
+	"clean", "clone", "commit", "config", "describe", "diff", "fetch",
+	"grep", "init", "log", "merge", "mv", "pull", "push", "rebase",
+	"reflog", "remote", "reset", "restore", "revert", "rm", "show",
+	"stash", "status", "switch", "tag", "worktree", NULL
+};
+
+// Subcommands whose arguments are usually branches
+static const char *git_branch_cmds[] = {
+	"branch", "checkout", "cherry-pick", "diff", "log", "merge", "pull",
+	"push", "rebase", "reset", "show", "switch", NULL
+};
+
+struct complete_cand {
+	char *s;
+	int dir;
+};
+
+struct complete_set {
+	struct osh_arena *a;
+	struct complete_cand *v;
+	size_t n;
+	size_t cap;
+	// Unquoted word being completed
+	const char *word;
+	size_t wlen;
+};
+
+// Words of the pipeline stage the cursor is in, the last one is the word
+// being completed, possibly empty
+struct complete_line {
+	char **words;
+	int nwords;
+	// Where the last word starts in the line
+	size_t start;
+	// The last word is the file of a redirection
+	int redir;
+};
+
+// One completion in progress, candidates live in its arena until the
+// next one starts
+struct complete_run {
+	struct osh_arena a;
+	int ready;
+	struct complete_set cs;
+	struct complete_line cl;
+	// Next source of candidates to collect
+	int source;
+};
+
+// Tab and hints each have their own so a hint being computed survives a
+// Tab that changed nothing
+static struct complete_run complete_tab;
+static struct complete_run complete_hint;
+// Next $PATH directory osh_complete_idle lists, -1 once all of them are
+static int complete_warm;
+
+static int complete_add(struct complete_set *cs, const char *s, size_t len, int dir){
+	if (cs->n == cs->cap){
+		size_t cap = cs->cap ? cs->cap * 2 : 64;
+		struct complete_cand *v;
+
+		v = osh_arena_grow(cs->a, cs->v, cs->cap * sizeof(*v), cap * sizeof(*v));
+		if (v == NULL)
+			return -1;
+		cs->v = v;
+		cs->cap = cap;
+	}
+
+	if ((cs->v[cs->n].s = osh_arena_strndup(cs->a, s, len)) == NULL)
+		return -1;
+	cs->v[cs->n].dir = dir;
+	cs->n++;
+
+	return 0;
+}
+
+static int complete_prefix(const char *name, const struct complete_set *cs){
+	return !strncmp(name, cs->word, cs->wlen);
+}
+
+// Split the line the way the lexer would, only far enough to know the
+// words of the last pipeline stage
+static int complete_split(struct osh_arena *a, const char *buf, struct complete_line *cl){
+	size_t len = strlen(buf), i, w = 0;
+	char *cur = osh_arena_alloc(a, len + 1);
+	int cap = OSH_COMPLETE_WORDS, inword = 0, redir = 0;
+	char quote = 0;
+
+	cl->words = osh_arena_alloc(a, cap * sizeof(char*));
+	cl->nwords = 0;
+	cl->start = len;
+	cl->redir = 0;
+
+	if (cur == NULL || cl->words == NULL)
+		return -1;
+
+	for (i = 0; i <= len; i++){
+		char c = buf[i];
+
+		if (c != '\0' && (quote || (c != ' ' && c != '\t' && c != '|' && c != '&' &&
+		    c != '<' && c != '>'))){
+			if (!inword){
+				inword = 1;
+				cl->start = i;
+			}
+
+			if (quote){
+				if (c == quote)
+					quote = 0;
+				else if (quote == '"' && c == '\\' && buf[i+1])
+					cur[w++] = buf[++i];
+				else
+					cur[w++] = c;
+			} else if (c == '\'' || c == '"'){
+				quote = c;
+			} else if (c == '\\' && buf[i+1]){
+				cur[w++] = buf[++i];
+			} else {
+				cur[w++] = c;
+			}
+			continue;
+		}
+
+		if (inword || c == '\0'){
+			if (cl->nwords == cap){
+				char **words = osh_arena_grow(a, cl->words, cap * sizeof(char*), cap * 2 * sizeof(char*));
+
+				if (words == NULL)
+					return -1;
+				cl->words = words;
+				cap *= 2;
+			}
+
+			// A blank at the end starts a new, empty word
+			if (!inword)
+				cl->start = i;
+			cur[w] = '\0';
+			cl->words[cl->nwords++] = osh_arena_strndup(a, cur, w);
+			cl->redir = redir;
+			w = 0;
+
+			// Redirection targets and the 2 of 2> are no arguments
+			if (c != '\0' && (redir || ((c == '<' || c == '>') && inword &&
+			    cl->words[cl->nwords-1][0] >= '0' && cl->words[cl->nwords-1][0] <= '9' &&
+			    cl->words[cl->nwords-1][1] == '\0')))
+				cl->nwords--;
+			if (inword)
+				redir = 0;
+			inword = 0;
+		}
+
+		if (c == '<' || c == '>' || (c == '&' && i > 0 && (buf[i-1] == '<' || buf[i-1] == '>')))
+			redir = 1;
+		// A new stage starts with its command name
+		else if (c == '|' || c == '&')
+			cl->nwords = 0;
+	}
+
+	return 0;
+}
+
+static int complete_isdir(const char *dir, const char *name, unsigned char type){
+	char path[4096];
+	struct stat st;
+
+	if (type == DT_DIR)
+		return 1;
+	if (type != DT_LNK && type != DT_UNKNOWN)
+		return 0;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	return stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static int complete_isexec(const char *dir, const char *name){
+	char path[4096];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+#define COMPLETE_FILES 0
+#define COMPLETE_DIRS 1
+#define COMPLETE_EXEC 2
+
+// Names in the word's directory, served from the directory index
+static void complete_files(struct complete_set *cs, int mode){
+	const char *slash = strrchr(cs->word, '/');
+	size_t dlen = slash ? (size_t)(slash - cs->word) + 1 : 0;
+	const char *base = cs->word + dlen;
+	const struct osh_dirent *ents;
+	char dir[4096], cand[4096];
+	size_t n, i;
+
+	if (dlen >= sizeof(dir))
+		return;
+
+	if (dlen == 0){
+		strcpy(dir, ".");
+	} else {
+		memcpy(dir, cs->word, dlen);
+		dir[dlen] = '\0';
+	}
+
+	if ((ents = osh_dir_list(dir, &n)) == NULL)
+		return;
+
+	for (i = osh_dir_lower(ents, n, base); i < n; i++){
+		const char *name = ents[i].name;
+		int isdir;
+
+		if (strncmp(name, base, strlen(base)))
+			break;
+
+		// Hidden files only when asked for
+		if (name[0] == '.' && base[0] != '.')
+			continue;
+
+		isdir = complete_isdir(dir, name, ents[i].type);
+
+		if ((mode == COMPLETE_DIRS && !isdir) ||
+		    (mode == COMPLETE_EXEC && !isdir && !complete_isexec(dir, name)))
+			continue;
+
+		if (snprintf(cand, sizeof(cand), "%.*s%s", (int)dlen, cs->word, name) < (int)sizeof(cand))
+			complete_add(cs, cand, strlen(cand), isdir);
+	}
+}
+
+static void complete_builtins(struct complete_set *cs){
+	const struct osh_builtin *b;
+	size_t nb, i;
+
+	for (b = osh_builtin_list(&nb), i = 0; i < nb; i++)
+		if (complete_prefix(b[i].name, cs))
+			complete_add(cs, b[i].name, strlen(b[i].name), 0);
+}
+
+// Executables in $PATH directory 'd', 0 past the last directory
+static int complete_path_dir(struct complete_set *cs, int d){
+	const struct osh_dirent *ents;
+	const char *dir;
+	size_t n, i;
+
+	// $PATH is brought up to date once per completion
+	if (d == 0)
+		osh_path_dir_count();
+	if ((dir = osh_path_dir(d)) == NULL)
+		return 0;
+
+	if ((ents = osh_dir_list(dir, &n)) == NULL)
+		return 1;
+
+	for (i = osh_dir_lower(ents, n, cs->word); i < n && complete_prefix(ents[i].name, cs); i++)
+		if (ents[i].type != DT_DIR && complete_isexec(dir, ents[i].name))
+			complete_add(cs, ents[i].name, strlen(ents[i].name), 0);
+
+	return 1;
+}
+
+// The repository's git directory, looked up from the working directory
+int osh_complete_gitdir(char *out, size_t len){
+	char dir[4096], path[4200];
+	struct stat st;
+
+	if (getcwd(dir, sizeof(dir)) == NULL)
+		return -1;
+
+	for (;;){
+		char *slash;
+
+		snprintf(path, sizeof(path), "%s/.git", dir);
+
+		if (stat(path, &st) == 0){
+			FILE *fp;
+			char line[4096];
+
+			if (S_ISDIR(st.st_mode)){
+				snprintf(out, len, "%s", path);
+				return 0;
+			}
+
+			// Worktrees and submodules point elsewhere
+			if ((fp = fopen(path, "r")) == NULL)
+				return -1;
+			if (fgets(line, sizeof(line), fp) && !strncmp(line, "gitdir: ", 8)){
+				line[strcspn(line, "\n")] = '\0';
+				if (line[8] == '/')
+					snprintf(out, len, "%s", line + 8);
+				else
+					snprintf(out, len, "%s/%s", dir, line + 8);
+				fclose(fp);
+				return 0;
+			}
+			fclose(fp);
+			return -1;
+		}
+
+		if ((slash = strrchr(dir, '/')) == NULL || slash == dir)
+			return -1;
+		*slash = '\0';
+	}
+}
+
+// Loose refs under 'dir', named relative to 'prefix'
+static void complete_refs_dir(struct complete_set *cs, const char *dir, const char *prefix){
+	struct dirent *de;
+	DIR *dp;
+
+	if ((dp = opendir(dir)) == NULL)
+		return;
+
+	while ((de = readdir(dp)) != NULL){
+		char path[4096], name[1024];
+
+		if (de->d_name[0] == '.')
+			continue;
+
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		snprintf(name, sizeof(name), "%s%s", prefix, de->d_name);
+
+		if (complete_isdir(dir, de->d_name, de->d_type)){
+			strncat(name, "/", sizeof(name) - strlen(name) - 1);
+			complete_refs_dir(cs, path, name);
+		} else if (complete_prefix(name, cs)){
+			complete_add(cs, name, strlen(name), 0);
+		}
+	}
+
+	closedir(dp);
+}
+
+static void complete_git_branches(struct complete_set *cs){
+	char gitdir[4096], path[4200], line[4096];
+	FILE *fp;
+
+	if (osh_complete_gitdir(gitdir, sizeof(gitdir)) < 0)
+		return;
+
+	// Linked worktrees keep their refs in the main repository
+	snprintf(path, sizeof(path), "%s/commondir", gitdir);
+	if ((fp = fopen(path, "r")) != NULL){
+		if (fgets(line, sizeof(line), fp)){
+			line[strcspn(line, "\n")] = '\0';
+			if (line[0] == '/')
+				snprintf(gitdir, sizeof(gitdir), "%s", line);
+			else
+				strncat(gitdir, "/", sizeof(gitdir) - strlen(gitdir) - 1),
+				strncat(gitdir, line, sizeof(gitdir) - strlen(gitdir) - 1);
+		}
+		fclose(fp);
+	}
+
+	snprintf(path, sizeof(path), "%s/refs/heads", gitdir);
+	complete_refs_dir(cs, path, "");
+	snprintf(path, sizeof(path), "%s/refs/remotes", gitdir);
+	complete_refs_dir(cs, path, "");
+
+	snprintf(path, sizeof(path), "%s/packed-refs", gitdir);
+	if ((fp = fopen(path, "r")) == NULL)
+		return;
+
+	while (fgets(line, sizeof(line), fp)){
+		char *ref = strchr(line, ' ');
+
+		if (line[0] == '#' || line[0] == '^' || ref == NULL)
+			continue;
+		ref[strcspn(ref, "\n")] = '\0';
+		ref++;
+
+		if (!strncmp(ref, "refs/heads/", 11))
+			ref += 11;
+		else if (!strncmp(ref, "refs/remotes/", 13))
+			ref += 13;
+		else
+			continue;
+
+		if (complete_prefix(ref, cs))
+			complete_add(cs, ref, strlen(ref), 0);
+	}
+
+	fclose(fp);
+}
+
+static int complete_in(const char *s, const char **list){
+	for (; *list; list++)
+		if (!strcmp(s, *list))
+			return 1;
+	return 0;
+}
+
+static int complete_cmp(const void *a, const void *b){
+	return strcmp(((const struct complete_cand*)a)->s, ((const struct complete_cand*)b)->s);
+}
+
+// Words from "complete <cmd> = ..." in the config, for its first argument
+static const char *complete_rule(const char *cmd){
+	char key[256];
+
+	if (snprintf(key, sizeof(key), "complete %s", cmd) >= (int)sizeof(key))
+		return NULL;
+
+	return osh_config_get(key);
+}
+
+static void complete_words(struct complete_set *cs, const char *words){
+	const char *p = words;
+
+	for (;;){
+		size_t len;
+
+		p += strspn(p, " \t");
+		if ((len = strcspn(p, " \t")) == 0)
+			break;
+
+		if (len >= cs->wlen && !strncmp(p, cs->word, cs->wlen))
+			complete_add(cs, p, len, 0);
+		p += len;
+	}
+}
+
+// Split 'buf' and get ready to collect candidates for its last word
+static int complete_begin(struct complete_run *r, const char *buf){
+	struct complete_set *cs = &r->cs;
+
+	if (!r->ready){
+		osh_arena_init(&r->a);
+		r->ready = 1;
+	}
+	osh_arena_reset(&r->a);
+
+	memset(cs, 0, sizeof(*cs));
+	cs->a = &r->a;
+	r->source = 0;
+
+	if (complete_split(&r->a, buf, &r->cl) < 0 || r->cl.nwords == 0)
+		return -1;
+
+	cs->word = r->cl.words[r->cl.nwords - 1];
+	cs->wlen = strlen(cs->word);
+
+	return 0;
+}
+
+// Collect the next source of candidates, returns 0 once all are in. A
+// source is at most one directory, so a step stays short.
+static int complete_source(struct complete_run *r){
+	struct complete_set *cs = &r->cs;
+	struct complete_line *cl = &r->cl;
+	const char *cmd = cl->words[0];
+	int git = !strcmp(cmd, "git"), s = r->source++;
+	const char *rule;
+	size_t i;
+
+	if (cl->redir){
+		if (s == 0)
+			complete_files(cs, COMPLETE_FILES);
+		return s == 0;
+	}
+
+	if (cl->nwords == 1){
+		if (strchr(cs->word, '/')){
+			if (s == 0)
+				complete_files(cs, COMPLETE_EXEC);
+			return s == 0;
+		}
+
+		// Every name would match an empty word
+		if (cs->wlen == 0)
+			return 0;
+		if (s == 0){
+			complete_builtins(cs);
+			return 1;
+		}
+		return complete_path_dir(cs, s - 1);
+	}
+
+	if (!strcmp(cmd, "cd")){
+		if (s == 0)
+			complete_files(cs, COMPLETE_DIRS);
+		return s == 0;
+	}
+
+	if (git && cl->nwords == 2){
+		if (s == 0)
+			for (i = 0; git_cmds[i]; i++)
+				if (complete_prefix(git_cmds[i], cs))
+					complete_add(cs, git_cmds[i], strlen(git_cmds[i]), 0);
+		return s == 0;
+	}
+
+	if (cl->nwords == 2 && (rule = complete_rule(cmd)) != NULL){
+		if (s == 0)
+			complete_words(cs, rule);
+		return s == 0;
+	}
+
+	if (s == 0){
+		if (git && complete_in(cl->words[1], git_branch_cmds) && cs->word[0] != '-')
+			complete_git_branches(cs);
+		return 1;
+	}
+
+	if (s == 1){
+		complete_files(cs, COMPLETE_FILES);
+		return 1;
+	}
+
+	return 0;
+}
+
+// Sort the candidates and drop repeats
+static void complete_finish(struct complete_set *cs){
+	size_t i, j;
+
+	qsort(cs->v, cs->n, sizeof(*cs->v), complete_cmp);
+
+	for (i = j = 0; i < cs->n; i++)
+		if (j == 0 || strcmp(cs->v[i].s, cs->v[j-1].s))
+			cs->v[j++] = cs->v[i];
+	cs->n = j;
+}
+
+// Length of the prefix every candidate shares
+static size_t complete_common(const struct complete_set *cs){
+	size_t len, i;
+
+	if (cs->n == 0)
+		return 0;
+
+	len = strlen(cs->v[0].s);
+	for (i = 1; i < cs->n; i++){
+		size_t k = 0;
+
+		while (k < len && cs->v[i].s[k] == cs->v[0].s[k])
+			k++;
+		len = k;
+	}
+
+	return len;
+}
+
+// Line with the last word replaced by 'len' bytes of 's', escaped for the
+// lexer
+static void complete_emit(linenoiseCompletions *lc, const char *buf, size_t start,
+		const char *s, size_t len, const char *tail){
+	char *line = malloc(start + len * 2 + strlen(tail) + 1), *p;
+	size_t i;
+
+	if (line == NULL)
+		return;
+
+	memcpy(line, buf, start);
+	p = line + start;
+
+	for (i = 0; i < len; i++){
+		if (strchr(" \t\\'\"|&#$;<>()*?`", s[i]))
+			*p++ = '\\';
+		*p++ = s[i];
+	}
+	strcpy(p, tail);
+
+	linenoiseAddCompletion(lc, line);
+	free(line);
+}
+
+static void complete_tab_run(const char *buf, linenoiseCompletions *lc){
+	struct complete_run *r = &complete_tab;
+	struct complete_set *cs = &r->cs;
+	size_t common, i, start;
+
+	if (complete_begin(r, buf) < 0)
+		return;
+
+	while (complete_source(r))
+		;
+	complete_finish(cs);
+
+	if (cs->n == 0)
+		return;
+
+	start = r->cl.start;
+
+	// A lone match is finished off, directories stay open for more
+	if (cs->n == 1){
+		complete_emit(lc, buf, start, cs->v[0].s, strlen(cs->v[0].s), cs->v[0].dir ? "/" : " ");
+		return;
+	}
+
+	// First Tab goes as far as every match agrees, then they cycle
+	if ((common = complete_common(cs)) > cs->wlen)
+		complete_emit(lc, buf, start, cs->v[0].s, common, "");
+
+	for (i = 0; i < cs->n; i++)
+		complete_emit(lc, buf, start, cs->v[i].s, strlen(cs->v[i].s), cs->v[i].dir ? "/" : "");
+}
+
+static int complete_hint_step(const char *buf, int restart, char **hint, int *color, int *bold){
+	struct complete_run *r = &complete_hint;
+	struct complete_set *cs = &r->cs;
+	size_t common;
+
+	*color = 2;
+	*bold = 0;
+	*hint = NULL;
+
+	if (restart){
+		// Nothing to go on yet
+		if (*buf == '\0' || buf[strlen(buf) - 1] == ' ' || complete_begin(r, buf) < 0){
+			r->source = -1;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (r->source < 0)
+		return 1;
+
+	// One source per call, linenoise reads keys in between
+	if (complete_source(r))
+		return 0;
+
+	complete_finish(cs);
+	r->source = -1;
+
+	if ((common = complete_common(cs)) <= cs->wlen)
+		return 1;
+
+	if ((*hint = malloc(common - cs->wlen + 2)) == NULL)
+		return 1;
+
+	memcpy(*hint, cs->v[0].s + cs->wlen, common - cs->wlen);
+	strcpy(*hint + common - cs->wlen, cs->n == 1 && cs->v[0].dir ? "/" : "");
+
+	return 1;
+}
+
+void osh_complete(const char *buf, linenoiseCompletions *lc){
+	OSH_STATS_START(start);
+
+	complete_tab_run(buf, lc);
+	OSH_STATS_TIME(complete, start);
+}
+
+int osh_complete_hint(const char *buf, int restart, char **hint, int *color, int *bold){
+	OSH_STATS_START(start);
+	int done = complete_hint_step(buf, restart, hint, color, bold);
+
+	OSH_STATS_TIME(hint, start);
+	return done;
+}
+
+int osh_complete_idle(int work){
+	const char *dir;
+	size_t n;
+
+	if (complete_warm < 0)
+		return 0;
+	if (!work)
+		return 1;
+
+	if (complete_warm == 0)
+		osh_path_dir_count();
+	if ((dir = osh_path_dir(complete_warm)) == NULL){
+		complete_warm = -1;
+		return 1;
+	}
+
+	osh_dir_list(dir, &n);
+	complete_warm++;
+
+	return 1;
+}
@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "include/config.h"
+#include "include/env.h"
+#include "include/sys.h"
+
+// Parsed config cached next to the text file, remade when the text's
+// inode, size or mtime differ from what the snapshot was built from
+#define OSH_CONFIG_SNAP_SUFFIX ".snap"
+#define OSH_CONFIG_SNAP_MAGIC "OSHC"
+#define OSH_CONFIG_SNAP_VERSION 1
+
+// Snapshot layout: header, nents entries sorted by key, then the
+// NUL terminated strings they point at
+struct config_snap_hdr {
+	char magic[4];
+	uint32_t version;
+	uint64_t src_ino;
+	uint64_t src_size;
+	int64_t src_mtime_sec;
+	int64_t src_mtime_nsec;
+	uint32_t nents;
+	uint32_t size;
+};
+
+struct config_snap_ent {
+	// Offsets from the start of the snapshot
+	uint32_t key;
+	uint32_t val;
+};
+
+// Key and value while the text is parsed
+struct osh_config_ent {
+	char *key;
+	char *val;
+	// Line order, the last of several equal keys wins
+	size_t line;
+};
+
+// The snapshot in use, mmapped or built in memory from the text
+static const char *config_snap;
+static size_t config_snap_len;
+static int config_snap_mapped;
+static const struct config_snap_ent *config_ents;
+static size_t config_len;
+
+// $XDG_CONFIG_HOME, then $HOME and the password database
+static char *config_path(void){
+	const char *base = osh_env_get("XDG_CONFIG_HOME");
+	const char *sub = "/oshean/config";
+	char *path;
+
+	if (base == NULL || *base == '\0'){
+		if ((base = oshean_get_home()) == NULL)
+			return NULL;
+		sub = "/.config/oshean/config";
+	}
+
+	if ((path = malloc(strlen(base) + strlen(sub) + 1)) == NULL)
+		return NULL;
+
+	strcpy(path, base);
+	strcat(path, sub);
+
+	return path;
+}
+
+static char *config_strip(char *s){
+	char *e;
+
+	while (isspace((unsigned char)*s))
+		s++;
+
+	for (e = s + strlen(s); e > s && isspace((unsigned char)e[-1]); e--)
+		;
+	*e = '\0';
+
+	return s;
+}
+
+// "alias   gs" and "alias gs" are the same key
+static void config_squeeze(char *s){
+	char *d = s;
+
+	for (; *s; s++){
+		if (isspace((unsigned char)*s)){
+			if (isspace((unsigned char)s[1]))
+				continue;
+			*s = ' ';
+		}
+		*d++ = *s;
+	}
+	*d = '\0';
+}
+
+static void config_use(const char *snap, size_t len, int mapped){
+	const struct config_snap_hdr *h = (const struct config_snap_hdr*)snap;
+
+	config_snap = snap;
+	config_snap_len = len;
+	config_snap_mapped = mapped;
+	config_ents = (const struct config_snap_ent*)(snap + sizeof(*h));
+	config_len = h->nents;
+}
+
+// Map the snapshot if it was made from exactly this text
+static int config_snap_open(const char *snap_path, const struct stat *src){
+	const struct config_snap_hdr *h;
+	struct stat st;
+	char *map;
+	size_t i;
+	int fd;
+
+	if ((fd = open(snap_path, O_RDONLY | O_CLOEXEC)) < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*h)){
+		close(fd);
+		return -1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return -1;
+
+	h = (const struct config_snap_hdr*)map;
+
+	if (memcmp(h->magic, OSH_CONFIG_SNAP_MAGIC, 4) || h->version != OSH_CONFIG_SNAP_VERSION ||
+	    h->size != (uint64_t)st.st_size || h->src_ino != (uint64_t)src->st_ino ||
+	    h->src_size != (uint64_t)src->st_size ||
+	    h->src_mtime_sec != src->st_mtim.tv_sec || h->src_mtime_nsec != src->st_mtim.tv_nsec ||
+	    h->nents > (h->size - sizeof(*h)) / sizeof(struct config_snap_ent) ||
+	    (h->nents && map[h->size - 1] != '\0'))
+		goto stale;
+
+	// Every string has to end inside the map, the last byte is a NUL
+	for (i = 0; i < h->nents; i++){
+		const struct config_snap_ent *e = (const struct config_snap_ent*)(map + sizeof(*h)) + i;
+
+		if (e->key >= h->size || e->val >= h->size)
+			goto stale;
+	}
+
+	config_use(map, st.st_size, 1);
+	return 0;
+
+stale:
+	munmap(map, st.st_size);
+	return -1;
+}
+
+static int config_ent_cmp(const void *a, const void *b){
+	const struct osh_config_ent *x = a, *y = b;
+	int cmp = strcmp(x->key, y->key);
+
+	if (cmp)
+		return cmp;
+
+	return x->line < y->line ? -1 : x->line > y->line;
+}
+
+// Lay the parsed entries out as a snapshot, sorted and with repeats
+// dropped, '*n' is left at the entries kept
+static char *config_snap_build(struct osh_config_ent *ents, size_t *n,
+		const struct stat *src, size_t *len){
+	struct config_snap_hdr *h;
+	struct config_snap_ent *se;
+	size_t i, m = 0, size, off;
+	char *snap;
+
+	qsort(ents, *n, sizeof(*ents), config_ent_cmp);
+
+	// Keep the last line of each key
+	for (i = 0; i < *n; i++){
+		if (i + 1 < *n && !strcmp(ents[i].key, ents[i + 1].key)){
+			free(ents[i].key);
+			free(ents[i].val);
+			continue;
+		}
+		ents[m++] = ents[i];
+	}
+	*n = m;
+
+	size = sizeof(*h) + m * sizeof(*se);
+	for (i = 0; i < m; i++)
+		size += strlen(ents[i].key) + 1 + strlen(ents[i].val) + 1;
+
+	if (size > UINT32_MAX || (snap = calloc(1, size)) == NULL)
+		return NULL;
+
+	h = (struct config_snap_hdr*)snap;
+	memcpy(h->magic, OSH_CONFIG_SNAP_MAGIC, 4);
+	h->version = OSH_CONFIG_SNAP_VERSION;
+	h->src_ino = src->st_ino;
+	h->src_size = src->st_size;
+	h->src_mtime_sec = src->st_mtim.tv_sec;
+	h->src_mtime_nsec = src->st_mtim.tv_nsec;
+	h->nents = m;
+	h->size = size;
+
+	se = (struct config_snap_ent*)(snap + sizeof(*h));
+	off = sizeof(*h) + m * sizeof(*se);
+
+	for (i = 0; i < m; i++){
+		size_t kl = strlen(ents[i].key) + 1, vl = strlen(ents[i].val) + 1;
+
+		se[i].key = off;
+		memcpy(snap + off, ents[i].key, kl);
+		off += kl;
+		se[i].val = off;
+		memcpy(snap + off, ents[i].val, vl);
+		off += vl;
+	}
+
+	*len = size;
+
+	return snap;
+}
+
+// Write the snapshot through a temporary file, so a shell starting at the
+// same time never maps half of one
+static void config_snap_write(const char *snap_path, const char *snap, size_t len){
+	char *tmp = malloc(strlen(snap_path) + 32);
+	ssize_t w = 0;
+	size_t off = 0;
+	int fd;
+
+	if (tmp == NULL)
+		return;
+
+	sprintf(tmp, "%s.%ld", snap_path, (long)getpid());
+
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0){
+		free(tmp);
+		return;
+	}
+
+	while (off < len && (w = write(fd, snap + off, len - off)) > 0)
+		off += w;
+
+	if (close(fd) < 0 || off < len || rename(tmp, snap_path) < 0)
+		unlink(tmp);
+
+	free(tmp);
+}
+
+// Parse the text into a fresh snapshot and save it for the next shell
+static int config_parse(const char *path, const char *snap_path, const struct stat *src){
+	struct osh_config_ent *ents = NULL;
+	size_t n = 0, cap = 0, len, i;
+	char *line = NULL, *snap;
+	size_t lcap = 0;
+	int lineno = 0;
+	FILE *fp;
+
+	if ((fp = fopen(path, "r")) == NULL)
+		return 0;
+
+	while (getline(&line, &lcap, fp) > 0){
+		char *key, *val, *eq;
+
+		lineno++;
+		key = config_strip(line);
+
+		if (*key == '\0' || *key == '#')
+			continue;
+
+		if ((eq = strchr(key, '=')) == NULL){
+			fprintf(stderr, "oshean: %s:%d: expected key = value\n", path, lineno);
+			continue;
+		}
+
+		*eq = '\0';
+		key = config_strip(key);
+		val = config_strip(eq + 1);
+		config_squeeze(key);
+
+		if (n == cap){
+			struct osh_config_ent *e = realloc(ents, (cap ? cap * 2 : 16) * sizeof(*e));
+
+			if (e == NULL)
+				break;
+			ents = e;
+			cap = cap ? cap * 2 : 16;
+		}
+
+		ents[n].key = strdup(key);
+		ents[n].val = strdup(val);
+		ents[n].line = lineno;
+
+		if (ents[n].key == NULL || ents[n].val == NULL){
+			free(ents[n].key);
+			free(ents[n].val);
+			break;
+		}
+		n++;
+	}
+
+	free(line);
+	fclose(fp);
+
+	if ((snap = config_snap_build(ents, &n, src, &len)) != NULL){
+		config_snap_write(snap_path, snap, len);
+		config_use(snap, len, 0);
+	}
+
+	for (i = 0; i < n; i++){
+		free(ents[i].key);
+		free(ents[i].val);
+	}
+	free(ents);
+
+	return snap ? 0 : -1;
+}
+
+int osh_config_load(void){
+	char *path, *snap_path;
+	struct stat st;
+	int ret = 0;
+
+	if ((path = config_path()) == NULL)
+		return -1;
+
+	// A missing file is an empty config
+	if (stat(path, &st) < 0){
+		free(path);
+		return 0;
+	}
+
+	snap_path = malloc(strlen(path) + sizeof(OSH_CONFIG_SNAP_SUFFIX));
+
+	if (snap_path == NULL){
+		free(path);
+		return -1;
+	}
+
+	strcpy(snap_path, path);
+	strcat(snap_path, OSH_CONFIG_SNAP_SUFFIX);
+
+	if (config_snap_open(snap_path, &st) < 0)
+		ret = config_parse(path, snap_path, &st);
+
+	free(snap_path);
+	free(path);
+
+	return ret;
+}
+
+// First entry whose key is not below 'key'
+static size_t config_lower(const char *key){
+	size_t lo = 0, hi = config_len;
+
+	while (lo < hi){
+		size_t mid = (lo + hi) / 2;
+
+		if (strcmp(config_snap + config_ents[mid].key, key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+const char *osh_config_get(const char *key){
+	size_t i = config_lower(key);
+
+	if (i < config_len && !strcmp(config_snap + config_ents[i].key, key))
+		return config_snap + config_ents[i].val;
+
+	return NULL;
+}
+
+long osh_config_long(const char *key, long def){
+	const char *val = osh_config_get(key);
+	char *end;
+	long n;
+
+	if (val == NULL || *val == '\0')
+		return def;
+
+	n = strtol(val, &end, 10);
+
+	return *end == '\0' ? n : def;
+}
+
+void osh_config_each(const char *prefix, osh_config_fn *fn, void *arg){
+	size_t plen = strlen(prefix), i;
+
+	// Sorted, so every match sits together
+	for (i = config_lower(prefix); i < config_len; i++){
+		const char *key = config_snap + config_ents[i].key;
+
+		if (strncmp(key, prefix, plen))
+			break;
+		fn(key + plen, config_snap + config_ents[i].val, arg);
+	}
+}
+
+static void config_env_default(const char *name, const char *val, void *arg){
+	(void)arg;
+
+	if (*name && osh_env_get(name) == NULL)
+		osh_env_set(name, val);
+}
+
+void osh_config_env(void){
+	osh_config_each("env ", config_env_default, NULL);
+}
+
+void osh_config_free(void){
+	if (config_snap_mapped)
+		munmap((void*)config_snap, config_snap_len);
+	else
+		free((void*)config_snap);
+
+	config_snap = NULL;
+	config_snap_len = 0;
+	config_ents = NULL;
+	config_len = 0;
+}
@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "include/dirindex.h"
+#include "include/arena.h"
+
+// Listings kept at once, the least recently used one goes first
+#define OSH_DIR_CACHE 64
+
+struct osh_dir {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	struct timespec mtime;
+	// A listing read in the same second the directory changed may have
+	// missed a later change with the same mtime, never trust it
+	int racy;
+	struct osh_dirent *ents;
+	size_t n;
+	// Entry names
+	struct osh_arena names;
+	struct osh_dir *next;
+};
+
+// Most recently used first
+static struct osh_dir *dir_cache;
+static int dir_cached;
+
+static int dir_cmp(const void *a, const void *b){
+	return strcmp(((const struct osh_dirent*)a)->name, ((const struct osh_dirent*)b)->name);
+}
+
+static int dir_read(struct osh_dir *d, const struct stat *st){
+	size_t cap = 0;
+	struct dirent *de;
+	struct timespec now;
+	DIR *dp;
+
+	if ((dp = opendir(d->path)) == NULL)
+		return -1;
+
+	free(d->ents);
+	d->ents = NULL;
+	d->n = 0;
+	osh_arena_reset(&d->names);
+
+	while ((de = readdir(dp)) != NULL){
+		struct osh_dirent *e;
+
+		if (de->d_name[0] == '.' && (de->d_name[1] == '\0' ||
+		    (de->d_name[1] == '.' && de->d_name[2] == '\0')))
+			continue;
+
+		if (d->n == cap){
+			cap = cap ? cap * 2 : 64;
+
+			if ((e = realloc(d->ents, cap * sizeof(*e))) == NULL)
+				break;
+			d->ents = e;
+		}
+
+		e = &d->ents[d->n];
+		if ((e->name = osh_arena_strndup(&d->names, de->d_name, strlen(de->d_name))) == NULL)
+			break;
+		e->type = de->d_type;
+		d->n++;
+	}
+
+	closedir(dp);
+	qsort(d->ents, d->n, sizeof(*d->ents), dir_cmp);
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	d->dev = st->st_dev;
+	d->ino = st->st_ino;
+	d->mtime = st->st_mtim;
+	d->racy = now.tv_sec <= st->st_mtim.tv_sec + 1;
+
+	return 0;
+}
+
+static void dir_free(struct osh_dir *d){
+	free(d->path);
+	free(d->ents);
+	osh_arena_free(&d->names);
+	free(d);
+}
+
+const struct osh_dirent *osh_dir_list(const char *path, size_t *n){
+	struct osh_dir **pd, *d;
+	struct stat st;
+
+	if (stat(path, &st) < 0 || !S_ISDIR(st.st_mode))
+		return NULL;
+
+	for (pd = &dir_cache; *pd; pd = &(*pd)->next)
+		if (!strcmp((*pd)->path, path))
+			break;
+
+	if ((d = *pd) != NULL){
+		// Move to the front
+		*pd = d->next;
+	} else {
+		// Reuse the least recently used listing once the cache is full
+		if (dir_cached >= OSH_DIR_CACHE){
+			for (pd = &dir_cache; (*pd)->next; pd = &(*pd)->next)
+				;
+			dir_free(*pd);
+			*pd = NULL;
+			dir_cached--;
+		}
+
+		if ((d = calloc(1, sizeof(*d))) == NULL || (d->path = strdup(path)) == NULL){
+			free(d);
+			return NULL;
+		}
+
+		osh_arena_init(&d->names);
+		d->racy = 1;
+		dir_cached++;
+	}
+
+	d->next = dir_cache;
+	dir_cache = d;
+
+	if (d->racy || d->dev != st.st_dev || d->ino != st.st_ino ||
+	    d->mtime.tv_sec != st.st_mtim.tv_sec || d->mtime.tv_nsec != st.st_mtim.tv_nsec){
+		if (dir_read(d, &st) < 0)
+			return NULL;
+	}
+
+	*n = d->n;
+	return d->ents;
+}
+
+size_t osh_dir_lower(const struct osh_dirent *ents, size_t n, const char *prefix){
+	size_t lo = 0, hi = n;
+
+	while (lo < hi){
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (strcmp(ents[mid].name, prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
@@ -1,14 +1,178 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "include/env.h"
 
-void set_env_var(char **env_val, char **envp){
-	int i = 0;
+// One variable, stored as the "NAME=value" string execve wants
+struct osh_env_var {
+	char *str;
+	size_t nlen;
+};
 
-	for (char **env = envp; *env != 0; env++){
-		env_val[i] = *env;
-		i++;
+static struct osh_env_var *env_vars;
+static size_t env_len;
+static size_t env_cap;
+
+// execve-ready snapshot, rebuilt only when a variable changed
+static char **env_vec;
+static size_t env_vec_cap;
+static int env_dirty = 1;
+
+unsigned long osh_env_gen;
+
+static struct osh_env_var *env_find(const char *name, size_t nlen){
+	size_t i;
+
+	for (i = 0; i < env_len; i++)
+		if (env_vars[i].nlen == nlen && !memcmp(env_vars[i].str, name, nlen))
+			return &env_vars[i];
+
+	return NULL;
+}
+
+// Take ownership of a malloc'd "NAME=value" string
+static int env_put(char *str, size_t nlen){
+	struct osh_env_var *v = env_find(str, nlen);
+
+	if (v){
+		free(v->str);
+		v->str = str;
+	} else {
+		if (env_len == env_cap){
+			size_t cap = env_cap ? env_cap * 2 : 64;
+			struct osh_env_var *vars = realloc(env_vars, cap * sizeof(*vars));
+
+			if (vars == NULL){
+				free(str);
+				return -1;
+			}
+
+			env_vars = vars;
+			env_cap = cap;
+		}
+
+		env_vars[env_len].str = str;
+		env_vars[env_len].nlen = nlen;
+		env_len++;
+	}
+
+	env_dirty = 1;
+	osh_env_gen++;
+
+	return 0;
+}
+
+void osh_env_init(char **envp){
+	char **env;
+
+	for (env = envp; *env != 0; env++){
+		char *eq = strchr(*env, '=');
+		char *str;
+
+		if (eq == NULL || eq == *env || (str = strdup(*env)) == NULL)
+			continue;
+
+		env_put(str, eq - *env);
 	}
+}
+
+char *osh_env_get(const char *name){
+	struct osh_env_var *v = env_find(name, strlen(name));
+
+	return v ? v->str + v->nlen + 1 : NULL;
+}
+
+int osh_env_set(const char *name, const char *value){
+	size_t nlen = strlen(name);
+	size_t vlen = strlen(value);
+	char *str;
+
+	if (nlen == 0 || strchr(name, '=') || (str = malloc(nlen + 1 + vlen + 1)) == NULL)
+		return -1;
+
+	memcpy(str, name, nlen);
+	str[nlen] = '=';
+	memcpy(str + nlen + 1, value, vlen + 1);
+
+	return env_put(str, nlen);
+}
+
+int osh_env_unset(const char *name){
+	struct osh_env_var *v = env_find(name, strlen(name));
+
+	if (v == NULL)
+		return 0;
+
+	free(v->str);
+	*v = env_vars[--env_len];
+	env_dirty = 1;
+	osh_env_gen++;
+
+	return 0;
+}
+
+char **osh_env_vec(void){
+	size_t i;
+
+	if (!env_dirty)
+		return env_vec;
+
+	if (env_len + 1 > env_vec_cap){
+		char **vec = realloc(env_vec, (env_len + 1) * 2 * sizeof(*vec));
+
+		if (vec == NULL)
+			return env_vec;
+
+		env_vec = vec;
+		env_vec_cap = (env_len + 1) * 2;
+	}
+
+	for (i = 0; i < env_len; i++)
+		env_vec[i] = env_vars[i].str;
+	env_vec[env_len] = NULL;
+	env_dirty = 0;
+
+	return env_vec;
+}
+
+int osh_env_export_builtin(int argc, char **args){
+	int ret = 0;
+	size_t i;
+
+	(void)argc;
+
+	if (args[1] == NULL){
+		for (i = 0; i < env_len; i++)
+			printf("export %.*s=\"%s\"\n", (int)env_vars[i].nlen,
+				env_vars[i].str, env_vars[i].str + env_vars[i].nlen + 1);
+		return 0;
+	}
+
+	for (i = 1; args[i]; i++){
+		char *eq = strchr(args[i], '=');
+
+		// Every variable is already exported
+		if (eq == NULL)
+			continue;
+
+		*eq = '\0';
+		if (osh_env_set(args[i], eq + 1) < 0){
+			printf("export: %s: not a valid identifier\n", args[i]);
+			ret = 1;
+		}
+		*eq = '=';
+	}
+
+	return ret;
+}
+
+int osh_env_unset_builtin(int argc, char **args){
+	size_t i;
+
+	(void)argc;
+
+	for (i = 1; args[i]; i++)
+		osh_env_unset(args[i]);
 
-	env_val[i+1] = 	NULL;
+	return 0;
 }
@@ -0,0 +1,188 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include "include/hist.h"
+#include "include/config.h"
+#include "include/sys.h"
+#include "include/linenoise.h"
+
+// The file is compacted in the background once it grows past this many
+// bytes, unless the config sets history_file_max
+#define OSH_HIST_FILE_MAX (16L << 20)
+
+static char *hist_path;
+static int hist_fd = -1;
+static long hist_max;
+// Lines kept by a compaction, the in-memory history length
+static long hist_keep;
+static pid_t hist_compactor;
+
+// 'name' under the home directory
+static char *hist_home_path(const char *name){
+	const char *home = oshean_get_home();
+	char *path;
+
+	if (home == NULL)
+		return NULL;
+
+	if ((path = malloc(strlen(home) + strlen(name) + 1)) == NULL)
+		return NULL;
+
+	strcpy(path, home);
+	strcat(path, name);
+
+	return path;
+}
+
+static int hist_open(void){
+	if (hist_fd >= 0)
+		close(hist_fd);
+
+	hist_fd = open(hist_path, O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0600);
+
+	return hist_fd;
+}
+
+// Runs in a child. Keeps the last hist_keep lines: they are written to a
+// temporary file that is renamed over the history. The exclusive lock on
+// the old file holds appenders back until the rename is done.
+static void hist_compact_run(void){
+	size_t tlen = strlen(hist_path) + sizeof(".XXXXXX");
+	char *tmp = malloc(tlen);
+	char *map, *p, *end;
+	struct stat st;
+	long n;
+	int fd, out;
+
+	if (tmp == NULL || (fd = open(hist_path, O_RDONLY|O_CLOEXEC)) < 0)
+		_exit(1);
+
+	if (flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0)
+		_exit(1);
+
+	// Another session got there first
+	if (st.st_nlink == 0 || st.st_size <= hist_max)
+		_exit(0);
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+	if (map == MAP_FAILED)
+		_exit(1);
+
+	end = map + st.st_size;
+	while (end > map && end[-1] != '\n')
+		end--;
+
+	for (p = end, n = 0; p > map && n < hist_keep; n++){
+		char *nl = p - 1 > map ? memrchr(map, '\n', p - 1 - map) : NULL;
+
+		p = nl ? nl + 1 : map;
+	}
+
+	snprintf(tmp, tlen, "%s.XXXXXX", hist_path);
+
+	if ((out = mkstemp(tmp)) < 0)
+		_exit(1);
+
+	while (p < end){
+		ssize_t w = write(out, p, end - p);
+
+		if (w < 0){
+			unlink(tmp);
+			_exit(1);
+		}
+		p += w;
+	}
+
+	if (fchmod(out, 0600) < 0 || close(out) < 0 || rename(tmp, hist_path) < 0){
+		unlink(tmp);
+		_exit(1);
+	}
+
+	_exit(0);
+}
+
+static void hist_compact(void){
+	pid_t pid;
+
+	// Only one compaction from this shell at a time
+	if (hist_compactor > 0 && waitpid(hist_compactor, NULL, WNOHANG) == 0)
+		return;
+
+	if ((pid = fork()) == 0){
+		// Keep terminal signals away from it
+		setpgid(0, 0);
+		hist_compact_run();
+	}
+
+	hist_compactor = pid;
+}
+
+int osh_hist_init(long keep){
+	const char *path = osh_config_get("history_file");
+
+	if (path == NULL || *path == '\0')
+		hist_path = hist_home_path("/.oshean_history");
+	else if (!strncmp(path, "~/", 2))
+		hist_path = hist_home_path(path + 1);
+	else
+		hist_path = strdup(path);
+
+	if (hist_path == NULL)
+		return -1;
+
+	hist_max = osh_config_long("history_file_max", OSH_HIST_FILE_MAX);
+	hist_keep = keep > 0 ? keep : 1;
+
+	// Read once the first prompt is up or the history is needed
+	linenoiseHistoryLoadDeferred(hist_path);
+
+	return hist_open() < 0 ? -1 : 0;
+}
+
+void osh_hist_add(const char *line){
+	struct iovec iov[2];
+	struct stat st;
+	int tries;
+
+	// Repeats are neither kept nor written
+	if (!linenoiseHistoryAdd(line) || hist_fd < 0)
+		return;
+
+	iov[0].iov_base = (char*)line;
+	iov[0].iov_len = strlen(line);
+	iov[1].iov_base = "\n";
+	iov[1].iov_len = 1;
+
+	// A single writev on an O_APPEND descriptor lands as one record even
+	// with several sessions writing. The shared lock keeps it away from a
+	// compaction, a file that was renamed over is reopened.
+	for (tries = 0; tries < 2; tries++){
+		if (flock(hist_fd, LOCK_SH) < 0 || fstat(hist_fd, &st) < 0)
+			return;
+
+		if (st.st_nlink == 0){
+			flock(hist_fd, LOCK_UN);
+			if (hist_open() < 0)
+				return;
+			continue;
+		}
+
+		if (writev(hist_fd, iov, 2) < 0)
+			st.st_size = 0;
+		flock(hist_fd, LOCK_UN);
+		break;
+	}
+
+	if (st.st_size + (off_t)iov[0].iov_len + 1 > hist_max)
+		hist_compact();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "lex.h"
+
+// Nested aliases and function calls expanded for one command word
+#define OSH_ALIAS_DEPTH 16
+
+// Define or replace an alias, its text is lexed on first use and the
+// tokens kept, trailing arguments of the command follow them
+int osh_alias_set(const char *name, const char *text);
+// Define or replace a function, $1 to $N, $# and $@ in its text take
+// the words after the name
+int osh_alias_set_function(const char *name, const char *text);
+int osh_alias_unset(const char *name);
+// Aliases and functions from "alias NAME = ..." and "function NAME = ..."
+// config entries
+void osh_alias_init(void);
+void osh_alias_free(void);
+
+// Splice aliases and functions into every command word of a lexed line,
+// returns 't' itself when nothing expanded and NULL on errors
+struct osh_tok *osh_alias_expand(struct osh_arena *a, struct osh_tok *t, int *n);
+
+int osh_alias_builtin(int argc, char **argv);
+int osh_alias_function_builtin(int argc, char **argv);
+int osh_alias_unalias_builtin(int argc, char **argv);
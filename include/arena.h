@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct osh_arena_chunk {
+	struct osh_arena_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+// Bump allocator for state that dies together, reset instead of freed
+struct osh_arena {
+	struct osh_arena_chunk *chunk;
+};
+
+void osh_arena_init(struct osh_arena *a);
+void *osh_arena_alloc(struct osh_arena *a, size_t size);
+// Grow the latest allocation in place when possible, copy otherwise
+void *osh_arena_grow(struct osh_arena *a, void *ptr, size_t old, size_t size);
+char *osh_arena_strndup(struct osh_arena *a, const char *s, size_t len);
+// Forget every allocation, the largest chunk is kept for the next round
+// unless it grew past 64 KB
+void osh_arena_reset(struct osh_arena *a);
+void osh_arena_free(struct osh_arena *a);
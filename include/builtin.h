@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int (osh_builtin_fn)(int argc, char **argv);
+
+struct osh_builtin {
+	const char *name;
+	osh_builtin_fn *fn;
+};
+
+// Look a builtin up by name, NULL when it is not one
+const struct osh_builtin *osh_builtin_find(const char *name);
+// Every builtin, sorted by name
+const struct osh_builtin *osh_builtin_list(size_t *n);
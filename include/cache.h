@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Bytes of keys and output kept before the least recently used entries go,
+// "cache_size" in the config
+#define OSH_CACHE_SIZE (1024 * 1024)
+
+// Output of a command run from the cache, owned by the cache and valid
+// until the next call into it
+struct osh_cache_result {
+	const char *out;
+	size_t len;
+	int status;
+	// Served from memory, nothing ran
+	int hit;
+};
+
+// Run argv with stdout captured, or serve the stdout of an earlier run with
+// the same argv, cwd and mtimes of 'files'. Output is also written to
+// 'fd_out' when it is not -1. Returns -1 when the command can't start.
+int osh_cache_run(char **argv, char **files, int nfiles, int fd_out, struct osh_cache_result *r);
+// "cache WORDS = FILES" rules from the config and the size cap
+void osh_cache_init(void);
+void osh_cache_free(void);
+// Whether a config rule names a command starting like argv, such commands
+// are memoized without the prefix
+int osh_cache_rule_match(int argc, char **argv);
+
+// cache [-f FILE]... command ..., cache -c to forget everything and cache
+// alone to list what's kept
+int osh_cache_builtin(int argc, char **argv);
+// Run argv through the cache with the files of its config rule
+int osh_cache_rule_builtin(int argc, char **argv);
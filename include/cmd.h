@@ -1,3 +1,5 @@
+#pragma once
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -5,4 +7,55 @@
 #include <errno.h>
 #include <string.h>
 
-int cmd_exec_oshean(char *input_cmd_oshean, char **args);
+#include "parse.h"
+#include "builtin.h"
+
+// Launch through fork + execve instead of posix_spawn
+#define OSH_LAUNCH_FORK 1
+
+// Descriptors a redirection can name, 0 to 9
+#define OSH_REDIR_FDS 10
+
+// Descriptor 'fd' of the child becomes a copy of the shell's 'src', or is
+// closed when 'src' is -1
+struct osh_fdmap {
+	int fd;
+	int src;
+};
+
+// Everything needed to start one external command
+struct osh_launch {
+	char *path;
+	char **argv;
+	int argc;
+	char **envp;
+	// stdin and stdout of the child, -1 to inherit the shell's
+	int fd_in;
+	int fd_out;
+	// Redirections, applied after fd_in and fd_out
+	struct osh_fdmap *fdmap;
+	int nfdmap;
+	// Process group to join, 0 to lead a new one, -1 to stay in the shell's
+	pid_t pgid;
+	// Hand the terminal over to the process group
+	int foreground;
+	// Run this builtin in the child instead of exec, needs OSH_LAUNCH_FORK
+	osh_builtin_fn *builtin;
+	int flags;
+};
+
+struct osh_launch_stats {
+	unsigned long spawn;
+	unsigned long fork;
+};
+
+extern struct osh_launch_stats osh_launch_stats;
+
+void cmd_init_oshean(int interactive);
+pid_t cmd_launch_oshean(struct osh_launch *l);
+int cmd_exec_oshean(struct osh_pipeline *pl);
+// Start 'pl' without waiting, stdin from 'fd_in' or the shell's when -1,
+// stdout and stderr to 'fd_out', joining process group 'pgid' as for
+// struct osh_launch. Simple external commands go through posix_spawn,
+// builtins and pipelines run in a copy of the shell. Returns the pid.
+pid_t cmd_start_oshean(struct osh_pipeline *pl, int fd_in, int fd_out, pid_t pgid);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "linenoise.h"
+
+// Tab completion for the word at the end of 'buf': commands from the
+// builtins and $PATH, files from the word's directory, git subcommands
+// and branches
+void osh_complete(const char *buf, linenoiseCompletions *lc);
+// Hints provider showing what Tab would add to the last word, one source
+// of candidates per call
+int osh_complete_hint(const char *buf, int restart, char **hint, int *color, int *bold);
+// Idle callback listing one $PATH directory per call ahead of the first
+// Tab or hint, 0 once they are all cached
+int osh_complete_idle(int work);
+// Git directory of the repository holding the working directory, -1 when
+// outside of one
+int osh_complete_gitdir(char *out, size_t len);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef void (osh_config_fn)(const char *name, const char *val, void *arg);
+
+// Read $XDG_CONFIG_HOME/oshean/config or ~/.config/oshean/config, lines
+// of "key = value" with # comments. A missing file is not an error. The
+// parsed file is kept in config.snap beside it and mapped by the next
+// shell, the text is only parsed again after it changes.
+int osh_config_load(void);
+// Value of 'key', NULL when the config does not set it
+const char *osh_config_get(const char *key);
+// Numeric value of 'key', 'def' when unset or not a number
+long osh_config_long(const char *key, long def);
+// Call 'fn' for every key starting with 'prefix', in key order, with the
+// rest of the key: "alias gs = git status" gives "gs" for "alias "
+void osh_config_each(const char *prefix, osh_config_fn *fn, void *arg);
+// Set the "env NAME = value" defaults the environment does not have
+void osh_config_env(void);
+void osh_config_free(void);
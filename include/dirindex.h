@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct osh_dirent {
+	const char *name;
+	// d_type from readdir, DT_UNKNOWN when the filesystem doesn't say
+	unsigned char type;
+};
+
+// Sorted listing of directory 'path' without . and .., served from a
+// cache and only read again once the directory's mtime moved. The array
+// belongs to the cache and stays valid until the next osh_dir_list call.
+// Returns NULL if the directory can't be read.
+const struct osh_dirent *osh_dir_list(const char *path, size_t *n);
+// First entry of a listing that does not sort before 'prefix'
+size_t osh_dir_lower(const struct osh_dirent *ents, size_t n, const char *prefix);
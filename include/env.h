@@ -1,4 +1,16 @@
+#pragma once
+
 #include <stdio.h>
 #include <stdlib.h>
 
-void set_env_var(char **env_val, char **envp);
+// Bumped on every change to the environment store
+extern unsigned long osh_env_gen;
+
+void osh_env_init(char **envp);
+char *osh_env_get(const char *name);
+int osh_env_set(const char *name, const char *value);
+int osh_env_unset(const char *name);
+// NULL terminated "NAME=value" vector for execve, owned by the store
+char **osh_env_vec(void);
+int osh_env_export_builtin(int argc, char **args);
+int osh_env_unset_builtin(int argc, char **args);
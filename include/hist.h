@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Load the history file into linenoise and open it for appending. The
+// file is history_file from the config, ~/.oshean_history by default,
+// compactions keep its last 'keep' lines.
+int osh_hist_init(long keep);
+// Add a line to the history, and to the file as one O_APPEND record
+void osh_hist_add(const char *line);
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "times.h"
+
+enum osh_job_state {
+	OSH_JOB_RUNNING,
+	OSH_JOB_STOPPED,
+	OSH_JOB_DONE
+};
+
+struct osh_job {
+	int id;
+	// Process group, 0 when the shell doesn't do job control
+	pid_t pgid;
+	pid_t *pids;
+	// Per process osh_job_state and wait status
+	int *states;
+	int *statuses;
+	int npids;
+	enum osh_job_state state;
+	// State changed since the user was last told
+	int notify;
+	char *text;
+	// Resources used by the finished processes, wall clock span
+	struct rusage ru;
+	struct timespec start;
+	struct timespec end;
+	// Terminal modes the job had when it was stopped
+	struct termios tmodes;
+	int has_tmodes;
+	struct osh_job *next;
+};
+
+// Process groups and the terminal are only managed by interactive shells
+extern int osh_job_control;
+extern pid_t osh_shell_pgid;
+
+void osh_job_init(int interactive);
+// Self-pipe written by the SIGCHLD handler, readable when children changed
+int osh_job_fd(void);
+// Reap every child that changed state without blocking
+void osh_job_reap(void);
+// Report finished and stopped jobs, drop the finished ones
+void osh_job_notify(void);
+
+// Track launched processes, pids with -1 are skipped
+struct osh_job *osh_job_new(pid_t pgid, pid_t *pids, int npids);
+struct osh_pipeline;
+
+// Wait for a foreground job to finish or stop, returns its exit status.
+// Finished jobs are freed, stopped ones stay with 'pl' as their text.
+int osh_job_wait_fg(struct osh_job *j, struct osh_pipeline *pl);
+void osh_job_free(struct osh_job *j);
+// Wall clock and resource usage of a finished job
+void osh_job_times(struct osh_job *j, struct osh_times *t);
+
+int osh_job_jobs_builtin(int argc, char **argv);
+int osh_job_fg_builtin(int argc, char **argv);
+int osh_job_bg_builtin(int argc, char **argv);
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+
+// Stands in for a $ that is subject to expansion, so quoted and escaped
+// dollars survive unquoting as plain text
+#define OSH_LEX_VAR '\x01'
+
+// Leave $ expansions for later, words keep OSH_LEX_VAR and get 'expand'
+#define OSH_LEX_RAW 1
+
+enum osh_tok_type {
+	OSH_TOK_WORD,
+	OSH_TOK_PIPE,
+	OSH_TOK_AMP,
+	// Redirections, each followed by its word: < > >> <& >& <<<
+	OSH_TOK_IN,
+	OSH_TOK_OUT,
+	OSH_TOK_APPEND,
+	OSH_TOK_DUP_IN,
+	OSH_TOK_DUP_OUT,
+	OSH_TOK_STRING
+};
+
+struct osh_tok {
+	enum osh_tok_type type;
+	// Word text, unquoted in place inside the lexed line or copied into the
+	// arena when it had $ expansions, NULL for operators
+	char *str;
+	// Lexed with OSH_LEX_RAW and still holding $, see osh_lex_expand()
+	int expand;
+	// Descriptor written before a redirection, 2 in 2>, -1 for the default
+	int fd;
+};
+
+// Single pass lexer, the line is modified in place and the token vector
+// lives in the arena. $?, $NAME and ${NAME} expand outside single quotes.
+// Operators end words without blanks around them, as in ls>out.
+// Returns NULL on syntax errors.
+struct osh_tok *osh_lex(struct osh_arena *a, char *s, int *ntok, int flags);
+// Expand the OSH_LEX_VAR marked $ of a raw word into a new arena string
+char *osh_lex_expand(struct osh_arena *a, const char *word);
+// Positional parameters for $1 to $N, $# and $@ while a function body is
+// expanded, argv NULL to go back to the environment
+void osh_lex_set_args(int argc, char **argv);
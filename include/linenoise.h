@@ -51,9 +51,20 @@ typedef struct linenoiseCompletions {
 typedef void(linenoiseCompletionCallback)(const char *, linenoiseCompletions *);
 typedef char*(linenoiseHintsCallback)(const char *, int *color, int *bold);
 typedef void(linenoiseFreeHintsCallback)(void *);
+/* Polled while no key is waiting, with 'restart' set on the first call for
+ * 'buf'. Returns 0 to be called again or 1 once *hint is final, NULL for
+ * no hint. Keys are read between calls, so each one should be short. */
+typedef int(linenoiseHintsProvider)(const char *buf, int restart, char **hint, int *color, int *bold);
+typedef void(linenoiseWatchCallback)(void);
+/* Idle work, one short step when 'work' is set. Returns whether there is
+ * anything to do, polling waits for keys without a timeout once it's 0. */
+typedef int(linenoiseIdleCallback)(int work);
 void linenoiseSetCompletionCallback(linenoiseCompletionCallback *);
 void linenoiseSetHintsCallback(linenoiseHintsCallback *);
 void linenoiseSetFreeHintsCallback(linenoiseFreeHintsCallback *);
+void linenoiseSetHintsProvider(linenoiseHintsProvider *);
+void linenoiseSetWatchFd(int fd, linenoiseWatchCallback *);
+void linenoiseSetIdleCallback(linenoiseIdleCallback *);
 void linenoiseAddCompletion(linenoiseCompletions *, const char *);
 
 char *linenoise(const char *prompt);
@@ -62,12 +73,29 @@ int linenoiseHistoryAdd(const char *line);
 int linenoiseHistorySetMaxLen(int len);
 int linenoiseHistorySave(const char *filename);
 int linenoiseHistoryLoad(const char *filename);
+int linenoiseHistoryLoadDeferred(const char *filename);
+int linenoiseHistoryLen(void);
+const char *linenoiseHistoryGet(int index);
 void linenoiseClearScreen(void);
 void linenoiseSetMultiLine(int ml);
 void linenoisePrintKeyCodes(void);
 void linenoiseMaskModeEnable(void);
 void linenoiseMaskModeDisable(void);
 
+/* What handling one key of a replayed trace took. */
+typedef struct linenoiseKeyStat {
+  int key;        /* Key code as read, ESC for escape sequences. */
+  long ns;        /* From reading the key to being done with it. */
+  size_t bytes;   /* Bytes written for it. */
+  int writes;     /* write() calls they took. */
+} linenoiseKeyStat;
+
+typedef void(linenoiseReplayCallback)(const linenoiseKeyStat *ks, void *arg);
+/* Let hints and the history index finish between keys of a replay. */
+#define LINENOISE_REPLAY_IDLE 1
+int linenoiseReplay(int ifd, int ofd, const char *prompt, int cols, int flags,
+    linenoiseReplayCallback *cb, void *arg);
+
 typedef size_t (linenoisePrevCharLen)(const char *buf, size_t buf_len, size_t pos, size_t *col_len);
 typedef size_t (linenoiseNextCharLen)(const char *buf, size_t buf_len, size_t pos, size_t *col_len);
 typedef size_t (linenoiseReadCode)(int fd, char *buf, size_t buf_len, int* c);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Upper bound on -j, more slots than this only add scheduling noise
+#define OSH_PARALLEL_MAX_JOBS 256
+
+// parallel [-j N] [-k] command ... [::: input ...]
+//
+// Run the command once per input, with {} replaced by the input or the
+// input appended when there's no {}. Inputs are the words after ::: or
+// the lines of stdin. At most N jobs run at once, N defaults to the
+// number of CPUs. A job's stdout and stderr are printed together once it
+// exits, in completion order or in input order with -k. Returns the
+// number of failed jobs, at most 101.
+int osh_parallel_builtin(int argc, char **argv);
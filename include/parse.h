@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+
+enum osh_redir_type {
+	OSH_REDIR_IN,
+	OSH_REDIR_OUT,
+	OSH_REDIR_APPEND,
+	// n>&m and n<&m, 'word' is m or - to close n
+	OSH_REDIR_DUP,
+	// n<<<word, the word and a newline
+	OSH_REDIR_STRING
+};
+
+// Redirection of descriptor 'fd' of one command, applied left to right
+struct osh_redir {
+	enum osh_redir_type type;
+	int fd;
+	char *word;
+};
+
+// One simple command of a pipeline
+struct osh_cmd {
+	char **argv;
+	int argc;
+	struct osh_redir *redirs;
+	int nredirs;
+};
+
+// a | b | c, ncmds is 0 for empty lines
+struct osh_pipeline {
+	struct osh_cmd *cmds;
+	int ncmds;
+	// Trailing &
+	int background;
+	// Leading time keyword, report resource usage afterwards
+	int timed;
+	// Arena it was parsed into, scratch memory for running it
+	struct osh_arena *arena;
+};
+
+// Lex and parse a line, everything lives in the arena. Returns NULL on
+// syntax errors.
+struct osh_pipeline *osh_parse(struct osh_arena *a, char *s);
+// Command line text rebuilt from the words, malloc'd, for job listings
+char *osh_pipeline_text(struct osh_pipeline *pl);
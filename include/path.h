@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Resolve a command name against $PATH through the hashed cache, returns
+// an absolute path owned by the cache or NULL if nothing executable found
+char *osh_path_lookup(const char *name);
+// Forget every remembered location (hash -r)
+void osh_path_flush(void);
+// hash builtin: list, remember or forget command locations
+int osh_path_hash_builtin(int argc, char **args);
+// Directories of the current $PATH, in search order
+int osh_path_dir_count(void);
+const char *osh_path_dir(int i);
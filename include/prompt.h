@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Read the segment list, "prompt = user cwd git status duration" in the
+// config, and compute what never changes (user@host)
+int osh_prompt_init(void);
+// The working directory changed, cwd and git look again on the next render
+void osh_prompt_cwd_changed(void);
+// Prompt for the next line, 'ran' is 0 before the first command. The
+// string is owned by the prompt and valid until the next call.
+const char *osh_prompt_render(int ran);
+void osh_prompt_free(void);
@@ -4,4 +4,15 @@
 #include <curses.h>
 #include <string.h>
 
+#include "arena.h"
+
+// Environment store and job control set up shared by every mode
+void osh_init_shell(int interactive);
+// Parse and run one line, returns its exit status
+int osh_eval_line(struct osh_arena *a, char *line);
 int spawn_oshean();
+
+// Non-interactive modes, no prompt, history or line editing
+int osh_run_script(const char *path);
+int osh_run_fd(int fd);
+int osh_run_string(const char *cmd);
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Overhead of the shell itself, shown by the stats builtin. The counters
+// only exist in builds with OSH_STATS defined (cmake -DOSH_STATS=ON), in
+// any other build every hook below compiles to nothing.
+
+// Log2 buckets of microseconds, under 1us first, the last one takes
+// everything from 16ms up
+#define OSH_STATS_BUCKETS 16
+
+struct osh_stats_hist {
+	unsigned long n;
+	unsigned long long sum_ns;
+	unsigned long long max_ns;
+	unsigned long bucket[OSH_STATS_BUCKETS];
+};
+
+struct osh_stats {
+	// Enter pressed to the line's first command started
+	struct osh_stats_hist enter_exec;
+	// Tab completions and hint provider calls
+	struct osh_stats_hist complete;
+	struct osh_stats_hist hint;
+	// Line editor refreshes and the bytes they wrote
+	struct osh_stats_hist refresh;
+	unsigned long long refresh_bytes;
+	unsigned long path_hits;
+	unsigned long path_misses;
+	// Builtins run inside the shell, nothing launched
+	unsigned long builtin;
+	// When the pending Enter was pressed, 0 once it's accounted for
+	long long enter_ns;
+};
+
+#ifdef OSH_STATS
+// Single threaded, plain increments
+extern struct osh_stats osh_stats;
+
+long long osh_stats_now(void);
+void osh_stats_record(struct osh_stats_hist *h, long long start_ns);
+void osh_stats_exec(void);
+
+#define OSH_STATS_START(v) long long v = osh_stats_now()
+#define OSH_STATS_TIME(h, v) osh_stats_record(&osh_stats.h, v)
+#define OSH_STATS_INC(f) (osh_stats.f++)
+#define OSH_STATS_ADD(f, n) (osh_stats.f += (n))
+#define OSH_STATS_ENTER() (osh_stats.enter_ns = osh_stats_now())
+#define OSH_STATS_EXEC() osh_stats_exec()
+#else
+#define OSH_STATS_START(v)
+#define OSH_STATS_TIME(h, v)
+#define OSH_STATS_INC(f)
+#define OSH_STATS_ADD(f, n)
+#define OSH_STATS_ENTER()
+#define OSH_STATS_EXEC()
+#endif
+
+// Remember the "stats_dump" config file, - for stderr
+void osh_stats_init(void);
+// Append the stats to that file, if any, while the shell is still whole
+void osh_stats_exit(void);
+// stats [-r]: everything counted so far, -r to start over
+int osh_stats_builtin(int argc, char **argv);
@@ -8,4 +8,3 @@
 char *ltrim(char *s);
 char *rtrim(char *s);
 char *osh_trim(char *s);
-char *osh_set_args(char **arg, char *cmd);
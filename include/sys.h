@@ -5,4 +5,6 @@
 #include <limits.h>
 
 char *oshean_get_user();
+// $HOME, or the password database's home directory when it's unset
+const char *oshean_get_home();
 char *oshean_get_hostname();
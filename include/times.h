@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+
+// Wall clock and resources used by one command line, microseconds
+struct osh_times {
+	long long real_us;
+	long long user_us;
+	long long sys_us;
+	long maxrss_kb;
+	long nvcsw;
+	long nivcsw;
+};
+
+// Shell side starting point of one command line
+struct osh_times_mark {
+	struct timespec start;
+	struct rusage self;
+};
+
+// Last foreground command, read by time, $? style variables and the prompt
+extern struct osh_times osh_last_times;
+extern int osh_last_status;
+// Start of the interactive shell to its first prompt, $OSH_STARTUP_US
+extern long long osh_startup_us;
+
+// Clear the last times and remember where the shell stands
+void osh_times_start(struct osh_times_mark *m);
+// Fill in the wall clock and add what the shell itself used on top of
+// the children accounted by the job
+void osh_times_stop(const struct osh_times_mark *m);
+// Print a time report to stderr
+void osh_times_print(const struct osh_times *t);
+// Short human duration like 850us, 12.3ms or 1.25s
+void osh_times_duration(long long us, char *buf, size_t len);
+// $? and the OSH_* timing variables, NULL for other names
+const char *osh_times_var(const char *name, size_t len, char *buf, size_t buflen);
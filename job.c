@@ -0,0 +1,445 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "include/job.h"
+#include "include/parse.h"
+
+int osh_job_control;
+pid_t osh_shell_pgid;
+
+static struct osh_job *jobs;
+static int job_pipe[2] = { -1, -1 };
+static struct termios shell_tmodes;
+
+static void job_sigchld(int sig){
+	int saved = errno;
+
+	(void)sig;
+
+	// Pipe is non blocking, a full pipe already means "children changed"
+	if (write(job_pipe[1], "", 1) < 0){}
+	errno = saved;
+}
+
+void osh_job_init(int interactive){
+	struct sigaction sa;
+
+	osh_job_control = interactive && isatty(STDIN_FILENO);
+
+	if (pipe2(job_pipe, O_CLOEXEC|O_NONBLOCK) == 0){
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = job_sigchld;
+		sa.sa_flags = SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGCHLD, &sa, NULL);
+	}
+
+	if (!osh_job_control)
+		return;
+
+	// Ctrl-Z, Ctrl-C and terminal access only concern the foreground job
+	signal(SIGTSTP, SIG_IGN);
+	signal(SIGTTIN, SIG_IGN);
+	signal(SIGTTOU, SIG_IGN);
+	signal(SIGINT, SIG_IGN);
+	signal(SIGQUIT, SIG_IGN);
+
+	osh_shell_pgid = getpgrp();
+	tcgetattr(STDIN_FILENO, &shell_tmodes);
+}
+
+void osh_job_times(struct osh_job *j, struct osh_times *t){
+	t->real_us = (j->end.tv_sec - j->start.tv_sec) * 1000000LL +
+		(j->end.tv_nsec - j->start.tv_nsec) / 1000;
+	t->user_us = j->ru.ru_utime.tv_sec * 1000000LL + j->ru.ru_utime.tv_usec;
+	t->sys_us = j->ru.ru_stime.tv_sec * 1000000LL + j->ru.ru_stime.tv_usec;
+	t->maxrss_kb = j->ru.ru_maxrss;
+	t->nvcsw = j->ru.ru_nvcsw;
+	t->nivcsw = j->ru.ru_nivcsw;
+}
+
+int osh_job_fd(void){
+	return job_pipe[0];
+}
+
+static int job_next_id(void){
+	struct osh_job *j;
+	int id = 1;
+
+	for (j = jobs; j; j = j->next)
+		if (j->id >= id)
+			id = j->id + 1;
+
+	return id;
+}
+
+struct osh_job *osh_job_new(pid_t pgid, pid_t *pids, int npids){
+	struct osh_job *j = calloc(1, sizeof(*j));
+	struct osh_job **pj;
+	int i;
+
+	if (j == NULL)
+		return NULL;
+
+	j->pids = malloc(npids * sizeof(*j->pids));
+	j->states = malloc(npids * sizeof(*j->states));
+	j->statuses = calloc(npids, sizeof(*j->statuses));
+
+	if (j->pids == NULL || j->states == NULL || j->statuses == NULL){
+		osh_job_free(j);
+		return NULL;
+	}
+
+	for (i = 0; i < npids; i++){
+		if (pids[i] <= 0)
+			continue;
+
+		j->pids[j->npids] = pids[i];
+		j->states[j->npids] = OSH_JOB_RUNNING;
+		j->npids++;
+	}
+
+	j->pgid = pgid > 0 ? pgid : 0;
+	j->state = OSH_JOB_RUNNING;
+	clock_gettime(CLOCK_MONOTONIC, &j->start);
+	j->id = job_next_id();
+
+	// Oldest first, like the job ids
+	for (pj = &jobs; *pj; pj = &(*pj)->next)
+		;
+	*pj = j;
+
+	return j;
+}
+
+void osh_job_free(struct osh_job *j){
+	struct osh_job **pj;
+
+	for (pj = &jobs; *pj; pj = &(*pj)->next){
+		if (*pj == j){
+			*pj = j->next;
+			break;
+		}
+	}
+
+	free(j->pids);
+	free(j->states);
+	free(j->statuses);
+	free(j->text);
+	free(j);
+}
+
+// Recompute the job state from its processes
+static void job_state(struct osh_job *j){
+	enum osh_job_state state;
+	int i, running = 0, stopped = 0;
+
+	for (i = 0; i < j->npids; i++){
+		if (j->states[i] == OSH_JOB_RUNNING)
+			running++;
+		else if (j->states[i] == OSH_JOB_STOPPED)
+			stopped++;
+	}
+
+	state = running ? OSH_JOB_RUNNING : stopped ? OSH_JOB_STOPPED : OSH_JOB_DONE;
+
+	if (state != j->state){
+		j->state = state;
+		j->notify = 1;
+	}
+}
+
+// Add what one finished process used to the job's totals
+static void job_account(struct osh_job *j, struct rusage *ru){
+	timeradd(&j->ru.ru_utime, &ru->ru_utime, &j->ru.ru_utime);
+	timeradd(&j->ru.ru_stime, &ru->ru_stime, &j->ru.ru_stime);
+	if (ru->ru_maxrss > j->ru.ru_maxrss)
+		j->ru.ru_maxrss = ru->ru_maxrss;
+	j->ru.ru_nvcsw += ru->ru_nvcsw;
+	j->ru.ru_nivcsw += ru->ru_nivcsw;
+}
+
+// Record a wait status and resource usage reported for 'pid'
+static void job_update(pid_t pid, int status, struct rusage *ru){
+	struct osh_job *j;
+	int i;
+
+	for (j = jobs; j; j = j->next){
+		for (i = 0; i < j->npids; i++){
+			if (j->pids[i] != pid)
+				continue;
+
+			if (WIFSTOPPED(status)){
+				j->states[i] = OSH_JOB_STOPPED;
+			} else if (WIFCONTINUED(status)){
+				j->states[i] = OSH_JOB_RUNNING;
+			} else {
+				j->states[i] = OSH_JOB_DONE;
+				j->statuses[i] = status;
+				job_account(j, ru);
+			}
+
+			job_state(j);
+			if (j->state == OSH_JOB_DONE)
+				clock_gettime(CLOCK_MONOTONIC, &j->end);
+			return;
+		}
+	}
+}
+
+void osh_job_reap(void){
+	struct rusage ru;
+	char buf[64];
+	pid_t pid;
+	int status;
+
+	while (read(job_pipe[0], buf, sizeof(buf)) > 0)
+		;
+
+	while ((pid = wait4(-1, &status, WNOHANG|WUNTRACED|WCONTINUED, &ru)) > 0)
+		job_update(pid, status, &ru);
+
+	// Nobody is told about jobs without job control, don't keep them
+	if (!osh_job_control){
+		struct osh_job *j, *next;
+
+		for (j = jobs; j; j = next){
+			next = j->next;
+			if (j->state == OSH_JOB_DONE)
+				osh_job_free(j);
+		}
+	}
+}
+
+// Exit status of a job, the one of its last process like other shells
+static int job_status(struct osh_job *j){
+	int status;
+
+	if (j->npids == 0)
+		return 0;
+
+	status = j->statuses[j->npids - 1];
+
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+
+	return WEXITSTATUS(status);
+}
+
+static const char *job_state_name(struct osh_job *j, char *buf, size_t len){
+	int status = job_status(j);
+
+	switch (j->state){
+	case OSH_JOB_RUNNING:
+		return "Running";
+	case OSH_JOB_STOPPED:
+		return "Stopped";
+	default:
+		if (status == 0)
+			return "Done";
+		snprintf(buf, len, "Exit %d", status);
+		return buf;
+	}
+}
+
+static void job_print(struct osh_job *j){
+	char buf[32];
+
+	printf("[%d]  %-22s %s\n", j->id, job_state_name(j, buf, sizeof(buf)),
+		j->text ? j->text : "");
+}
+
+void osh_job_notify(void){
+	struct osh_job *j, *next;
+
+	osh_job_reap();
+
+	for (j = jobs; j; j = next){
+		next = j->next;
+
+		if (!j->notify)
+			continue;
+
+		j->notify = 0;
+
+		if (j->state == OSH_JOB_RUNNING)
+			continue;
+
+		job_print(j);
+
+		if (j->state == OSH_JOB_DONE)
+			osh_job_free(j);
+	}
+}
+
+int osh_job_wait_fg(struct osh_job *j, struct osh_pipeline *pl){
+	int status;
+
+	if (osh_job_control && j->pgid){
+		if (j->has_tmodes)
+			tcsetattr(STDIN_FILENO, TCSADRAIN, &j->tmodes);
+		tcsetpgrp(STDIN_FILENO, j->pgid);
+	}
+
+	// Other jobs' children reported meanwhile are recorded too
+	while (j->state == OSH_JOB_RUNNING){
+		struct rusage ru;
+		pid_t pid = wait4(j->pgid ? -j->pgid : -1, &status, WUNTRACED, &ru);
+
+		if (pid < 0){
+			if (errno == EINTR)
+				continue;
+
+			// Nothing left to wait for, don't spin on lost children
+			if (errno == ECHILD){
+				int i;
+
+				for (i = 0; i < j->npids; i++)
+					if (j->states[i] == OSH_JOB_RUNNING)
+						j->states[i] = OSH_JOB_DONE;
+				job_state(j);
+				clock_gettime(CLOCK_MONOTONIC, &j->end);
+			}
+			break;
+		}
+
+		job_update(pid, status, &ru);
+	}
+
+	if (osh_job_control && j->pgid){
+		tcsetpgrp(STDIN_FILENO, osh_shell_pgid);
+
+		if (j->state == OSH_JOB_STOPPED){
+			tcgetattr(STDIN_FILENO, &j->tmodes);
+			j->has_tmodes = 1;
+		}
+		tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_tmodes);
+	}
+
+	j->notify = 0;
+
+	if (j->state == OSH_JOB_STOPPED){
+		// Foreground jobs only get a text once they are kept around
+		if (j->text == NULL && pl)
+			j->text = osh_pipeline_text(pl);
+
+		printf("\n");
+		job_print(j);
+		return 128 + SIGTSTP;
+	}
+
+	status = job_status(j);
+	osh_job_times(j, &osh_last_times);
+	osh_job_free(j);
+
+	return status;
+}
+
+// %n, n or nothing for the most recent job
+static struct osh_job *job_find(int argc, char **argv, const char *name){
+	struct osh_job *j;
+	int id;
+
+	if (argc < 2){
+		for (j = jobs; j && j->next; j = j->next)
+			;
+		if (j == NULL)
+			printf("%s: current: no such job\n", name);
+		return j;
+	}
+
+	id = atoi(argv[1][0] == '%' ? argv[1] + 1 : argv[1]);
+
+	for (j = jobs; j; j = j->next)
+		if (j->id == id)
+			return j;
+
+	printf("%s: %s: no such job\n", name, argv[1]);
+	return NULL;
+}
+
+static void job_continue(struct osh_job *j){
+	int i;
+
+	for (i = 0; i < j->npids; i++)
+		if (j->states[i] == OSH_JOB_STOPPED)
+			j->states[i] = OSH_JOB_RUNNING;
+	j->state = OSH_JOB_RUNNING;
+
+	if (j->pgid)
+		kill(-j->pgid, SIGCONT);
+	else
+		for (i = 0; i < j->npids; i++)
+			kill(j->pids[i], SIGCONT);
+}
+
+int osh_job_jobs_builtin(int argc, char **argv){
+	struct osh_job *j;
+
+	(void)argc;
+	(void)argv;
+
+	osh_job_reap();
+
+	for (j = jobs; j; j = j->next){
+		job_print(j);
+		j->notify = 0;
+	}
+
+	// Finished jobs were reported now, forget them
+	for (j = jobs; j; ){
+		struct osh_job *next = j->next;
+
+		if (j->state == OSH_JOB_DONE)
+			osh_job_free(j);
+		j = next;
+	}
+
+	return 0;
+}
+
+int osh_job_fg_builtin(int argc, char **argv){
+	struct osh_job *j;
+
+	osh_job_reap();
+
+	if ((j = job_find(argc, argv, "fg")) == NULL)
+		return 1;
+
+	printf("%s\n", j->text ? j->text : "");
+	fflush(stdout);
+
+	job_continue(j);
+
+	return osh_job_wait_fg(j, NULL);
+}
+
+int osh_job_bg_builtin(int argc, char **argv){
+	struct osh_job *j;
+
+	osh_job_reap();
+
+	if ((j = job_find(argc, argv, "bg")) == NULL)
+		return 1;
+
+	if (j->state != OSH_JOB_STOPPED){
+		printf("bg: job %d already in background\n", j->id);
+		return 0;
+	}
+
+	job_continue(j);
+	printf("[%d]  %s &\n", j->id, j->text ? j->text : "");
+
+	return 0;
+}
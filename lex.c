@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/lex.h"
+#include "include/env.h"
+#include "include/times.h"
+
+#define OSH_LEX_TOKS 16
+
+// Positional parameters of the function being expanded, NULL outside
+static char **lex_args;
+static int lex_nargs;
+
+static int lex_blank(char c){
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Characters that end a word and start an operator
+static int lex_meta(char c){
+	return c == '|' || c == '&' || c == '<' || c == '>';
+}
+
+// Operator starting with 'c', the first byte is passed separately because
+// terminating the previous word may have overwritten it. Returns the
+// operator length.
+static int lex_op(char c, const char *r, enum osh_tok_type *type){
+	switch (c){
+	case '|':
+		*type = OSH_TOK_PIPE;
+		return 1;
+	case '&':
+		*type = OSH_TOK_AMP;
+		return 1;
+	case '>':
+		if (r[1] == '>'){
+			*type = OSH_TOK_APPEND;
+			return 2;
+		}
+		if (r[1] == '&'){
+			*type = OSH_TOK_DUP_OUT;
+			return 2;
+		}
+		*type = OSH_TOK_OUT;
+		return 1;
+	case '<':
+		if (r[1] == '<' && r[2] == '<'){
+			*type = OSH_TOK_STRING;
+			return 3;
+		}
+		if (r[1] == '&'){
+			*type = OSH_TOK_DUP_IN;
+			return 2;
+		}
+		*type = OSH_TOK_IN;
+		return 1;
+	}
+
+	return 0;
+}
+
+static int lex_name(char c){
+	return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		(c >= '0' && c <= '9');
+}
+
+// $1 to $N, $# and $@ of the function being expanded
+static const char *lex_arg(const char *name, size_t len, char *buf, size_t buflen){
+	size_t i, off = 0;
+
+	if (*name == '#'){
+		snprintf(buf, buflen, "%d", lex_nargs);
+		return buf;
+	}
+
+	if (*name == '@'){
+		buf[0] = '\0';
+		for (i = 0; i < (size_t)lex_nargs && off + 1 < buflen; i++)
+			off += snprintf(buf + off, buflen - off, i ? " %s" : "%s", lex_args[i]);
+		return buf;
+	}
+
+	for (i = 0; i < len; i++)
+		if (name[i] < '0' || name[i] > '9')
+			return NULL;
+
+	i = strtoul(name, NULL, 10);
+
+	if (i == 0)
+		return NULL;
+
+	return i <= (size_t)lex_nargs ? lex_args[i - 1] : "";
+}
+
+// Value of the variable named by 'name', empty when unset
+static const char *lex_lookup(const char *name, size_t len, char *buf, size_t buflen){
+	const char *val;
+	char *key;
+
+	if (lex_args && (val = lex_arg(name, len, buf, buflen)) != NULL)
+		return val;
+
+	if ((val = osh_times_var(name, len, buf, buflen)) != NULL)
+		return val;
+
+	if (len >= buflen)
+		return "";
+
+	key = memcpy(buf, name, len);
+	key[len] = '\0';
+
+	return (val = osh_env_get(key)) ? val : "";
+}
+
+char *osh_lex_expand(struct osh_arena *a, const char *word){
+	char buf[1024];
+	const char *p, *val;
+	size_t len = 0, cap = strlen(word) + 64;
+	char *out = osh_arena_alloc(a, cap);
+
+	if (out == NULL)
+		return NULL;
+
+	for (p = word; *p; ){
+		const char *name;
+		size_t nlen, vlen;
+		int brace = 0;
+
+		if (*p != OSH_LEX_VAR){
+			val = p++;
+			vlen = 1;
+		} else {
+			p++;
+			if (*p == '{' && (brace = 1))
+				p++;
+
+			name = p;
+			if (*p == '?' || *p == '#' || *p == '@')
+				p++;
+			else
+				while (lex_name(*p))
+					p++;
+			nlen = p - name;
+
+			if (brace && *p == '}')
+				p++;
+
+			// A lone $ stays literal
+			if (nlen == 0)
+				val = brace ? "${" : "$";
+			else
+				val = lex_lookup(name, nlen, buf, sizeof(buf));
+			vlen = strlen(val);
+		}
+
+		if (len + vlen + 1 > cap){
+			size_t cap2 = (len + vlen + 1) * 2;
+
+			if ((out = osh_arena_grow(a, out, cap, cap2)) == NULL)
+				return NULL;
+			cap = cap2;
+		}
+
+		memcpy(out + len, val, vlen);
+		len += vlen;
+	}
+	out[len] = '\0';
+
+	return out;
+}
+
+// Append a token, doubling the vector inside the arena
+static struct osh_tok *lex_push(struct osh_arena *a, struct osh_tok *v,
+		int *n, int *cap, enum osh_tok_type type, char *str){
+	if (*n == *cap){
+		int cap2 = *cap ? *cap * 2 : OSH_LEX_TOKS;
+
+		v = osh_arena_grow(a, v, *cap * sizeof(*v), cap2 * sizeof(*v));
+
+		if (v == NULL)
+			return NULL;
+
+		*cap = cap2;
+	}
+
+	v[*n].type = type;
+	v[*n].str = str;
+	v[*n].expand = 0;
+	v[*n].fd = -1;
+	(*n)++;
+
+	return v;
+}
+
+void osh_lex_set_args(int argc, char **argv){
+	lex_nargs = argc;
+	lex_args = argv;
+}
+
+struct osh_tok *osh_lex(struct osh_arena *a, char *s, int *ntok, int flags){
+	struct osh_tok *v = NULL;
+	int n = 0, cap = 0;
+	// Read and write cursors, unquoting never makes a word longer so the
+	// write cursor stays behind the read cursor
+	char *r = s, *w;
+
+	for (;;){
+		char *word;
+		char delim;
+		int expand, quoted;
+
+		while (lex_blank(*r))
+			r++;
+
+		// End of line or comment
+		if (*r == '\0' || *r == '#')
+			break;
+
+		if (lex_meta(*r)){
+			enum osh_tok_type type;
+
+			r += lex_op(*r, r, &type);
+			if ((v = lex_push(a, v, &n, &cap, type, NULL)) == NULL)
+				return NULL;
+			continue;
+		}
+
+		word = w = r;
+		expand = 0;
+		quoted = 0;
+
+		while (*r && !lex_blank(*r) && !lex_meta(*r)){
+			if (*r == '\\'){
+				quoted = 1;
+				if (*++r == '\0')
+					break;
+				*w++ = *r++;
+			} else if (*r == '\''){
+				quoted = 1;
+				for (r++; *r && *r != '\''; )
+					*w++ = *r++;
+
+				if (*r == '\0'){
+					printf("oshean: unterminated quote\n");
+					return NULL;
+				}
+				r++;
+			} else if (*r == '"'){
+				quoted = 1;
+				for (r++; *r && *r != '"'; ){
+					if (*r == '\\' && r[1] && strchr("\"\\$`", r[1])){
+						r++;
+					} else if (*r == '$'){
+						*w++ = OSH_LEX_VAR;
+						expand = 1;
+						r++;
+						continue;
+					}
+					*w++ = *r++;
+				}
+
+				if (*r == '\0'){
+					printf("oshean: unterminated quote\n");
+					return NULL;
+				}
+				r++;
+			} else if (*r == '$'){
+				*w++ = OSH_LEX_VAR;
+				expand = 1;
+				r++;
+			} else {
+				*w++ = *r++;
+			}
+		}
+
+		// Terminate the word, the delimiter may share its byte
+		delim = *r;
+		*w = '\0';
+
+		// A single bare digit right before a redirection names its
+		// descriptor, as in 2>&1
+		if ((delim == '<' || delim == '>') && !quoted && !expand &&
+		    w - word == 1 && *word >= '0' && *word <= '9'){
+			enum osh_tok_type type;
+			int fd = *word - '0';
+
+			r += lex_op(delim, r, &type);
+			if ((v = lex_push(a, v, &n, &cap, type, NULL)) == NULL)
+				return NULL;
+			v[n-1].fd = fd;
+			continue;
+		}
+
+		if (expand && !(flags & OSH_LEX_RAW) && (word = osh_lex_expand(a, word)) == NULL)
+			return NULL;
+
+		if ((v = lex_push(a, v, &n, &cap, OSH_TOK_WORD, word)) == NULL)
+			return NULL;
+		v[n-1].expand = expand && (flags & OSH_LEX_RAW);
+
+		if (delim == '\0')
+			break;
+
+		if (lex_meta(delim)){
+			enum osh_tok_type type;
+
+			r += lex_op(delim, r, &type);
+			if ((v = lex_push(a, v, &n, &cap, type, NULL)) == NULL)
+				return NULL;
+			continue;
+		}
+		r++;
+	}
+
+	// Never hand back NULL for an empty line
+	if (v == NULL && (v = osh_arena_alloc(a, sizeof(*v))) == NULL)
+		return NULL;
+
+	*ntok = n;
+	return v;
+}
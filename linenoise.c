@@ -89,6 +89,13 @@
  *    Sequence: ESC [ n B
  *    Effect: moves cursor down of n chars.
  *
+ * Refreshes only rewrite the line from the first character that changed,
+ * and wipe whatever followed it with:
+ *
+ * ED (Erase display)
+ *    Sequence: ESC [ 0 J
+ *    Effect: clear from cursor to end of screen
+ *
  * When linenoiseClearScreen() is called, two additional escape sequences
  * are used in order to clear the screen and position the cursor at home
  * position.
@@ -103,6 +110,8 @@
  *
  */
 
+#define _GNU_SOURCE /* memrchr() */
+
 #include <termios.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -111,28 +120,121 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include "include/linenoise.h"
+#include "include/stats.h"
 
 #define LINENOISE_DEFAULT_HISTORY_MAX_LEN 100
-#define LINENOISE_MAX_LINE 4096
+#define LINENOISE_HISTORY_POOL_MIN 4096
+#define LINENOISE_LINE_MIN 256
+/* Line sized buffers grown past this are given back once the line is
+ * done, a long paste doesn't keep its memory for the rest of the session. */
+#define LINENOISE_LINE_KEEP (64*1024)
 #define UNUSED(x) (void)(x)
 static char *unsupported_term[] = {"dumb","cons25","emacs",NULL};
 static linenoiseCompletionCallback *completionCallback = NULL;
 static linenoiseHintsCallback *hintsCallback = NULL;
 static linenoiseFreeHintsCallback *freeHintsCallback = NULL;
+static linenoiseHintsProvider *hintsProvider = NULL;
+static linenoiseWatchCallback *watchCallback = NULL;
+static int watch_fd = -1;
+static linenoiseIdleCallback *idleCallback = NULL;
+
+/* Input read past the end of a pasted block, handed out before the
+ * terminal is read again. */
+static char *input_ahead = NULL;
+static size_t input_ahead_len = 0;
+static size_t input_ahead_off = 0;
+
+/* Lines of a multi-line paste after the one that was entered, each call
+ * to linenoise() takes the next one. */
+static char *paste_queue = NULL;
+static size_t paste_queue_len = 0;
+static size_t paste_queue_off = 0;
 
 static struct termios orig_termios; /* In order to restore at exit.*/
 static int maskmode = 0; /* Show "***" instead of input. For passwords. */
+/* Line being edited, grown geometrically and kept from line to line. */
+static char *edit_buf = NULL;
+static size_t edit_cap = 0;
 static int rawmode = 0; /* For atexit() function to check if restore is needed*/
 static int mlmode = 0;  /* Multi line mode. Default is single line. */
 static int atexit_registered = 0; /* Register atexit just 1 time. */
 static int history_max_len = LINENOISE_DEFAULT_HISTORY_MAX_LEN;
 static int history_len = 0;
-static char **history = NULL;
+/* File handed to linenoiseHistoryLoadDeferred(), not read yet. */
+static char *history_deferred = NULL;
+/* History lines are stored back to back in one pool, 'history' is a ring
+ * of offsets into it with the oldest entry at 'history_head'. Evicting an
+ * entry just advances the head, the bytes are reclaimed when the pool is
+ * compacted. */
+static size_t *history = NULL;
+static int history_cap = 0;     /* Slots allocated in the ring. */
+static int history_head = 0;
+static char *history_pool = NULL;
+static size_t history_pool_len = 0;
+static size_t history_pool_cap = 0;
+/* Private mapping of the loaded history file. Ring entries tagged with
+ * HISTORY_MAPPED point into it instead of the pool, their newline is
+ * replaced by a nul the first time they are read. */
+static char *history_map = NULL;
+static size_t history_map_len = 0;
+#define HISTORY_MAPPED ((size_t)1 << (sizeof(size_t)*8-1))
+
+/* Every entry ever added gets the next sequence number, entry 0 of the
+ * ring has 'history_seq_base'. Searches go through a trigram index from
+ * trigram to the increasing sequence numbers of the entries containing
+ * it. It is built by the first search and caught up by later ones, and
+ * numbers of evicted entries are trimmed off the lists lazily. */
+#define HISTORY_SEQ_NONE ((unsigned)-1)
+#define LINENOISE_SEARCH_MAX 256
+#define LINENOISE_INDEX_BATCH 1024
+/* Longest stretch spent polling the hints provider before keys are
+ * looked at again. */
+#define LINENOISE_HINT_BUDGET_NS 1000000L
+
+struct historyPosting {
+    unsigned tri;       /* Three bytes of text, 0 for a free slot. */
+    unsigned start;     /* First live id, older ones are evicted. */
+    unsigned len;
+    unsigned cap;
+    unsigned *ids;
+};
+
+static unsigned history_seq_base = 0;
+static unsigned history_indexed = 0; /* Entries below this are indexed. */
+static struct historyPosting *history_tri = NULL;
+static size_t history_tri_size = 0;
+static size_t history_tri_used = 0;
+/* Indexed entries whose text was replaced afterwards, checked apart. */
+static unsigned *history_touched = NULL;
+static int history_touched_len = 0;
+static int frame_valid = 0; /* Last refresh still matches the screen. */
+static int frame_hint = 0;  /* Last refresh drew a hint after the line. */
+
+/* Headless replay, see linenoiseReplay(). Every write to the terminal
+ * is counted, a key's share is what was written while it was handled. */
+static unsigned long term_writes = 0;
+static size_t term_bytes = 0;
+static linenoiseReplayCallback *replay_cb = NULL;
+static void *replay_arg = NULL;
+static int replay_ofd = -1;
+static int replay_cols = 0;
+static int replay_flags = 0;
+static int replay_eof = 0;      /* The trace ran out. */
+static int replay_pending = 0;  /* replay_key is being handled. */
+static linenoiseKeyStat replay_key;
+static struct timespec replay_start;
+static unsigned long replay_writes;
+static size_t replay_bytes;
 
 /* The linenoiseState structure represents the state during line editing.
  * We pass this state to functions implementing specific editing
@@ -140,8 +242,8 @@ static char **history = NULL;
 struct linenoiseState {
     int ifd;            /* Terminal stdin file descriptor. */
     int ofd;            /* Terminal stdout file descriptor. */
-    char *buf;          /* Edited line buffer. */
-    size_t buflen;      /* Edited line buffer size. */
+    char *buf;          /* Edited line buffer, edit_buf. */
+    size_t buflen;      /* Bytes it holds before it has to grow. */
     const char *prompt; /* Prompt to display. */
     size_t plen;        /* Prompt length. */
     size_t pos;         /* Current cursor position. */
@@ -150,8 +252,27 @@ struct linenoiseState {
     size_t cols;        /* Number of columns in terminal. */
     size_t maxrows;     /* Maximum num of rows used so far (multiline mode) */
     int history_index;  /* The history index we are currently editing. */
+    unsigned search_seq; /* Entry shown by prefix search, or HISTORY_SEQ_NONE. */
+    size_t pwidth;      /* Visible width of the prompt. */
+    int layout_len;     /* Marks in layout_marks valid for this line. */
+    size_t layout_cols; /* Columns the marks were computed for. */
 };
 
+/* Layout of the line being edited in multi line mode. Every
+ * LINENOISE_LAYOUT_STEP bytes or so a mark keeps where the scan of
+ * layoutColumn() stood at a character boundary, so a column is found
+ * from the last mark before it instead of the start of the line. Edits
+ * drop the marks from the changed offset on. The storage is kept from
+ * line to line. */
+#define LINENOISE_LAYOUT_STEP 128
+struct layoutMark {
+    size_t off;         /* Character boundary. */
+    size_t col;         /* Column of 'off', counting wrapped rows. */
+    size_t colwid;      /* Column of 'off' in its row. */
+};
+static struct layoutMark *layout_marks = NULL;
+static int layout_cap = 0;
+
 enum KEY_ACTION{
 	KEY_NULL = 0,	    /* NULL */
 	CTRL_A = 1,         /* Ctrl+a */
@@ -160,6 +281,7 @@ enum KEY_ACTION{
 	CTRL_D = 4,         /* Ctrl-d */
 	CTRL_E = 5,         /* Ctrl-e */
 	CTRL_F = 6,         /* Ctrl-f */
+	CTRL_G = 7,         /* Ctrl-g */
 	CTRL_H = 8,         /* Ctrl-h */
 	TAB = 9,            /* Tab */
 	CTRL_K = 11,        /* Ctrl+k */
@@ -167,6 +289,7 @@ enum KEY_ACTION{
 	ENTER = 13,         /* Enter */
 	CTRL_N = 14,        /* Ctrl-n */
 	CTRL_P = 16,        /* Ctrl-p */
+	CTRL_R = 18,        /* Ctrl-r */
 	CTRL_T = 20,        /* Ctrl-t */
 	CTRL_U = 21,        /* Ctrl+u */
 	CTRL_W = 23,        /* Ctrl+w */
@@ -175,8 +298,20 @@ enum KEY_ACTION{
 };
 
 static void linenoiseAtExit(void);
+static ssize_t termWrite(int fd, const void *buf, size_t len);
 int linenoiseHistoryAdd(const char *line);
+static int historyAdd(const char *line);
+static void historyLoadPending(void);
+static int historyLoadIdle(int work);
 static void refreshLine(struct linenoiseState *l);
+static void linenoiseEditSet(struct linenoiseState *l, const char *text, size_t len);
+static char *historyAt(int index);
+static int historySet(int index, const char *line);
+static void historyDropLast(void);
+static unsigned historySearch(const char *q, size_t qlen, int prefix, unsigned from, int dir);
+static int historyIndexIdle(int work);
+static int hintsIdle(struct linenoiseState *l, int work);
+static void editRelease(void);
 
 /* Debugging macro. */
 #if 0
@@ -236,45 +371,166 @@ void linenoiseSetEncodingFunctions(
     readCode = readCodeFunc;
 }
 
+/* Number of bytes from 'off', stopping at 'end', that are ASCII and not
+ * followed by a combining character, so one column each in any ASCII
+ * compatible encoding. Looks at eight bytes at a time. */
+static size_t asciiRun(const char *buf, size_t buf_len, size_t off, size_t end) {
+    const uint64_t high = 0x8080808080808080ULL;
+    size_t run = off;
+
+    while (run + 8 <= buf_len) {
+        uint64_t w;
+
+        memcpy(&w,buf+run,8);
+        if (w & high) break;
+        run += 8;
+        if (run > end) break;
+    }
+    while (run < buf_len && run <= end && !((unsigned char)buf[run] & 0x80)) run++;
+
+    /* The last one could still carry a combining character */
+    if (run < buf_len && run > off) run--;
+    return (run < end ? run : end) - off;
+}
+
+/* read() that serves the input read ahead first. */
+static ssize_t inputRead(int fd, char *buf, size_t len) {
+    size_t n = input_ahead_len - input_ahead_off;
+
+    if (n == 0) return read(fd,buf,len);
+    if (n > len) n = len;
+    memcpy(buf,input_ahead+input_ahead_off,n);
+    input_ahead_off += n;
+    return n;
+}
+
+/* readCode() that serves the input read ahead first, one character at a
+ * time. */
+static int readKey(int fd, char *cbuf, size_t cbuf_len, int *c) {
+    size_t n = input_ahead_len - input_ahead_off;
+
+    if (n == 0) return readCode(fd,cbuf,cbuf_len,c);
+    n = nextCharLen(input_ahead,input_ahead_len,input_ahead_off,NULL);
+    if (n > cbuf_len) n = cbuf_len;
+    memcpy(cbuf,input_ahead+input_ahead_off,n);
+    input_ahead_off += n;
+    *c = (unsigned char)cbuf[0];
+    return n;
+}
+
 /* Get column length from begining of buffer to current byte position */
 static size_t columnPos(const char *buf, size_t buf_len, size_t pos) {
     size_t ret = 0;
     size_t off = 0;
     while (off < pos) {
         size_t col_len;
-        size_t len = nextCharLen(buf,buf_len,off,&col_len);
+        size_t len = asciiRun(buf,buf_len,off,pos);
+
+        if (len) {
+            off += len;
+            ret += len;
+            continue;
+        }
+
+        len = nextCharLen(buf,buf_len,off,&col_len);
         off += len;
         ret += col_len;
     }
     return ret;
 }
 
-/* Get column length from begining of buffer to current byte position for multiline mode*/
-static size_t columnPosForMultiLine(const char *buf, size_t buf_len, size_t pos, size_t cols, size_t ini_pos) {
-    size_t ret = 0;
-    size_t colwid = ini_pos;
+/* Forget the layout of the line from byte 'off' on, after an edit there.
+ * Marks before it stay good, the bytes they were computed from didn't
+ * change. */
+static void layoutEdit(struct linenoiseState *l, size_t off) {
+    while (l->layout_len > 0 && layout_marks[l->layout_len-1].off >= off)
+        l->layout_len--;
+}
 
-    size_t off = 0;
-    while (off < buf_len) {
-        size_t col_len;
-        size_t len = nextCharLen(buf,buf_len,off,&col_len);
+static void layoutPush(struct linenoiseState *l, const struct layoutMark *m) {
+    if (l->layout_len == layout_cap) {
+        int cap = layout_cap ? layout_cap*2 : 32;
+        struct layoutMark *marks = realloc(layout_marks,sizeof(*marks)*cap);
+
+        if (marks == NULL) return;
+        layout_marks = marks;
+        layout_cap = cap;
+    }
+    layout_marks[l->layout_len++] = *m;
+}
+
+/* Number of marks not after 'pos'. */
+static int layoutFind(struct linenoiseState *l, size_t pos) {
+    int lo = 0, hi = l->layout_len;
+
+    while (lo < hi) {
+        int mid = lo+(hi-lo)/2;
+        if (layout_marks[mid].off <= pos) lo = mid+1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Column of byte 'pos' counting from the start of the line in multi line
+ * mode, where a wide character that doesn't fit at the end of a row is
+ * moved to the next one and leaves a gap. */
+static size_t layoutColumn(struct linenoiseState *l, size_t pos) {
+    struct layoutMark m;
+    size_t cols = l->cols, next = (size_t)-1;
+    int lo;
+
+    if (l->layout_cols != cols) {
+        l->layout_len = 0;
+        l->layout_cols = cols;
+    }
+
+    /* Resume from the last mark not after 'pos' */
+    lo = layoutFind(l,pos);
+    if (lo > 0) {
+        m = layout_marks[lo-1];
+    } else {
+        m.off = m.col = 0;
+        m.colwid = l->pwidth;
+    }
+    /* Past the last mark, leave new ones behind */
+    if (lo == l->layout_len) next = m.off+LINENOISE_LAYOUT_STEP;
+
+    while (m.off < l->len) {
+        size_t col_len, len;
+        int dif;
+
+        if (m.off >= next) {
+            layoutPush(l,&m);
+            next = m.off+LINENOISE_LAYOUT_STEP;
+        }
+
+        /* Single columns never overflow a row, they only fill it */
+        len = m.colwid < cols ?
+            asciiRun(l->buf,l->len,m.off,pos < next ? pos : next) : 0;
+        if (len) {
+            m.off += len;
+            m.col += len;
+            m.colwid = (m.colwid+len) % cols;
+            continue;
+        }
+
+        len = nextCharLen(l->buf,l->len,m.off,&col_len);
+        dif = (int)(m.colwid+col_len) - (int)cols;
+        if (m.off >= pos) return m.col + (dif > 0 ? dif : 0);
 
-        int dif = (int)(colwid + col_len) - (int)cols;
         if (dif > 0) {
-            ret += dif;
-            colwid = col_len;
+            m.col += dif;
+            m.colwid = col_len;
         } else if (dif == 0) {
-            colwid = 0;
+            m.colwid = 0;
         } else {
-            colwid += col_len;
+            m.colwid += col_len;
         }
-
-        if (off >= pos) break;
-        off += len;
-        ret += col_len;
+        m.off += len;
+        m.col += col_len;
     }
 
-    return ret;
+    return m.col;
 }
 
 /* ======================= Low level terminal handling ====================== */
@@ -351,6 +607,38 @@ static void disableRawMode(int fd) {
         rawmode = 0;
 }
 
+/* write() to the terminal, counted for replays. */
+static ssize_t termWrite(int fd, const void *buf, size_t len) {
+    term_writes++;
+    term_bytes += len;
+    return write(fd,buf,len);
+}
+
+/* Report the key being handled in a replay, if any. */
+static void replayKeyDone(void) {
+    struct timespec now;
+
+    if (!replay_pending) return;
+    replay_pending = 0;
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    replay_key.ns = (now.tv_sec-replay_start.tv_sec)*1000000000L +
+        (now.tv_nsec-replay_start.tv_nsec);
+    replay_key.bytes = term_bytes-replay_bytes;
+    replay_key.writes = term_writes-replay_writes;
+    replay_cb(&replay_key,replay_arg);
+}
+
+/* Key 'c' was read, time it and count its writes until the next one. */
+static void replayKeyStart(int c) {
+    if (replay_cb == NULL) return;
+    replayKeyDone();
+    replay_key.key = c;
+    replay_pending = 1;
+    replay_writes = term_writes;
+    replay_bytes = term_bytes;
+    clock_gettime(CLOCK_MONOTONIC,&replay_start);
+}
+
 /* Use the ESC [6n escape sequence to query the horizontal cursor position
  * and return it. On error -1 is returned, on success the position of the
  * cursor. */
@@ -360,7 +648,7 @@ static int getCursorPosition(int ifd, int ofd) {
     unsigned int i = 0;
 
     /* Report cursor location */
-    if (write(ofd, "\x1b[6n", 4) != 4) return -1;
+    if (termWrite(ofd, "\x1b[6n", 4) != 4) return -1;
 
     /* Read the response: ESC [ rows ; cols R */
     while (i < sizeof(buf)-1) {
@@ -390,7 +678,7 @@ static int getColumns(int ifd, int ofd) {
         if (start == -1) goto failed;
 
         /* Go to right margin and get position. */
-        if (write(ofd,"\x1b[999C",6) != 6) goto failed;
+        if (termWrite(ofd,"\x1b[999C",6) != 6) goto failed;
         cols = getCursorPosition(ifd,ofd);
         if (cols == -1) goto failed;
 
@@ -398,7 +686,7 @@ static int getColumns(int ifd, int ofd) {
         if (cols > start) {
             char seq[32];
             snprintf(seq,32,"\x1b[%dD",cols-start);
-            if (write(ofd,seq,strlen(seq)) == -1) {
+            if (termWrite(ofd,seq,strlen(seq)) == -1) {
                 /* Can't recover... */
             }
         }
@@ -413,7 +701,8 @@ failed:
 
 /* Clear the screen. Used to handle ctrl+l */
 void linenoiseClearScreen(void) {
-    if (write(STDOUT_FILENO,"\x1b[H\x1b[2J",7) <= 0) {
+    frame_valid = 0;
+    if (termWrite(replay_cb ? replay_ofd : STDOUT_FILENO,"\x1b[H\x1b[2J",7) <= 0) {
         /* nothing to do, just to avoid warning. */
     }
 }
@@ -444,7 +733,7 @@ static void freeCompletions(linenoiseCompletions *lc) {
  * structure as described in the structure definition. */
 static int completeLine(struct linenoiseState *ls, char *cbuf, size_t cbuf_len, int *c) {
     linenoiseCompletions lc = { 0, NULL };
-    int nread = 0, nwritten;
+    int nread = 0;
     *c = 0;
 
     completionCallback(ls->buf,&lc);
@@ -460,15 +749,17 @@ static int completeLine(struct linenoiseState *ls, char *cbuf, size_t cbuf_len,
 
                 ls->len = ls->pos = strlen(lc.cvec[i]);
                 ls->buf = lc.cvec[i];
+                layoutEdit(ls,0);
                 refreshLine(ls);
                 ls->len = saved.len;
                 ls->pos = saved.pos;
                 ls->buf = saved.buf;
+                layoutEdit(ls,0);
             } else {
                 refreshLine(ls);
             }
 
-            nread = readCode(ls->ifd,cbuf,cbuf_len,c);
+            nread = readKey(ls->ifd,cbuf,cbuf_len,c);
             if (nread <= 0) {
                 freeCompletions(&lc);
                 *c = -1;
@@ -488,8 +779,7 @@ static int completeLine(struct linenoiseState *ls, char *cbuf, size_t cbuf_len,
                 default:
                     /* Update buffer and return */
                     if (i < lc.len) {
-                        nwritten = snprintf(ls->buf,ls->buflen,"%s",lc.cvec[i]);
-                        ls->len = ls->pos = nwritten;
+                        linenoiseEditSet(ls,lc.cvec[i],strlen(lc.cvec[i]));
                     }
                     stop = 1;
                     break;
@@ -518,6 +808,72 @@ void linenoiseSetFreeHintsCallback(linenoiseFreeHintsCallback *fn) {
     freeHintsCallback = fn;
 }
 
+/* Register a hints provider, used instead of the hints callback. Unlike
+ * the callback it can spread its work over several calls. */
+void linenoiseSetHintsProvider(linenoiseHintsProvider *fn) {
+    hintsProvider = fn;
+}
+
+/* Register a file descriptor watched while waiting for keys, 'fn' is
+ * called every time it becomes readable and must drain it. */
+void linenoiseSetWatchFd(int fd, linenoiseWatchCallback *fn) {
+    watch_fd = fd;
+    watchCallback = fn;
+}
+
+/* Register work done while no key is pending, after linenoise's own. */
+void linenoiseSetIdleCallback(linenoiseIdleCallback *fn) {
+    idleCallback = fn;
+}
+
+/* One step of idle work when 'work' is set, the hint for the line first,
+ * then loading and indexing the history, then the caller's. Returns
+ * whether there was anything to do. */
+static int editIdle(struct linenoiseState *l, int work) {
+    return hintsIdle(l,work) || historyLoadIdle(work) || historyIndexIdle(work) ||
+        (idleCallback != NULL && idleCallback(work));
+}
+
+/* Block until there is input for 'l', serving the watched descriptor and
+ * doing the idle work meanwhile. Returns -1 if polling failed, 0
+ * otherwise. */
+static int waitInput(struct linenoiseState *l) {
+    struct pollfd fds[2];
+    int nfds = 1;
+
+    /* Keys read ahead are already there */
+    if (input_ahead_off < input_ahead_len) return 0;
+
+    /* A replayed trace is always ready, let the idle work finish first as
+     * it would for someone typing */
+    if (replay_flags & LINENOISE_REPLAY_IDLE)
+        while (editIdle(l,1));
+
+    fds[0].fd = l->ifd;
+    fds[0].events = POLLIN;
+    if (watch_fd >= 0 && watchCallback != NULL) {
+        fds[1].fd = watch_fd;
+        fds[1].events = POLLIN;
+        nfds = 2;
+    }
+
+    while (1) {
+        /* Idle work only while nothing is pending */
+        int n = poll(fds,nfds,editIdle(l,0) ? 0 : -1);
+
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) {
+            editIdle(l,1);
+            continue;
+        }
+        if (nfds > 1 && (fds[1].revents & POLLIN)) watchCallback();
+        if (fds[0].revents) return 0;
+    }
+}
+
 /* This function is used by the callback function registered by the user
  * in order to add completion options given the input string when the
  * user typed <tab>. See the example.c source code for a very easy to
@@ -543,55 +899,241 @@ void linenoiseAddCompletion(linenoiseCompletions *lc, const char *str) {
 /* We define a very simple "append buffer" structure, that is an heap
  * allocated string where we can append to. This is useful in order to
  * write all the escape sequences in a buffer and flush them to the standard
- * output in a single call, to avoid flickering effects. */
+ * output in a single call, to avoid flickering effects.
+ *
+ * The storage grows geometrically and is kept between refreshes, so after
+ * the first few keystrokes a refresh does no allocation at all. */
+#define ABUF_MIN_CAP 256
+
 struct abuf {
     char *b;
     int len;
+    int cap;
 };
 
+/* Output of the refresh in progress, and a copy of the line bytes the last
+ * refresh left on the screen. A refresh only rewrites the line from the
+ * first character that differs from that frame. */
+static struct abuf refresh_ab;
+static struct abuf frame;
+
+/* Start a new content, keeping the storage. */
 static void abInit(struct abuf *ab) {
-    ab->b = NULL;
     ab->len = 0;
 }
 
 static void abAppend(struct abuf *ab, const char *s, int len) {
-    char *new = realloc(ab->b,ab->len+len);
-
-    if (new == NULL) return;
-    memcpy(new+ab->len,s,len);
-    ab->b = new;
+    if (len == 0) return;
+    if (ab->len+len > ab->cap) {
+        int cap = ab->cap ? ab->cap : ABUF_MIN_CAP;
+        char *new;
+
+        while (cap < ab->len+len) cap *= 2;
+        if ((new = realloc(ab->b,cap)) == NULL) return;
+        ab->b = new;
+        ab->cap = cap;
+    }
+    memcpy(ab->b+ab->len,s,len);
     ab->len += len;
 }
 
+#define abAppendLit(ab,s) abAppend(ab,s,sizeof(s)-1)
+
+/* Append a decimal number without going through snprintf(). */
+static void abAppendInt(struct abuf *ab, int n) {
+    char digits[16];
+    int i = sizeof(digits);
+
+    do {
+        digits[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0 && i > 0);
+    abAppend(ab,digits+i,sizeof(digits)-i);
+}
+
+/* Append the escape sequence ESC [ n <cmd>. */
+static void abAppendSeq(struct abuf *ab, int n, char cmd) {
+    abAppendLit(ab,"\x1b[");
+    abAppendInt(ab,n);
+    abAppend(ab,&cmd,1);
+}
+
 static void abFree(struct abuf *ab) {
     free(ab->b);
+    ab->b = NULL;
+    ab->len = ab->cap = 0;
 }
 
-/* Helper of refreshSingleLine() and refreshMultiLine() to show hints
- * to the right of the prompt. */
-void refreshShowHints(struct abuf *ab, struct linenoiseState *l, int pcollen) {
-    char seq[64];
-    size_t collen = pcollen+columnPos(l->buf,l->len,l->len);
-    if (hintsCallback && collen < l->cols) {
-        int color = -1, bold = 0;
-        char *hint = hintsCallback(l->buf,&color,&bold);
+/* Remember what is on the screen after a refresh. */
+static void frameStore(const char *buf, size_t len, int hint) {
+    abInit(&frame);
+    abAppend(&frame,buf,len);
+    frame_valid = !maskmode && frame.len == (int)len;
+    frame_hint = hint;
+}
+
+/* Bytes at the start of 'buf' that are already on the screen, always
+ * ending at a character boundary. When 'buf' is the line of 'l' the walk
+ * to that boundary starts from the layout cache. */
+static size_t framePrefix(struct linenoiseState *l, const char *buf, size_t len) {
+    size_t n = len < (size_t)frame.len ? len : (size_t)frame.len;
+    size_t diff = 0, off = 0;
+    int mark;
+
+    /* First byte that differs, eight at a time */
+    while (diff+8 <= n) {
+        uint64_t a, b;
+
+        memcpy(&a,buf+diff,8);
+        memcpy(&b,frame.b+diff,8);
+        if (a != b) break;
+        diff += 8;
+    }
+    while (diff < n && buf[diff] == frame.b[diff]) diff++;
+    if (diff == len) return len;
+
+    /* Back to the start of the character holding it */
+    if (buf == l->buf && (mark = layoutFind(l,diff)) > 0)
+        off = layout_marks[mark-1].off;
+    while (off < diff) {
+        size_t clen = nextCharLen(buf,len,off,NULL);
+        if (off+clen > diff) break;
+        off += clen;
+    }
+    return off;
+}
+
+/* Hints are never computed by a refresh. A refresh shows the hint last
+ * computed for the buffer in 'hint_key' and, when the buffer moved on,
+ * drops it and leaves the provider to be polled from waitInput(). */
+#define HINT_DONE 0     /* 'hint_text' is the answer for 'hint_key'. */
+#define HINT_START 1    /* Nothing asked yet for 'hint_key'. */
+#define HINT_RUNNING 2  /* The provider wants to be called again. */
+
+static struct abuf hint_key;
+static struct abuf hint_text;
+static int hint_color = -1;
+static int hint_bold = 0;
+static int hint_state = HINT_DONE;
+static int hint_off = 0;    /* Refresh without hints, for Enter. */
+
+static int hintsActive(void) {
+    return hintsCallback != NULL || hintsProvider != NULL;
+}
+
+/* Forget any hint, the next refresh asks again. */
+static void hintsReset(void) {
+    abInit(&hint_key);
+    abAppend(&hint_key,"",1);
+    hint_key.len = 0;
+    abInit(&hint_text);
+    hint_state = HINT_START;
+}
+
+/* Make the hint cache follow the buffer of 'l'. */
+static void hintsTrack(struct linenoiseState *l) {
+    size_t klen = hint_key.len, k;
+
+    if (hint_state != HINT_START && l->len == klen &&
+        (klen == 0 || !memcmp(hint_key.b,l->buf,klen))) return;
+
+    /* Typing the next characters of the hint keeps the rest of it on the
+     * screen until the provider answers for the new buffer. */
+    k = l->len - klen;
+    if (l->len > klen && k <= (size_t)hint_text.len &&
+        (klen == 0 || !memcmp(hint_key.b,l->buf,klen)) &&
+        !memcmp(hint_text.b,l->buf+klen,k)) {
+        memmove(hint_text.b,hint_text.b+k,hint_text.len-k);
+        hint_text.len -= k;
+    } else {
+        abInit(&hint_text);
+    }
+
+    /* Kept nul terminated for the provider */
+    abInit(&hint_key);
+    abAppend(&hint_key,l->buf,l->len);
+    abAppend(&hint_key,"",1);
+    hint_key.len--;
+    hint_state = HINT_START;
+}
+
+static long hintsElapsed(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return (now.tv_sec-start->tv_sec)*1000000000L + (now.tv_nsec-start->tv_nsec);
+}
+
+/* Tells whether the hint of 'l' is still owed. With 'work' set the
+ * provider is polled for at most LINENOISE_HINT_BUDGET_NS, and the line
+ * is refreshed if the answer differs from what is shown. */
+static int hintsIdle(struct linenoiseState *l, int work) {
+    struct timespec start;
+
+    if (!hintsActive() || hint_state == HINT_DONE) return 0;
+    if (!work) return 1;
+
+    clock_gettime(CLOCK_MONOTONIC,&start);
+    do {
+        int color = -1, bold = 0, changed;
+        char *hint = NULL;
+        int restart = hint_state == HINT_START;
+
+        hint_state = HINT_RUNNING;
+        if (hintsProvider) {
+            if (!hintsProvider(hint_key.b,restart,&hint,&color,&bold)) continue;
+        } else {
+            hint = hintsCallback(hint_key.b,&color,&bold);
+        }
+
+        changed = color != hint_color || bold != hint_bold ||
+            (hint ? strlen(hint) : 0) != (size_t)hint_text.len ||
+            (hint && memcmp(hint,hint_text.b,hint_text.len));
+        abInit(&hint_text);
         if (hint) {
-            int hintlen = strlen(hint);
-            int hintmaxlen = l->cols-collen;
-            if (hintlen > hintmaxlen) hintlen = hintmaxlen;
-            if (bold == 1 && color == -1) color = 37;
-            if (color != -1 || bold != 0)
-                snprintf(seq,64,"\033[%d;%d;49m",bold,color);
-            else
-                seq[0] = '\0';
-            abAppend(ab,seq,strlen(seq));
-            abAppend(ab,hint,hintlen);
-            if (color != -1 || bold != 0)
-                abAppend(ab,"\033[0m",4);
+            abAppend(&hint_text,hint,strlen(hint));
             /* Call the function to free the hint returned. */
             if (freeHintsCallback) freeHintsCallback(hint);
         }
+        hint_color = color;
+        hint_bold = bold;
+        hint_state = HINT_DONE;
+
+        if (changed) refreshLine(l);
+        return 1;
+    } while (hintsElapsed(&start) < LINENOISE_HINT_BUDGET_NS);
+
+    return 1;
+}
+
+/* Helper of refreshSingleLine() and refreshMultiLine() to show hints
+ * to the right of the prompt. Returns 1 if a hint was appended. */
+int refreshShowHints(struct abuf *ab, struct linenoiseState *l, int pcollen) {
+    size_t collen;
+    int hintlen, hintmaxlen;
+    int color = hint_color, bold = hint_bold;
+
+    if (!hintsActive() || hint_off) return 0;
+    hintsTrack(l);
+    hintlen = hint_text.len;
+    if (hintlen == 0) return 0;
+    collen = pcollen+(mlmode ? layoutColumn(l,l->len) : columnPos(l->buf,l->len,l->len));
+    if (collen >= l->cols) return 0;
+
+    hintmaxlen = l->cols-collen;
+    if (hintlen > hintmaxlen) hintlen = hintmaxlen;
+    if (bold == 1 && color == -1) color = 37;
+    if (color != -1 || bold != 0) {
+        abAppendLit(ab,"\033[");
+        abAppendInt(ab,bold);
+        abAppendLit(ab,";");
+        abAppendInt(ab,color < 0 ? 0 : color);
+        abAppendLit(ab,";49m");
     }
+    abAppend(ab,hint_text.b,hintlen);
+    if (color != -1 || bold != 0)
+        abAppendLit(ab,"\033[0m");
+    return 1;
 }
 
 /* Check if text is an ANSI escape sequence
@@ -615,9 +1157,10 @@ static int isAnsiEscape(const char *buf, size_t buf_len, size_t* len) {
 /* Get column length of prompt text
  */
 static size_t promptTextColumnLen(const char *prompt, size_t plen) {
-    char buf[LINENOISE_MAX_LINE];
-    size_t buf_len = 0;
+    char *buf = malloc(plen+1);
+    size_t buf_len = 0, cols;
     size_t off = 0;
+    if (buf == NULL) return plen;
     while (off < plen) {
         size_t len;
         if (isAnsiEscape(prompt + off, plen - off, &len)) {
@@ -626,21 +1169,25 @@ static size_t promptTextColumnLen(const char *prompt, size_t plen) {
         }
         buf[buf_len++] = prompt[off++];
     }
-    return columnPos(buf,buf_len,buf_len);
+    cols = columnPos(buf,buf_len,buf_len);
+    free(buf);
+    return cols;
 }
 
 /* Single line low level line refresh.
  *
  * Rewrite the currently edited line accordingly to the buffer content,
- * cursor position, and number of columns of the terminal. */
+ * cursor position, and number of columns of the terminal. Only the part
+ * of the visible line that changed since the last refresh is written. */
 static void refreshSingleLine(struct linenoiseState *l) {
-    char seq[64];
-    size_t pcollen = promptTextColumnLen(l->prompt,strlen(l->prompt));
+    size_t pcollen = l->pwidth;
     int fd = l->ofd;
     char *buf = l->buf;
     size_t len = l->len;
     size_t pos = l->pos;
-    struct abuf ab;
+    size_t start = 0;
+    struct abuf *ab = &refresh_ab;
+    int hint = 0;
 
     while((pcollen+columnPos(buf,len,pos)) >= l->cols) {
         int chlen = nextCharLen(buf,len,0,NULL);
@@ -652,84 +1199,118 @@ static void refreshSingleLine(struct linenoiseState *l) {
         len -= prevCharLen(buf,len,len,NULL);
     }
 
-    abInit(&ab);
-    /* Cursor to left edge */
-    snprintf(seq,64,"\r");
-    abAppend(&ab,seq,strlen(seq));
-    /* Write the prompt and the current buffer content */
-    abAppend(&ab,l->prompt,strlen(l->prompt));
+    abInit(ab);
+    if (frame_valid) {
+        start = framePrefix(l,buf,len);
+        /* Only the cursor moved */
+        if (start == len && start == (size_t)frame.len && !hintsActive() && !frame_hint)
+            goto cursor;
+        /* Cursor to the first changed character */
+        abAppendLit(ab,"\r");
+        if (pcollen+columnPos(buf,len,start))
+            abAppendSeq(ab,(int)(pcollen+columnPos(buf,len,start)),'C');
+    } else {
+        /* Cursor to left edge, write the prompt */
+        abAppendLit(ab,"\r");
+        abAppend(ab,l->prompt,l->plen);
+    }
+    /* Write the current buffer content */
     if (maskmode == 1) {
-        while (len--) abAppend(&ab,"*",1);
+        size_t i;
+        for (i = 0; i < len; i++) abAppendLit(ab,"*");
     } else {
-        abAppend(&ab,buf,len);
+        abAppend(ab,buf+start,len-start);
     }
     /* Show hits if any. */
-    refreshShowHints(&ab,l,pcollen);
+    hint = refreshShowHints(ab,l,pcollen);
     /* Erase to right */
-    snprintf(seq,64,"\x1b[0K");
-    abAppend(&ab,seq,strlen(seq));
+    abAppendLit(ab,"\x1b[0K");
+cursor:
     /* Move cursor to original position. */
-    snprintf(seq,64,"\r\x1b[%dC", (int)(columnPos(buf,len,pos)+pcollen));
-    abAppend(&ab,seq,strlen(seq));
-    if (write(fd,ab.b,ab.len) == -1) {} /* Can't recover from write error. */
-    abFree(&ab);
+    abAppendLit(ab,"\r");
+    if (columnPos(buf,len,pos)+pcollen)
+        abAppendSeq(ab,(int)(columnPos(buf,len,pos)+pcollen),'C');
+    if (termWrite(fd,ab->b,ab->len) == -1) {} /* Can't recover from write error. */
+    frameStore(buf,len,hint);
 }
 
 /* Multi line low level line refresh.
  *
  * Rewrite the currently edited line accordingly to the buffer content,
- * cursor position, and number of columns of the terminal. */
+ * cursor position, and number of columns of the terminal. Rows before the
+ * first changed character are left alone, everything after it is erased
+ * and written again. */
 static void refreshMultiLine(struct linenoiseState *l) {
-    char seq[64];
-    size_t pcollen = promptTextColumnLen(l->prompt,strlen(l->prompt));
-    int colpos = columnPosForMultiLine(l->buf, l->len, l->len, l->cols, pcollen);
+    size_t pcollen = l->pwidth;
+    int colpos = layoutColumn(l,l->len);
     int colpos2; /* cursor column position. */
     int rows = (pcollen+colpos+l->cols-1)/l->cols; /* rows used by current buf. */
     int rpos = (pcollen+l->oldcolpos+l->cols)/l->cols; /* cursor relative row. */
     int rpos2; /* rpos after refresh. */
+    int cur; /* row the cursor is on once the content is written. */
     int col; /* colum position, zero-based. */
-    int old_rows = l->maxrows;
-    int fd = l->ofd, j;
-    struct abuf ab;
+    int fd = l->ofd;
+    int hint = 0;
+    size_t start = 0;
+    struct abuf *ab = &refresh_ab;
 
     /* Update maxrows if needed. */
     if (rows > (int)l->maxrows) l->maxrows = rows;
 
-    /* First step: clear all the lines used before. To do so start by
-     * going to the last row. */
-    abInit(&ab);
-    if (old_rows-rpos > 0) {
-        lndebug("go down %d", old_rows-rpos);
-        snprintf(seq,64,"\x1b[%dB", old_rows-rpos);
-        abAppend(&ab,seq,strlen(seq));
-    }
-
-    /* Now for every row clear it, go up. */
-    for (j = 0; j < old_rows-1; j++) {
-        lndebug("clear+up");
-        snprintf(seq,64,"\r\x1b[0K\x1b[1A");
-        abAppend(&ab,seq,strlen(seq));
-    }
+    /* Get column length to cursor position */
+    colpos2 = layoutColumn(l,l->pos);
+
+    abInit(ab);
+    if (frame_valid) {
+        size_t scol;
+
+        start = framePrefix(l,l->buf,l->len);
+        scol = pcollen+layoutColumn(l,start);
+        /* Don't resume right at a row boundary, the terminal may not have
+         * wrapped to the row below yet. */
+        if (start > 0 && scol % l->cols == 0) {
+            start -= prevCharLen(l->buf,l->len,start,NULL);
+            scol = pcollen+layoutColumn(l,start);
+        }
 
-    /* Clean the top line. */
-    lndebug("clear");
-    snprintf(seq,64,"\r\x1b[0K");
-    abAppend(&ab,seq,strlen(seq));
+        /* Only the cursor moved, unless it needs the newline below */
+        if (start == l->len && start == (size_t)frame.len && !hintsActive() &&
+            !frame_hint && !(l->pos && l->pos == l->len && (colpos2+pcollen) % l->cols == 0)) {
+            cur = rpos;
+            goto cursor;
+        }
 
-    /* Write the prompt and the current buffer content */
-    abAppend(&ab,l->prompt,strlen(l->prompt));
-    if (maskmode == 1) {
-        unsigned int i;
-        for (i = 0; i < l->len; i++) abAppend(&ab,"*",1);
+        /* Go to the first changed character and erase from there */
+        lndebug("resume at %d", (int)start);
+        if ((int)(scol/l->cols)+1 < rpos)
+            abAppendSeq(ab,rpos-(int)(scol/l->cols)-1,'A');
+        else if ((int)(scol/l->cols)+1 > rpos)
+            abAppendSeq(ab,(int)(scol/l->cols)+1-rpos,'B');
+        abAppendLit(ab,"\r");
+        if (scol % l->cols)
+            abAppendSeq(ab,(int)(scol % l->cols),'C');
+        abAppendLit(ab,"\x1b[0J");
+        abAppend(ab,l->buf+start,l->len-start);
     } else {
-        abAppend(&ab,l->buf,l->len);
+        /* Go up to the prompt row, clear everything used before */
+        lndebug("clear");
+        if (rpos > 1)
+            abAppendSeq(ab,rpos-1,'A');
+        abAppendLit(ab,"\r\x1b[0J");
+
+        /* Write the prompt and the current buffer content */
+        abAppend(ab,l->prompt,l->plen);
+        if (maskmode == 1) {
+            unsigned int i;
+            for (i = 0; i < l->len; i++) abAppendLit(ab,"*");
+        } else {
+            abAppend(ab,l->buf,l->len);
+        }
     }
 
     /* Show hits if any. */
-    refreshShowHints(&ab,l,pcollen);
-
-    /* Get column length to cursor position */
-    colpos2 = columnPosForMultiLine(l->buf,l->len,l->pos,l->cols,pcollen);
+    hint = refreshShowHints(ab,l,pcollen);
+    cur = rows;
 
     /* If we are at the very end of the screen with our prompt, we need to
      * emit a newline and move the prompt to the first column. */
@@ -738,67 +1319,97 @@ static void refreshMultiLine(struct linenoiseState *l) {
         (colpos2+pcollen) % l->cols == 0)
     {
         lndebug("<newline>");
-        abAppend(&ab,"\n",1);
-        snprintf(seq,64,"\r");
-        abAppend(&ab,seq,strlen(seq));
+        abAppendLit(ab,"\n\r");
         rows++;
+        cur = rows;
         if (rows > (int)l->maxrows) l->maxrows = rows;
     }
 
+cursor:
     /* Move cursor to right position. */
     rpos2 = (pcollen+colpos2+l->cols)/l->cols; /* current cursor relative row. */
     lndebug("rpos2 %d", rpos2);
 
-    /* Go up till we reach the expected positon. */
-    if (rows-rpos2 > 0) {
-        lndebug("go-up %d", rows-rpos2);
-        snprintf(seq,64,"\x1b[%dA", rows-rpos2);
-        abAppend(&ab,seq,strlen(seq));
+    /* Go up or down till we reach the expected positon. */
+    if (cur-rpos2 > 0) {
+        lndebug("go-up %d", cur-rpos2);
+        abAppendSeq(ab,cur-rpos2,'A');
+    } else if (cur-rpos2 < 0) {
+        abAppendSeq(ab,rpos2-cur,'B');
     }
 
     /* Set column. */
     col = (pcollen + colpos2) % l->cols;
     lndebug("set col %d", 1+col);
+    abAppendLit(ab,"\r");
     if (col)
-        snprintf(seq,64,"\r\x1b[%dC", col);
-    else
-        snprintf(seq,64,"\r");
-    abAppend(&ab,seq,strlen(seq));
+        abAppendSeq(ab,col,'C');
 
     lndebug("\n");
     l->oldcolpos = colpos2;
 
-    if (write(fd,ab.b,ab.len) == -1) {} /* Can't recover from write error. */
-    abFree(&ab);
+    if (termWrite(fd,ab->b,ab->len) == -1) {} /* Can't recover from write error. */
+    frameStore(l->buf,l->len,hint);
 }
 
 /* Calls the two low level functions refreshSingleLine() or
  * refreshMultiLine() according to the selected mode. */
 static void refreshLine(struct linenoiseState *l) {
+    OSH_STATS_START(start);
+
     if (mlmode)
         refreshMultiLine(l);
     else
         refreshSingleLine(l);
+    OSH_STATS_TIME(refresh,start);
+    OSH_STATS_ADD(refresh_bytes,refresh_ab.len);
+}
+
+/* Make room for 'add' more bytes after the 'len' in use, doubling the
+ * buffer as needed. Returns -1 if it can't grow. */
+static int linenoiseEditReserve(struct linenoiseState *l, size_t add) {
+    size_t cap = edit_cap;
+    char *buf;
+
+    if (l->len+add <= l->buflen) return 0;
+    while (cap-1 < l->len+add) cap *= 2;
+    if ((buf = realloc(edit_buf,cap)) == NULL) return -1;
+    edit_buf = l->buf = buf;
+    edit_cap = cap;
+    l->buflen = cap-1;
+    return 0;
+}
+
+/* Replace the line with 'len' bytes of 'text', cursor at the end. */
+static void linenoiseEditSet(struct linenoiseState *l, const char *text, size_t len) {
+    l->len = 0;
+    if (linenoiseEditReserve(l,len) == -1 && len > l->buflen) len = l->buflen;
+    memcpy(l->buf,text,len);
+    l->buf[len] = '\0';
+    l->len = l->pos = len;
+    layoutEdit(l,0);
 }
 
 /* Insert the character 'c' at cursor current position.
  *
  * On error writing to the terminal -1 is returned, otherwise 0. */
 int linenoiseEditInsert(struct linenoiseState *l, const char *cbuf, int clen) {
-    if (l->len+clen <= l->buflen) {
+    if (linenoiseEditReserve(l,clen) == 0) {
+        layoutEdit(l,l->pos);
         if (l->len == l->pos) {
             memcpy(&l->buf[l->pos],cbuf,clen);
             l->pos+=clen;
             l->len+=clen;;
             l->buf[l->len] = '\0';
-            if ((!mlmode && promptTextColumnLen(l->prompt,l->plen)+columnPos(l->buf,l->len,l->len) < l->cols && !hintsCallback)) {
+            if ((!mlmode && l->pwidth+columnPos(l->buf,l->len,l->len) < l->cols && !hintsActive())) {
                 /* Avoid a full update of the line in the
                  * trivial case. */
                 if (maskmode == 1) {
                   static const char d = '*';
-                  if (write(l->ofd,&d,1) == -1) return -1;
+                  if (termWrite(l->ofd,&d,1) == -1) return -1;
                 } else {
-                  if (write(l->ofd,cbuf,clen) == -1) return -1;
+                  if (termWrite(l->ofd,cbuf,clen) == -1) return -1;
+                  abAppend(&frame,cbuf,clen);
                 }
             } else {
                 refreshLine(l);
@@ -852,11 +1463,11 @@ void linenoiseEditMoveEnd(struct linenoiseState *l) {
 #define LINENOISE_HISTORY_NEXT 0
 #define LINENOISE_HISTORY_PREV 1
 void linenoiseEditHistoryNext(struct linenoiseState *l, int dir) {
+    historyLoadPending();
     if (history_len > 1) {
         /* Update the current history entry before to
          * overwrite it with the next one. */
-        free(history[history_len - 1 - l->history_index]);
-        history[history_len - 1 - l->history_index] = strdup(l->buf);
+        historySet(history_len - 1 - l->history_index, l->buf);
         /* Show the new entry */
         l->history_index += (dir == LINENOISE_HISTORY_PREV) ? 1 : -1;
         if (l->history_index < 0) {
@@ -866,18 +1477,152 @@ void linenoiseEditHistoryNext(struct linenoiseState *l, int dir) {
             l->history_index = history_len-1;
             return;
         }
-        strncpy(l->buf,history[history_len - 1 - l->history_index],l->buflen);
-        l->buf[l->buflen-1] = '\0';
-        l->len = l->pos = strlen(l->buf);
+        const char *line = historyAt(history_len - 1 - l->history_index);
+
+        linenoiseEditSet(l,line,strlen(line));
         refreshLine(l);
     }
 }
 
+/* Show another prompt in front of the line. The row the cursor is on is
+ * kept, so the next refresh still finds where the line starts. */
+static void linenoiseEditSetPrompt(struct linenoiseState *l, const char *prompt) {
+    size_t row = (l->pwidth+l->oldcolpos)/l->cols;
+
+    l->prompt = prompt;
+    l->plen = strlen(prompt);
+    l->pwidth = promptTextColumnLen(prompt,l->plen);
+    l->oldcolpos = row*l->cols > l->pwidth ? row*l->cols-l->pwidth : 0;
+    /* Every column moves with the prompt */
+    l->layout_len = 0;
+    frame_valid = 0;
+}
+
+/* Put history entry 'seq' in the buffer with the cursor at 'pos'. */
+static void linenoiseEditShowEntry(struct linenoiseState *l, unsigned seq, size_t pos) {
+    const char *line = historyAt(seq-history_seq_base);
+
+    linenoiseEditSet(l,line,strlen(line));
+    if (pos < l->len) l->pos = pos;
+}
+
+/* Incremental reverse search, Ctrl-R. The line shows the newest history
+ * entry containing the typed text, Ctrl-R again moves to older matches and
+ * Ctrl-G gives the original line back. Any other key accepts the match and
+ * is returned for the caller to handle, with its bytes in 'cbuf'. Returns
+ * 0 when there is nothing left to handle and -1 if reading failed. */
+static int linenoiseEditSearch(struct linenoiseState *l, char *cbuf, size_t cbuf_len, int *nread) {
+    char query[LINENOISE_SEARCH_MAX+1];
+    char prompt[LINENOISE_SEARCH_MAX+32];
+    const char *orig_prompt = l->prompt;
+    char *saved = strdup(l->buf);
+    size_t saved_pos = l->pos, qlen = 0;
+    unsigned match = HISTORY_SEQ_NONE;
+    int failed = 0, c;
+
+    if (saved == NULL) return 0;
+    historyLoadPending();
+    query[0] = '\0';
+
+    while (1) {
+        unsigned from = HISTORY_SEQ_NONE, found;
+
+        snprintf(prompt,sizeof(prompt),"(%sreverse-i-search)`%s': ",
+            failed ? "failed " : "",query);
+        linenoiseEditSetPrompt(l,prompt);
+        refreshLine(l);
+
+        if (waitInput(l) == -1 ||
+            (*nread = readKey(l->ifd,cbuf,cbuf_len,&c)) <= 0) {
+            c = -1;
+            break;
+        }
+
+        if (c == CTRL_R) {
+            /* Older match for the same text */
+            if (qlen == 0 || match == HISTORY_SEQ_NONE) continue;
+            from = match;
+        } else if (c == BACKSPACE || c == CTRL_H) {
+            if (qlen == 0) continue;
+            qlen -= prevCharLen(query,qlen,qlen,NULL);
+            query[qlen] = '\0';
+        } else if (c == CTRL_G) {
+            /* Abort, back to the line as it was */
+            linenoiseEditSet(l,saved,strlen(saved));
+            l->pos = saved_pos;
+            c = 0;
+            break;
+        } else if (c >= 32 && c != 127 && c != ESC) {
+            /* Extend the text, the current match may still do */
+            if (qlen+*nread > LINENOISE_SEARCH_MAX) continue;
+            memcpy(query+qlen,cbuf,*nread);
+            qlen += *nread;
+            query[qlen] = '\0';
+            if (match != HISTORY_SEQ_NONE) from = match+1;
+        } else {
+            break;
+        }
+
+        if (qlen == 0) {
+            failed = 0;
+            match = HISTORY_SEQ_NONE;
+            continue;
+        }
+
+        found = historySearch(query,qlen,0,from,-1);
+        failed = found == HISTORY_SEQ_NONE;
+        if (!failed) {
+            const char *line = historyAt(found-history_seq_base);
+
+            match = found;
+            linenoiseEditShowEntry(l,found,(char*)memmem(line,strlen(line),query,qlen)-line);
+        }
+    }
+
+    linenoiseEditSetPrompt(l,orig_prompt);
+    refreshLine(l);
+    free(saved);
+    return c;
+}
+
+/* Substitute the line with the previous or next history entry that starts
+ * with the text before the cursor, which stays where it is. Going past the
+ * newest match gives back the line that was typed. */
+void linenoiseEditHistoryPrefix(struct linenoiseState *l, int dir) {
+    unsigned cur;
+    unsigned seq;
+
+    historyLoadPending();
+    cur = history_seq_base + history_len - 1;
+    if (history_len < 2) return;
+
+    /* Keep the typed line in the current entry to come back to */
+    if (l->search_seq == HISTORY_SEQ_NONE) {
+        historySet(history_len-1,l->buf);
+        l->search_seq = cur;
+    }
+
+    seq = historySearch(l->buf,l->pos,1,l->search_seq,
+        dir == LINENOISE_HISTORY_PREV ? -1 : 1);
+    if (seq == HISTORY_SEQ_NONE) {
+        if (dir == LINENOISE_HISTORY_PREV || l->search_seq == cur) {
+            linenoiseBeep();
+            return;
+        }
+        seq = cur;
+    }
+
+    l->search_seq = seq;
+    linenoiseEditShowEntry(l,seq,l->pos);
+    refreshLine(l);
+}
+
 /* Delete the character at the right of the cursor without altering the cursor
  * position. Basically this is what happens with the "Delete" keyboard key. */
 void linenoiseEditDelete(struct linenoiseState *l) {
     if (l->len > 0 && l->pos < l->len) {
         int chlen = nextCharLen(l->buf,l->len,l->pos,NULL);
+        layoutEdit(l,l->pos);
         memmove(l->buf+l->pos,l->buf+l->pos+chlen,l->len-l->pos-chlen);
         l->len-=chlen;
         l->buf[l->len] = '\0';
@@ -889,6 +1634,7 @@ void linenoiseEditDelete(struct linenoiseState *l) {
 void linenoiseEditBackspace(struct linenoiseState *l) {
     if (l->pos > 0 && l->len > 0) {
         int chlen = prevCharLen(l->buf,l->len,l->pos,NULL);
+        layoutEdit(l,l->pos-chlen);
         memmove(l->buf+l->pos-chlen,l->buf+l->pos,l->len-l->pos);
         l->pos-=chlen;
         l->len-=chlen;
@@ -908,11 +1654,145 @@ void linenoiseEditDeletePrevWord(struct linenoiseState *l) {
     while (l->pos > 0 && l->buf[l->pos-1] != ' ')
         l->pos--;
     diff = old_pos - l->pos;
+    layoutEdit(l,l->pos);
     memmove(l->buf+l->pos,l->buf+old_pos,l->len-old_pos+1);
     l->len -= diff;
     refreshLine(l);
 }
 
+/* Put 'len' bytes of 'text' at the cursor with one move of the tail and
+ * one refresh, as much as fits in the buffer. */
+static void linenoiseEditInsertText(struct linenoiseState *l, const char *text, size_t len) {
+    size_t room, n = 0;
+
+    linenoiseEditReserve(l,len);
+    room = l->buflen - l->len;
+    if (len > room) {
+        while (n < len) {
+            size_t clen = nextCharLen(text,len,n,NULL);
+            if (n+clen > room) break;
+            n += clen;
+        }
+        len = n;
+    }
+    if (len == 0) return;
+
+    layoutEdit(l,l->pos);
+    memmove(l->buf+l->pos+len,l->buf+l->pos,l->len-l->pos);
+    memcpy(l->buf+l->pos,text,len);
+    l->pos += len;
+    l->len += len;
+    l->buf[l->len] = '\0';
+    refreshLine(l);
+}
+
+/* Line break in the 'len' bytes at 'text', or NULL. */
+static const char *pasteBreak(const char *text, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        if (text[i] == '\r' || text[i] == '\n') return text+i;
+    return NULL;
+}
+
+/* Bytes to skip for the line break at 'p', a \r\n pair counts as one. */
+static size_t pasteBreakLen(const char *p, const char *end) {
+    return (p[0] == '\r' && p+1 < end && p[1] == '\n') ? 2 : 1;
+}
+
+#define PASTE_END "\x1b[201~"
+#define PASTE_END_LEN 6
+#define PASTE_READ 4096
+
+/* Bracketed paste, called once ESC[200~ was read. The block up to ESC[201~
+ * is taken in large reads and inserted at once. If it breaks lines, the
+ * first line is completed and the others are queued for the next calls
+ * of linenoise(), returns 1 so the caller enters the line. */
+static int linenoiseEditPaste(struct linenoiseState *l) {
+    struct abuf p = { NULL, 0, 0 };
+    char chunk[PASTE_READ];
+    const char *end = NULL, *nl;
+    size_t len, rest;
+
+    /* Whatever was read ahead comes first */
+    abAppend(&p,input_ahead+input_ahead_off,input_ahead_len-input_ahead_off);
+    input_ahead_off = input_ahead_len = 0;
+
+    while ((end = p.len ? memmem(p.b,p.len,PASTE_END,PASTE_END_LEN) : NULL) == NULL) {
+        ssize_t nread = read(l->ifd,chunk,sizeof(chunk));
+
+        if (nread == -1 && errno == EINTR) continue;
+        if (nread <= 0) break;
+        abAppend(&p,chunk,nread);
+    }
+
+    len = end ? (size_t)(end-p.b) : (size_t)p.len;
+
+    /* Keys typed after the paste */
+    if (end && (rest = p.len-len-PASTE_END_LEN) > 0) {
+        char *ahead = realloc(input_ahead,rest);
+
+        if (ahead != NULL) {
+            memcpy(ahead,end+PASTE_END_LEN,rest);
+            input_ahead = ahead;
+            input_ahead_len = rest;
+        }
+    }
+
+    if ((nl = pasteBreak(p.b,len)) == NULL) {
+        linenoiseEditInsertText(l,p.b,len);
+        abFree(&p);
+        return 0;
+    }
+
+    /* Lines after the first one, ahead of any still queued */
+    rest = p.b+len - (nl+pasteBreakLen(nl,p.b+len));
+    if (rest > 0) {
+        size_t queued = paste_queue_len-paste_queue_off;
+        char *queue = malloc(rest+queued);
+
+        if (queue != NULL) {
+            memcpy(queue,p.b+len-rest,rest);
+            if (queued) memcpy(queue+rest,paste_queue+paste_queue_off,queued);
+            free(paste_queue);
+            paste_queue = queue;
+            paste_queue_len = rest+queued;
+            paste_queue_off = 0;
+        }
+    }
+
+    linenoiseEditInsertText(l,p.b,nl-p.b);
+    abFree(&p);
+    return 1;
+}
+
+/* Load the next queued paste line into the empty buffer. Returns 1 if it
+ * is a whole line to be entered, 0 if it is the unfinished last one left
+ * to edit, -1 when nothing is queued. */
+static int linenoiseEditPasteNext(struct linenoiseState *l) {
+    const char *text = paste_queue+paste_queue_off;
+    const char *end = paste_queue+paste_queue_len;
+    const char *nl;
+    size_t len;
+    int whole;
+
+    if (paste_queue_off >= paste_queue_len) return -1;
+
+    nl = pasteBreak(text,end-text);
+    whole = nl != NULL;
+    len = whole ? (size_t)(nl-text) : (size_t)(end-text);
+    paste_queue_off += whole ? len+pasteBreakLen(nl,end) : len;
+
+    linenoiseEditInsertText(l,text,len);
+
+    if (paste_queue_off >= paste_queue_len) {
+        free(paste_queue);
+        paste_queue = NULL;
+        paste_queue_len = paste_queue_off = 0;
+    }
+    return whole;
+}
+
 /* This function is the core of the line editing capability of linenoise.
  * It expects 'fd' to be already in "raw mode" so that every key pressed
  * will be returned ASAP to read().
@@ -921,41 +1801,69 @@ void linenoiseEditDeletePrevWord(struct linenoiseState *l) {
  * when ctrl+d is typed.
  *
  * The function returns the length of the current buffer. */
-static int linenoiseEdit(int stdin_fd, int stdout_fd, char *buf, size_t buflen, const char *prompt)
+static int linenoiseEdit(int stdin_fd, int stdout_fd, const char *prompt)
 {
     struct linenoiseState l;
+    int paste_enter;
+
+    if (edit_buf == NULL) {
+        if ((edit_buf = malloc(LINENOISE_LINE_MIN)) == NULL) return -1;
+        edit_cap = LINENOISE_LINE_MIN;
+    }
 
     /* Populate the linenoise state that we pass to functions implementing
      * specific editing functionalities. */
     l.ifd = stdin_fd;
     l.ofd = stdout_fd;
-    l.buf = buf;
-    l.buflen = buflen;
+    l.buf = edit_buf;
+    l.buflen = edit_cap-1; /* Make sure there is always space for the nulterm */
     l.prompt = prompt;
     l.plen = strlen(prompt);
     l.oldcolpos = l.pos = 0;
     l.len = 0;
-    l.cols = getColumns(stdin_fd, stdout_fd);
+    l.cols = replay_cols ? (size_t)replay_cols : (size_t)getColumns(stdin_fd, stdout_fd);
     l.maxrows = 0;
     l.history_index = 0;
+    l.search_seq = HISTORY_SEQ_NONE;
+    l.pwidth = promptTextColumnLen(prompt,l.plen);
+    l.layout_len = 0;
+    l.layout_cols = l.cols;
 
     /* Buffer starts empty. */
     l.buf[0] = '\0';
-    l.buflen--; /* Make sure there is always space for the nulterm */
 
     /* The latest history entry is always our current buffer, that
-     * initially is just an empty string. */
-    linenoiseHistoryAdd("");
-
-    if (write(l.ofd,prompt,l.plen) == -1) return -1;
+     * initially is just an empty string. A deferred history file stays
+     * unread, the prompt shows first. */
+    historyAdd("");
+
+    if (termWrite(l.ofd,prompt,l.plen) == -1) return -1;
+    /* The screen now shows the prompt and an empty line */
+    frameStore("",0,0);
+    hintsReset();
+    /* A line queued by a paste is entered right away */
+    paste_enter = linenoiseEditPasteNext(&l) == 1;
     while(1) {
         int c;
         char cbuf[32]; // large enough for any encoding?
-        int nread;
-        char seq[3];
+        int nread = 0; /* A queued paste line skips readKey(). */
+        char seq[5];
+        int keep_search = 0; /* Key continues a prefix search. */
+
+        if (paste_enter) {
+            paste_enter = 0;
+            c = ENTER;
+            replayKeyStart(c);
+            goto dispatch;
+        }
 
-        nread = readCode(l.ifd,cbuf,sizeof(cbuf),&c);
-        if (nread <= 0) return l.len;
+        if (waitInput(&l) == -1) return l.len;
+        nread = readKey(l.ifd,cbuf,sizeof(cbuf),&c);
+        if (nread <= 0) {
+            replay_eof = 1;
+            return l.len;
+        }
+        replayKeyStart(c);
 
         /* Only autocomplete when the callback is set. It returns < 0 when
          * there was an error reading from fd. Otherwise it will return the
@@ -968,18 +1876,17 @@ static int linenoiseEdit(int stdin_fd, int stdout_fd, char *buf, size_t buflen,
             if (c == 0) continue;
         }
 
+dispatch:
         switch(c) {
         case ENTER:    /* enter */
-            history_len--;
-            free(history[history_len]);
+            historyDropLast();
             if (mlmode) linenoiseEditMoveEnd(&l);
-            if (hintsCallback) {
+            if (hintsActive()) {
                 /* Force a refresh without hints to leave the previous
                  * line as the user typed it after a newline. */
-                linenoiseHintsCallback *hc = hintsCallback;
-                hintsCallback = NULL;
+                hint_off = 1;
                 refreshLine(&l);
-                hintsCallback = hc;
+                hint_off = 0;
             }
             return (int)l.len;
         case CTRL_C:     /* ctrl-c */
@@ -994,16 +1901,16 @@ static int linenoiseEdit(int stdin_fd, int stdout_fd, char *buf, size_t buflen,
             if (l.len > 0) {
                 linenoiseEditDelete(&l);
             } else {
-                history_len--;
-                free(history[history_len]);
+                historyDropLast();
                 return -1;
             }
             break;
         case CTRL_T:    /* ctrl-t, swaps current character with previous. */
             if (l.pos > 0 && l.pos < l.len) {
-                int aux = buf[l.pos-1];
-                buf[l.pos-1] = buf[l.pos];
-                buf[l.pos] = aux;
+                int aux = l.buf[l.pos-1];
+                layoutEdit(&l,l.pos-1);
+                l.buf[l.pos-1] = l.buf[l.pos];
+                l.buf[l.pos] = aux;
                 if (l.pos != l.len-1) l.pos++;
                 refreshLine(&l);
             }
@@ -1020,24 +1927,44 @@ static int linenoiseEdit(int stdin_fd, int stdout_fd, char *buf, size_t buflen,
         case CTRL_N:    /* ctrl-n */
             linenoiseEditHistoryNext(&l, LINENOISE_HISTORY_NEXT);
             break;
+        case CTRL_R:    /* ctrl-r, incremental reverse search */
+            c = linenoiseEditSearch(&l,cbuf,sizeof(cbuf),&nread);
+            if (c < 0) return l.len;
+            /* The key that ended the search */
+            if (c > 0) goto dispatch;
+            break;
         case ESC:    /* escape sequence */
             /* Read the next two bytes representing the escape sequence.
              * Use two calls to handle slow terminals returning the two
              * chars at different times. */
-            if (read(l.ifd,seq,1) == -1) break;
-            if (read(l.ifd,seq+1,1) == -1) break;
+            if (inputRead(l.ifd,seq,1) == -1) break;
+            if (inputRead(l.ifd,seq+1,1) == -1) break;
 
             /* ESC [ sequences. */
             if (seq[0] == '[') {
                 if (seq[1] >= '0' && seq[1] <= '9') {
                     /* Extended escape, read additional byte. */
-                    if (read(l.ifd,seq+2,1) == -1) break;
+                    if (inputRead(l.ifd,seq+2,1) == -1) break;
                     if (seq[2] == '~') {
                         switch(seq[1]) {
                         case '3': /* Delete key. */
                             linenoiseEditDelete(&l);
                             break;
+                        case '5': /* Page up, prefix search backwards. */
+                            linenoiseEditHistoryPrefix(&l, LINENOISE_HISTORY_PREV);
+                            keep_search = 1;
+                            break;
+                        case '6': /* Page down, prefix search forwards. */
+                            linenoiseEditHistoryPrefix(&l, LINENOISE_HISTORY_NEXT);
+                            keep_search = 1;
+                            break;
                         }
+                    } else if (seq[1] == '2' && seq[2] == '0') {
+                        /* ESC [ 2 0 0 ~ starts a bracketed paste */
+                        if (inputRead(l.ifd,seq+3,1) == -1) break;
+                        if (inputRead(l.ifd,seq+4,1) == -1) break;
+                        if (seq[3] == '0' && seq[4] == '~')
+                            paste_enter = linenoiseEditPaste(&l);
                     }
                 } else {
                     switch(seq[1]) {
@@ -1079,13 +2006,15 @@ static int linenoiseEdit(int stdin_fd, int stdout_fd, char *buf, size_t buflen,
             if (linenoiseEditInsert(&l,cbuf,nread)) return -1;
             break;
         case CTRL_U: /* Ctrl+u, delete the whole line. */
-            buf[0] = '\0';
+            l.buf[0] = '\0';
             l.pos = l.len = 0;
+            layoutEdit(&l,0);
             refreshLine(&l);
             break;
         case CTRL_K: /* Ctrl+k, delete from current to end of line. */
-            buf[l.pos] = '\0';
+            l.buf[l.pos] = '\0';
             l.len = l.pos;
+            layoutEdit(&l,l.pos);
             refreshLine(&l);
             break;
         case CTRL_A: /* Ctrl+a, go to the start of the line */
@@ -1102,10 +2031,51 @@ static int linenoiseEdit(int stdin_fd, int stdout_fd, char *buf, size_t buflen,
             linenoiseEditDeletePrevWord(&l);
             break;
         }
+        /* Any other key starts the next prefix search afresh */
+        if (!keep_search) l.search_seq = HISTORY_SEQ_NONE;
+        replayKeyDone();
     }
     return l.len;
 }
 
+/* Edit lines from the key trace on 'ifd' (a file, a pipe or a pty)
+ * without a terminal, rendering 'cols' columns wide to 'ofd'. Each line
+ * entered goes to the history, as the shell would add it. 'cb' gets the
+ * handling time, bytes written and write() calls of every key. Returns
+ * the number of lines edited. */
+int linenoiseReplay(int ifd, int ofd, const char *prompt, int cols, int flags,
+        linenoiseReplayCallback *cb, void *arg) {
+    int lines = 0;
+
+    replay_cb = cb;
+    replay_arg = arg;
+    replay_ofd = ofd;
+    replay_cols = cols > 0 ? cols : 80;
+    replay_flags = flags;
+    replay_eof = 0;
+
+    while (!replay_eof) {
+        int len;
+
+        errno = 0;
+        len = linenoiseEdit(ifd,ofd,prompt);
+        /* Lines end on Enter, Ctrl-C or the end of the trace */
+        replayKeyDone();
+        if (len == -1 && errno != EAGAIN) break;
+        if (len > 0) linenoiseHistoryAdd(edit_buf);
+        editRelease();
+        if (termWrite(ofd,"\r\n",2) == -1) {}
+        lines++;
+    }
+
+    replay_cb = NULL;
+    replay_arg = NULL;
+    replay_ofd = -1;
+    replay_cols = 0;
+    replay_flags = 0;
+    return lines;
+}
+
 /* This special mode is used by linenoise in order to print scan codes
  * on screen for debugging / development purposes. It is implemented
  * by the linenoise_example program using the --keycodes option. */
@@ -1136,16 +2106,34 @@ void linenoisePrintKeyCodes(void) {
 
 /* This function calls the line editing function linenoiseEdit() using
  * the STDIN file descriptor set in raw mode. */
-static int linenoiseRaw(char *buf, size_t buflen, const char *prompt) {
-    int count;
-
-    if (buflen == 0) {
-        errno = EINVAL;
-        return -1;
+/* Release what a very long line grew the line sized buffers to, they are
+ * kept from line to line otherwise. */
+static void editRelease(void) {
+    if (edit_cap > LINENOISE_LINE_KEEP) {
+        free(edit_buf);
+        edit_buf = NULL;
+        edit_cap = 0;
+    }
+    if (refresh_ab.cap > LINENOISE_LINE_KEEP) abFree(&refresh_ab);
+    if (frame.cap > LINENOISE_LINE_KEEP) {
+        abFree(&frame);
+        frame_valid = 0;
+    }
+    if (layout_cap*sizeof(*layout_marks) > LINENOISE_LINE_KEEP) {
+        free(layout_marks);
+        layout_marks = NULL;
+        layout_cap = 0;
     }
+}
+
+static int linenoiseRaw(const char *prompt) {
+    int count;
 
     if (enableRawMode(STDIN_FILENO) == -1) return -1;
-    count = linenoiseEdit(STDIN_FILENO, STDOUT_FILENO, buf, buflen, prompt);
+    /* Pastes arrive as one block, only while editing */
+    if (termWrite(STDOUT_FILENO,"\x1b[?2004h",8) == -1) {}
+    count = linenoiseEdit(STDIN_FILENO, STDOUT_FILENO, prompt);
+    if (termWrite(STDOUT_FILENO,"\x1b[?2004l",8) == -1) {}
     disableRawMode(STDIN_FILENO);
     printf("\n");
     return count;
@@ -1155,7 +2143,7 @@ static int linenoiseRaw(char *buf, size_t buflen, const char *prompt) {
  * input file descriptor not attached to a TTY. So for example when the
  * program using linenoise is called in pipe or with a file redirected
  * to its standard input. In this case, we want to be able to return the
- * line regardless of its length (by default we are limited to 4k). */
+ * line regardless of its length. */
 static char *linenoiseNoTTY(void) {
     char *line = NULL;
     size_t len = 0, maxlen = 0;
@@ -1193,7 +2181,6 @@ static char *linenoiseNoTTY(void) {
  * editing function or uses dummy fgets() so that you will be able to type
  * something even in the most desperate of the conditions. */
 char *linenoise(const char *prompt) {
-    char buf[LINENOISE_MAX_LINE];
     int count;
 
     if (!isatty(STDIN_FILENO)) {
@@ -1201,21 +2188,22 @@ char *linenoise(const char *prompt) {
          * limit to the line size, so we call a function to handle that. */
         return linenoiseNoTTY();
     } else if (isUnsupportedTerm()) {
+        char *line;
         size_t len;
 
         printf("%s",prompt);
         fflush(stdout);
-        if (fgets(buf,LINENOISE_MAX_LINE,stdin) == NULL) return NULL;
-        len = strlen(buf);
-        while(len && (buf[len-1] == '\n' || buf[len-1] == '\r')) {
-            len--;
-            buf[len] = '\0';
-        }
-        return strdup(buf);
+        if ((line = linenoiseNoTTY()) == NULL) return NULL;
+        len = strlen(line);
+        while(len && line[len-1] == '\r') line[--len] = '\0';
+        return line;
     } else {
-        count = linenoiseRaw(buf,LINENOISE_MAX_LINE,prompt);
-        if (count == -1) return NULL;
-        return strdup(buf);
+        char *line;
+
+        count = linenoiseRaw(prompt);
+        line = count == -1 ? NULL : strdup(edit_buf);
+        editRelease();
+        return line;
     }
 }
 
@@ -1232,53 +2220,391 @@ void linenoiseFree(void *ptr) {
 /* Free the history, but does not reset it. Only used when we have to
  * exit() to avoid memory leaks are reported by valgrind & co. */
 static void freeHistory(void) {
-    if (history) {
-        int j;
-
-        for (j = 0; j < history_len; j++)
-            free(history[j]);
-        free(history);
-    }
+    size_t j;
+
+    for (j = 0; j < history_tri_size; j++)
+        free(history_tri[j].ids);
+    free(history_tri);
+    free(history_touched);
+    history_tri = NULL;
+    history_touched = NULL;
+    history_tri_size = history_tri_used = 0;
+    history_touched_len = 0;
+    history_indexed = history_seq_base;
+    free(history);
+    free(history_pool);
+    free(history_deferred);
+    if (history_map) munmap(history_map,history_map_len);
+    history = NULL;
+    history_pool = NULL;
+    history_deferred = NULL;
+    history_map = NULL;
+    history_map_len = 0;
+    history_cap = history_head = history_len = 0;
+    history_pool_len = history_pool_cap = 0;
 }
 
 /* At exit we'll try to fix the terminal to the initial conditions. */
 static void linenoiseAtExit(void) {
     disableRawMode(STDIN_FILENO);
     freeHistory();
+    abFree(&refresh_ab);
+    abFree(&frame);
+    abFree(&hint_key);
+    abFree(&hint_text);
+    free(layout_marks);
+    layout_marks = NULL;
+    layout_cap = 0;
+    free(input_ahead);
+    free(paste_queue);
+    free(edit_buf);
+    edit_buf = NULL;
+    edit_cap = 0;
 }
 
-/* This is the API call to add a new entry in the linenoise history.
- * It uses a fixed array of char pointers that are shifted (memmoved)
- * when the history max length is reached in order to remove the older
- * entry and make room for the new one, so it is not exactly suitable for huge
- * histories, but will work well for a few hundred of entries.
- *
- * Using a circular buffer is smarter, but a bit more complex to handle. */
-int linenoiseHistoryAdd(const char *line) {
-    char *linecopy;
+/* Ring slot of the history entry at 'index', 0 being the oldest one. */
+static size_t *historySlot(int index) {
+    return &history[(history_head + index) % history_cap];
+}
 
-    if (history_max_len == 0) return 0;
+static char *historyAt(int index) {
+    size_t off = *historySlot(index);
+    char *line, *end;
+
+    if (!(off & HISTORY_MAPPED)) return history_pool + off;
+    line = history_map + (off & ~HISTORY_MAPPED);
+    end = line + strcspn(line,"\n");
+    *end = '\0';
+    return line;
+}
+
+/* Move the ring into 'cap' slots, oldest entry first. 'cap' must be able
+ * to hold every entry. */
+static int historyResize(int cap) {
+    size_t *new = malloc(sizeof(*new)*cap);
+    int j;
+
+    if (new == NULL) return -1;
+    for (j = 0; j < history_len; j++)
+        new[j] = *historySlot(j);
+    free(history);
+    history = new;
+    history_cap = cap;
+    history_head = 0;
+    return 0;
+}
+
+/* Copy 'line' into the pool and return its offset, or (size_t)-1. A full
+ * pool is replaced by one twice the size of the live lines, which drops
+ * the bytes of evicted and replaced entries. */
+static size_t historyStore(const char *line) {
+    size_t n = strlen(line)+1, off;
+
+    if (history_pool_len + n > history_pool_cap) {
+        size_t live = n, cap, in = (size_t)-1;
+        char *pool;
+        int j;
+
+        /* 'line' may be one of our own entries */
+        if (line >= history_pool && line < history_pool+history_pool_len)
+            in = line-history_pool;
+
+        for (j = 0; j < history_len; j++)
+            if (!(*historySlot(j) & HISTORY_MAPPED))
+                live += strlen(historyAt(j))+1;
+        cap = live*2 > LINENOISE_HISTORY_POOL_MIN ? live*2 : LINENOISE_HISTORY_POOL_MIN;
+        if ((pool = malloc(cap)) == NULL) return (size_t)-1;
+
+        history_pool_len = 0;
+        for (j = 0; j < history_len; j++) {
+            size_t *slot = historySlot(j);
+            size_t len;
+
+            if (*slot & HISTORY_MAPPED) continue;
+            len = strlen(history_pool+*slot)+1;
+
+            if (in != (size_t)-1 && in >= *slot && in < *slot+len)
+                in = history_pool_len+(in-*slot);
+            memcpy(pool+history_pool_len,history_pool+*slot,len);
+            *slot = history_pool_len;
+            history_pool_len += len;
+        }
+        free(history_pool);
+        history_pool = pool;
+        history_pool_cap = cap;
+        if (in != (size_t)-1) line = pool+in;
+    }
+
+    off = history_pool_len;
+    memcpy(history_pool+off,line,n);
+    history_pool_len += n;
+    return off;
+}
+
+/* Replace the text of the entry at 'index'. */
+static int historySet(int index, const char *line) {
+    unsigned seq = history_seq_base + index;
+    size_t off = historyStore(line);
+    unsigned *t;
+    int j;
 
-    /* Initialization on first call. */
-    if (history == NULL) {
-        history = malloc(sizeof(char*)*history_max_len);
-        if (history == NULL) return 0;
-        memset(history,0,(sizeof(char*)*history_max_len));
+    if (off == (size_t)-1) return 0;
+    *historySlot(index) = off;
+
+    /* The index still has the old text of this one. */
+    if (seq < history_indexed) {
+        for (j = 0; j < history_touched_len; j++)
+            if (history_touched[j] == seq) return 1;
+        t = realloc(history_touched,sizeof(*t)*(history_touched_len+1));
+        if (t == NULL) return 1;
+        history_touched = t;
+        history_touched[history_touched_len++] = seq;
     }
+    return 1;
+}
 
-    /* Don't add duplicated lines. */
-    if (history_len && !strcmp(history[history_len-1], line)) return 0;
+/* Forget the newest entry, giving its bytes back when they are the last
+ * ones in the pool. */
+static void historyDropLast(void) {
+    char *last;
+
+    if (history_len == 0) return;
+    last = historyAt(history_len-1);
+    if (!(*historySlot(history_len-1) & HISTORY_MAPPED) &&
+        last+strlen(last)+1 == history_pool+history_pool_len)
+        history_pool_len = last-history_pool;
+    history_len--;
+    /* The number is handed out again, make sure it gets indexed again. */
+    if (history_indexed > history_seq_base + history_len)
+        history_indexed = history_seq_base + history_len;
+}
+
+static unsigned historyTrigram(const char *s) {
+    return ((unsigned)(unsigned char)s[0] << 16) |
+        ((unsigned)(unsigned char)s[1] << 8) | (unsigned char)s[2];
+}
+
+/* Posting list of 'tri', or the free slot it would go into. */
+static struct historyPosting *historyPostingSlot(unsigned tri) {
+    size_t mask = history_tri_size-1;
+    size_t j = (tri * 2654435761u) & mask;
+
+    while (history_tri[j].tri && history_tri[j].tri != tri)
+        j = (j+1) & mask;
+    return &history_tri[j];
+}
+
+static struct historyPosting *historyPostingFind(unsigned tri) {
+    struct historyPosting *p;
+
+    if (history_tri_size == 0) return NULL;
+    p = historyPostingSlot(tri);
+    return p->tri ? p : NULL;
+}
+
+/* Keep the posting table at most half full. */
+static int historyPostingGrow(void) {
+    struct historyPosting *old = history_tri;
+    size_t oldsize = history_tri_size, j;
+    size_t size = oldsize ? oldsize*2 : 4096;
+
+    if ((history_tri = calloc(size,sizeof(*history_tri))) == NULL) {
+        history_tri = old;
+        return -1;
+    }
+    history_tri_size = size;
+    for (j = 0; j < oldsize; j++)
+        if (old[j].tri) *historyPostingSlot(old[j].tri) = old[j];
+    free(old);
+    return 0;
+}
+
+static void historyIndexLine(const char *line, size_t len, unsigned seq) {
+    size_t j;
+
+    for (j = 0; j+3 <= len; j++) {
+        unsigned tri = historyTrigram(line+j);
+        struct historyPosting *p;
+
+        if ((history_tri_used+1)*2 > history_tri_size && historyPostingGrow() == -1)
+            return;
+        p = historyPostingSlot(tri);
+        if (!p->tri) {
+            p->tri = tri;
+            history_tri_used++;
+        }
+        /* Repeated trigram in the same line */
+        if (p->len > p->start && p->ids[p->len-1] == seq) continue;
+
+        /* Drop evicted ids before growing the list */
+        while (p->start < p->len && p->ids[p->start] < history_seq_base) p->start++;
+        if (p->start > 32 && p->start*2 > p->len) {
+            memmove(p->ids,p->ids+p->start,sizeof(*p->ids)*(p->len-p->start));
+            p->len -= p->start;
+            p->start = 0;
+        }
+        if (p->len == p->cap) {
+            unsigned cap = p->cap ? p->cap*2 : 4;
+            unsigned *ids = realloc(p->ids,sizeof(*ids)*cap);
+            if (ids == NULL) continue;
+            p->ids = ids;
+            p->cap = cap;
+        }
+        p->ids[p->len++] = seq;
+    }
+}
+
+/* Index up to 'max' entries added since the last time, never the current
+ * line. Mapped entries are read in place, their pages stay shared. */
+static void historyIndexSync(unsigned max) {
+    unsigned end = history_seq_base + history_len - 1;
+
+    if (history_indexed < history_seq_base) history_indexed = history_seq_base;
+    for (; history_indexed < end && max; history_indexed++, max--) {
+        size_t off = *historySlot(history_indexed-history_seq_base);
+        const char *line;
+
+        if (off & HISTORY_MAPPED) {
+            line = history_map + (off & ~HISTORY_MAPPED);
+            historyIndexLine(line,strcspn(line,"\n"),history_indexed);
+        } else {
+            line = history_pool + off;
+            historyIndexLine(line,strlen(line),history_indexed);
+        }
+    }
+}
+
+/* Tell whether entries are waiting to be indexed, and with 'work' index
+ * a batch of them that takes around a millisecond. */
+static int historyIndexIdle(int work) {
+    if (history_len < 2 || history_indexed >= history_seq_base + history_len - 1)
+        return 0;
+    if (work) historyIndexSync(LINENOISE_INDEX_BATCH);
+    return 1;
+}
+
+static int historyMatches(unsigned seq, const char *q, size_t qlen, int prefix) {
+    const char *line = historyAt(seq-history_seq_base);
+
+    if (prefix) return !strncmp(line,q,qlen);
+    return memmem(line,strlen(line),q,qlen) != NULL;
+}
+
+/* Newest entry older than 'from' (dir < 0) or oldest entry newer than
+ * 'from' (dir > 0) that contains the 'qlen' bytes at 'q', or starts with
+ * them when 'prefix' is set. Returns its sequence number or
+ * HISTORY_SEQ_NONE, the current line is never a match. */
+static unsigned historySearch(const char *q, size_t qlen, int prefix, unsigned from, int dir) {
+    unsigned cur = history_seq_base + history_len - 1;
+    unsigned best = HISTORY_SEQ_NONE, seq;
+    struct historyPosting *p = NULL;
+    size_t j;
+    int t;
+
+    if (history_len < 2) return HISTORY_SEQ_NONE;
+    if (from > cur) from = cur;
+    if (from < history_seq_base) from = history_seq_base;
+
+    /* Too short for a trigram, look at the entries one by one */
+    if (qlen < 3) {
+        if (dir < 0) {
+            for (seq = from; seq-- > history_seq_base; )
+                if (historyMatches(seq,q,qlen,prefix)) return seq;
+        } else {
+            for (seq = from+1; seq < cur; seq++)
+                if (historyMatches(seq,q,qlen,prefix)) return seq;
+        }
+        return HISTORY_SEQ_NONE;
+    }
+
+    historyIndexSync(HISTORY_SEQ_NONE);
+
+    /* Candidates come from the shortest list of the query's trigrams */
+    for (j = 0; j+3 <= qlen; j++) {
+        struct historyPosting *pj = historyPostingFind(historyTrigram(q+j));
+
+        if (pj) while (pj->start < pj->len && pj->ids[pj->start] < history_seq_base) pj->start++;
+        if (pj == NULL || pj->start == pj->len) {
+            p = NULL;
+            break;
+        }
+        if (p == NULL || pj->len-pj->start < p->len-p->start) p = pj;
+    }
+
+    if (p) {
+        /* First id above 'from' */
+        size_t lo = p->start, hi = p->len;
+
+        while (lo < hi) {
+            size_t mid = lo+(hi-lo)/2;
+            if (p->ids[mid] <= from) lo = mid+1;
+            else hi = mid;
+        }
+        if (dir < 0) {
+            if (lo > p->start && p->ids[lo-1] == from) lo--;
+            while (lo-- > p->start)
+                if (historyMatches(p->ids[lo],q,qlen,prefix)) {
+                    best = p->ids[lo];
+                    break;
+                }
+        } else {
+            for (; lo < p->len && p->ids[lo] < cur; lo++)
+                if (historyMatches(p->ids[lo],q,qlen,prefix)) {
+                    best = p->ids[lo];
+                    break;
+                }
+        }
+    }
+
+    /* Entries edited in place may match with their new text */
+    for (t = 0; t < history_touched_len; t++) {
+        seq = history_touched[t];
+        if (seq < history_seq_base || seq >= cur) continue;
+        if (dir < 0 ? seq >= from || (best != HISTORY_SEQ_NONE && seq < best)
+                    : seq <= from || seq > best) continue;
+        if (historyMatches(seq,q,qlen,prefix)) best = seq;
+    }
+    return best;
+}
 
-    /* Add an heap allocated copy of the line in the history.
-     * If we reached the max length, remove the older line. */
-    linecopy = strdup(line);
-    if (!linecopy) return 0;
+/* Make room for one more entry at the end of the ring. If we reached the
+ * max length the oldest line is dropped, otherwise the ring grows as
+ * entries come in, up to the max length. */
+static int historyMakeRoom(void) {
     if (history_len == history_max_len) {
-        free(history[0]);
-        memmove(history,history+1,sizeof(char*)*(history_max_len-1));
+        history_head = (history_head+1) % history_cap;
         history_len--;
+        history_seq_base++;
+    } else if (history_len == history_cap) {
+        int cap = history_cap ? history_cap*2 : 64;
+
+        if (cap > history_max_len) cap = history_max_len;
+        if (historyResize(cap) == -1) return -1;
     }
-    history[history_len] = linecopy;
+    return 0;
+}
+
+/* This is the API call to add a new entry in the linenoise history.
+ * Lines are copied into the history pool and their offsets kept in a
+ * ring, so once the max length is reached the oldest entry is evicted in
+ * O(1) by advancing the head of the ring. */
+int linenoiseHistoryAdd(const char *line) {
+    historyLoadPending();
+    return historyAdd(line);
+}
+
+/* linenoiseHistoryAdd() with any deferred file left unread. */
+static int historyAdd(const char *line) {
+    size_t off;
+
+    if (history_max_len == 0) return 0;
+
+    /* Don't add duplicated lines. */
+    if (history_len && !strcmp(historyAt(history_len-1), line)) return 0;
+
+    if (historyMakeRoom() == -1) return 0;
+    if ((off = historyStore(line)) == (size_t)-1) return 0;
+    *historySlot(history_len) = off;
     history_len++;
     return 1;
 }
@@ -1288,33 +2614,32 @@ int linenoiseHistoryAdd(const char *line) {
  * just the latest 'len' elements if the new history length value is smaller
  * than the amount of items already inside the history. */
 int linenoiseHistorySetMaxLen(int len) {
-    char **new;
-
     if (len < 1) return 0;
-    if (history) {
-        int tocopy = history_len;
-
-        new = malloc(sizeof(char*)*len);
-        if (new == NULL) return 0;
-
-        /* If we can't copy everything, free the elements we'll not use. */
-        if (len < tocopy) {
-            int j;
-
-            for (j = 0; j < tocopy-len; j++) free(history[j]);
-            tocopy = len;
-        }
-        memset(new,0,sizeof(char*)*len);
-        memcpy(new,history+(history_len-tocopy), sizeof(char*)*tocopy);
-        free(history);
-        history = new;
+    if (history_len > len) {
+        history_head = (history_head + history_len-len) % history_cap;
+        history_seq_base += history_len-len;
+        history_len = len;
     }
+    if (history_cap > len && historyResize(len) == -1) return 0;
     history_max_len = len;
-    if (history_len > history_max_len)
-        history_len = history_max_len;
     return 1;
 }
 
+/* Return the number of entries in the history. */
+int linenoiseHistoryLen(void) {
+    historyLoadPending();
+    return history_len;
+}
+
+/* Return the history entry at 'index', 0 being the oldest one, or NULL
+ * if the index is out of range. The pointer is only valid until the
+ * history is modified. */
+const char *linenoiseHistoryGet(int index) {
+    historyLoadPending();
+    if (index < 0 || index >= history_len) return NULL;
+    return historyAt(index);
+}
+
 /* Save the history in the specified file. On success 0 is returned
  * otherwise -1 is returned. */
 int linenoiseHistorySave(const char *filename) {
@@ -1326,31 +2651,114 @@ int linenoiseHistorySave(const char *filename) {
     umask(old_umask);
     if (fp == NULL) return -1;
     chmod(filename,S_IRUSR|S_IWUSR);
+    historyLoadPending();
     for (j = 0; j < history_len; j++)
-        fprintf(fp,"%s\n",history[j]);
+        fprintf(fp,"%s\n",historyAt(j));
     fclose(fp);
     return 0;
 }
 
 /* Load the history from the specified file. If the file does not exist
- * zero is returned and no operation is performed.
+ * -1 is returned and no operation is performed, 0 on success.
  *
- * If the file exists and the operation succeeded 0 is returned, otherwise
- * on error -1 is returned. */
+ * The file is mapped privately instead of being read. Only the last
+ * lines that fit the max length are looked at, by scanning backwards from
+ * the end, and history entries point straight into the mapping, so the
+ * cost is bounded by the history length and not by the file size.
+ * Partial records at the end of the file are ignored. */
 int linenoiseHistoryLoad(const char *filename) {
-    FILE *fp = fopen(filename,"r");
-    char buf[LINENOISE_MAX_LINE];
+    int fd = open(filename,O_RDONLY|O_CLOEXEC);
+    struct stat st;
+    char *map, *p, *nl, *end, *prev = NULL;
+    size_t prevlen = 0;
+    int n = 0, direct;
+
+    if (fd == -1) return -1;
+    if (fstat(fd,&st) == -1 || st.st_size == 0 || history_max_len == 0) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL,st.st_size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    /* Complete records only, then back up to the first wanted line. */
+    end = map+st.st_size;
+    while (end > map && end[-1] != '\n') end--;
+    for (p = end; p > map && n < history_max_len; n++) {
+        nl = p-1 > map ? memrchr(map,'\n',p-1-map) : NULL;
+        p = nl ? nl+1 : map;
+    }
 
-    if (fp == NULL) return -1;
+    /* Size the ring once instead of doubling it line by line. */
+    if (history_len+n > history_cap)
+        historyResize(history_len+n < history_max_len ? history_len+n : history_max_len);
+
+    /* Only one file can back the entries, any later one is copied. */
+    direct = history_map == NULL;
+
+    for (; p < end; p = nl+1) {
+        size_t len;
+
+        nl = memchr(p,'\n',end-p);
+        len = nl-p;
 
-    while (fgets(buf,LINENOISE_MAX_LINE,fp) != NULL) {
-        char *p;
+        /* Skip empty lines and repeats, like linenoiseHistoryAdd(). */
+        if (len == 0 || (prev && len == prevlen && !memcmp(prev,p,len))) continue;
+        prev = p;
+        prevlen = len;
 
-        p = strchr(buf,'\r');
-        if (!p) p = strchr(buf,'\n');
-        if (p) *p = '\0';
-        linenoiseHistoryAdd(buf);
+        if (direct) {
+            if (historyMakeRoom() == -1) break;
+            *historySlot(history_len) = (size_t)(p-map) | HISTORY_MAPPED;
+            history_len++;
+        } else {
+            p[len] = '\0';
+            linenoiseHistoryAdd(p);
+            p[len] = '\n';
+        }
+    }
+
+    if (direct) {
+        history_map = map;
+        history_map_len = st.st_size;
+    } else {
+        munmap(map,st.st_size);
     }
-    fclose(fp);
     return 0;
 }
+
+/* Like linenoiseHistoryLoad(), but the file is only read once linenoise
+ * is idle or the history is first used, so a long history does not hold
+ * the first prompt back. Returns -1 if the name can't be kept. */
+int linenoiseHistoryLoadDeferred(const char *filename) {
+    char *copy = strdup(filename);
+
+    if (copy == NULL) return -1;
+    free(history_deferred);
+    history_deferred = copy;
+    return 0;
+}
+
+/* Read the deferred file now, the history is about to be used. An empty
+ * newest entry is the line being edited and stays the newest. */
+static void historyLoadPending(void) {
+    char *filename = history_deferred;
+    int editing;
+
+    if (filename == NULL) return;
+    history_deferred = NULL;
+
+    editing = history_len && historyAt(history_len-1)[0] == '\0';
+    if (editing) historyDropLast();
+    linenoiseHistoryLoad(filename);
+    if (editing) historyAdd("");
+    free(filename);
+}
+
+/* Idle step loading the deferred file, if there is one. */
+static int historyLoadIdle(int work) {
+    if (history_deferred == NULL) return 0;
+    if (work) historyLoadPending();
+    return 1;
+}
@@ -1,9 +1,28 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <locale.h>
 #include "include/sh.h"
 
-int main(){
+int main(int argc, char **argv){
+	// oshean -c 'cmd'
+	if (argc > 1 && !strcmp(argv[1], "-c")){
+		if (argc < 3){
+			printf("oshean: -c: option requires an argument\n");
+			return 2;
+		}
+		return osh_run_string(argv[2]);
+	}
+
+	// oshean script.osh
+	if (argc > 1)
+		return osh_run_script(argv[1]);
+
+	// Script piped or redirected to stdin
+	if (!isatty(STDIN_FILENO))
+		return osh_run_fd(STDIN_FILENO);
+
 	setlocale(LC_ALL, "");
 	spawn_oshean();
 }
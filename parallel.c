@@ -0,0 +1,403 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "include/parallel.h"
+#include "include/arena.h"
+#include "include/parse.h"
+#include "include/cmd.h"
+#include "include/job.h"
+
+// Output of one job, kept until it can be printed in one piece
+struct parallel_out {
+	char *buf;
+	size_t len;
+	size_t cap;
+	int done;
+};
+
+struct parallel_slot {
+	// -1 while the slot is free
+	pid_t pid;
+	// Read end of the job's stdout and stderr, -1 once at end of file
+	int fd;
+	// Its entry in the poll set, -1 when not polled this round
+	int polled;
+	int input;
+	int exited;
+	int status;
+	struct parallel_out out;
+};
+
+static int parallel_write_all(int fd, const char *s, size_t len){
+	while (len){
+		ssize_t w = write(fd, s, len);
+
+		if (w < 0){
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		s += w;
+		len -= w;
+	}
+
+	return 0;
+}
+
+static int parallel_append(struct parallel_out *o, const char *s, size_t len){
+	if (o->len + len > o->cap){
+		size_t cap = o->cap ? o->cap * 2 : 4096;
+		char *buf;
+
+		while (cap < o->len + len)
+			cap *= 2;
+		if ((buf = realloc(o->buf, cap)) == NULL)
+			return -1;
+		o->buf = buf;
+		o->cap = cap;
+	}
+
+	memcpy(o->buf + o->len, s, len);
+	o->len += len;
+
+	return 0;
+}
+
+// The first 'len' bytes of 's' single quoted for the lexer, ' itself as '\''
+static void parallel_quote(struct parallel_out *line, const char *s, size_t len){
+	parallel_append(line, "'", 1);
+
+	for (; len; s++, len--){
+		if (*s == '\'')
+			parallel_append(line, "'\\''", 4);
+		else
+			parallel_append(line, s, 1);
+	}
+
+	parallel_append(line, "'", 1);
+}
+
+// The command words as one line with {} standing for 'input', parsed like
+// anything typed so aliases apply. Every word is quoted, the shell already
+// split and unquoted them once.
+static char *parallel_line(struct parallel_out *line, char **cmd, int ncmd, const char *input){
+	int i, used = 0;
+
+	line->len = 0;
+
+	for (i = 0; i < ncmd; i++){
+		const char *w = cmd[i], *brace;
+
+		if (i)
+			parallel_append(line, " ", 1);
+
+		while ((brace = strstr(w, "{}")) != NULL){
+			parallel_quote(line, w, brace - w);
+			parallel_quote(line, input, strlen(input));
+			w = brace + 2;
+			used = 1;
+		}
+		parallel_quote(line, w, strlen(w));
+	}
+
+	if (!used){
+		parallel_append(line, " ", 1);
+		parallel_quote(line, input, strlen(input));
+	}
+
+	if (parallel_append(line, "", 1) < 0)
+		return NULL;
+
+	return line->buf;
+}
+
+// Lines of stdin, split in place inside 'store'
+static char **parallel_read_inputs(struct parallel_out *store, int *n){
+	char buf[65536], **v, *p, *end;
+	ssize_t r;
+	int cap = 0, i = 0;
+
+	while ((r = read(STDIN_FILENO, buf, sizeof(buf))) != 0){
+		if (r < 0){
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (parallel_append(store, buf, r) < 0)
+			return NULL;
+	}
+
+	if (store->len && store->buf[store->len - 1] != '\n')
+		parallel_append(store, "\n", 1);
+
+	for (p = store->buf, end = p + store->len; p && p < end; p++)
+		if (*p == '\n')
+			cap++;
+
+	if ((v = malloc((cap + 1) * sizeof(*v))) == NULL)
+		return NULL;
+
+	for (p = store->buf, end = p + store->len; p && p < end; ){
+		char *nl = memchr(p, '\n', end - p);
+
+		*nl = '\0';
+		v[i++] = p;
+		p = nl + 1;
+	}
+
+	*n = i;
+	return v;
+}
+
+static int parallel_status(int status){
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+
+	return WEXITSTATUS(status);
+}
+
+int osh_parallel_builtin(int argc, char **argv){
+	long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	struct parallel_out line = { 0 }, store = { 0 }, *outs = NULL;
+	struct parallel_slot *slots = NULL;
+	struct pollfd *pfd = NULL;
+	struct osh_arena a;
+	char **cmd, **inputs;
+	int ncmd, ninputs, keep = 0, i, sep;
+	int next = 0, running = 0, emitted = 0, failed = 0, stop = 0;
+	int devnull, self = osh_job_fd();
+	pid_t pgid = 0;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++){
+		if (!strcmp(argv[i], "--")){
+			i++;
+			break;
+		} else if (!strcmp(argv[i], "-k")){
+			keep = 1;
+		} else if (!strncmp(argv[i], "-j", 2)){
+			const char *n = argv[i][2] ? argv[i] + 2 : argv[++i];
+
+			if (n == NULL || (jobs = strtol(n, NULL, 10)) <= 0){
+				printf("parallel: -j needs a positive number\n");
+				return 2;
+			}
+		} else {
+			printf("parallel: %s: unknown option\n", argv[i]);
+			return 2;
+		}
+	}
+
+	for (sep = i; sep < argc && strcmp(argv[sep], ":::"); sep++)
+		;
+
+	cmd = argv + i;
+	ncmd = sep - i;
+
+	if (ncmd == 0){
+		printf("usage: parallel [-j N] [-k] command ... [::: input ...]\n");
+		return 2;
+	}
+
+	if (sep < argc){
+		inputs = argv + sep + 1;
+		ninputs = argc - sep - 1;
+	} else if ((inputs = parallel_read_inputs(&store, &ninputs)) == NULL){
+		printf("NULL Memory Allocation\n");
+		free(store.buf);
+		return 1;
+	}
+
+	// sysconf gives -1 when it can't tell
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs > OSH_PARALLEL_MAX_JOBS)
+		jobs = OSH_PARALLEL_MAX_JOBS;
+	if (jobs > ninputs)
+		jobs = ninputs ? ninputs : 1;
+
+	slots = calloc(jobs, sizeof(*slots));
+	pfd = calloc(jobs + 1, sizeof(*pfd));
+	outs = keep ? calloc(ninputs ? ninputs : 1, sizeof(*outs)) : NULL;
+	devnull = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+	if (slots == NULL || pfd == NULL || (keep && outs == NULL)){
+		printf("NULL Memory Allocation\n");
+		goto out;
+	}
+
+	for (i = 0; i < jobs; i++)
+		slots[i].pid = -1;
+
+	osh_arena_init(&a);
+	fflush(stdout);
+
+	while (running > 0 || (next < ninputs && !stop)){
+		int np = 0;
+
+		// Refill every free slot first
+		for (i = 0; i < jobs && next < ninputs && !stop; i++){
+			struct parallel_slot *s = &slots[i];
+			struct osh_pipeline *pl;
+			int p[2];
+
+			if (s->pid >= 0)
+				continue;
+
+			osh_arena_reset(&a);
+			if (parallel_line(&line, cmd, ncmd, inputs[next]) == NULL ||
+			    (pl = osh_parse(&a, line.buf)) == NULL){
+				failed++;
+				next++;
+				continue;
+			}
+
+			if (pl->ncmds == 0 || pipe2(p, O_CLOEXEC) < 0){
+				if (pl->ncmds)
+					printf("%s: pipe\n", strerror(errno));
+				failed++;
+				next++;
+				continue;
+			}
+
+			memset(s, 0, sizeof(*s));
+			s->input = next++;
+			s->fd = p[0];
+			s->pid = cmd_start_oshean(pl, devnull, p[1], osh_job_control ? pgid : -1);
+			close(p[1]);
+
+			// Never ran, what went wrong is in the pipe already
+			if (s->pid < 0){
+				s->pid = 0;
+				s->exited = 1;
+				s->status = 127 << 8;
+			} else if (osh_job_control && pgid == 0){
+				pgid = s->pid;
+				tcsetpgrp(STDIN_FILENO, pgid);
+			}
+			running++;
+		}
+
+		if (running == 0)
+			break;
+
+		pfd[np].fd = self;
+		pfd[np++].events = POLLIN;
+		for (i = 0; i < jobs; i++){
+			slots[i].polled = -1;
+			if (slots[i].pid < 0 || slots[i].fd < 0)
+				continue;
+			slots[i].polled = np;
+			pfd[np].fd = slots[i].fd;
+			pfd[np].revents = 0;
+			pfd[np++].events = POLLIN;
+		}
+
+		// Every job that's still open either writes or exits, both wake us
+		pfd[0].revents = 0;
+		if (poll(pfd, np, -1) < 0){
+			if (errno != EINTR)
+				break;
+			continue;
+		}
+
+		if (pfd[0].revents & POLLIN){
+			char buf[64];
+
+			while (read(self, buf, sizeof(buf)) > 0)
+				;
+		}
+
+		for (i = 0; i < jobs; i++){
+			struct parallel_slot *s = &slots[i];
+			char buf[16384];
+			ssize_t r;
+			int status;
+
+			if (s->pid < 0)
+				continue;
+
+			if (s->fd >= 0 && s->polled >= 0 && pfd[s->polled].revents){
+				if ((r = read(s->fd, buf, sizeof(buf))) > 0){
+					parallel_append(&s->out, buf, r);
+				} else if (r == 0 || (errno != EINTR && errno != EAGAIN)){
+					close(s->fd);
+					s->fd = -1;
+				}
+			}
+
+			// Reaped here, the SIGCHLD self-pipe said someone changed
+			if (!s->exited && waitpid(s->pid, &status, WNOHANG) == s->pid){
+				s->exited = 1;
+				s->status = status;
+			}
+
+			if (!s->exited || s->fd >= 0)
+				continue;
+
+			if (parallel_status(s->status) != 0)
+				failed++;
+			if (WIFSIGNALED(s->status) && WTERMSIG(s->status) == SIGINT)
+				stop = 1;
+
+			if (keep){
+				outs[s->input] = s->out;
+				outs[s->input].done = 1;
+			} else {
+				parallel_write_all(STDOUT_FILENO, s->out.buf, s->out.len);
+				free(s->out.buf);
+			}
+
+			s->pid = -1;
+			running--;
+
+			// The group goes with its last member
+			if (running == 0 && pgid){
+				tcsetpgrp(STDIN_FILENO, osh_shell_pgid);
+				pgid = 0;
+			}
+		}
+
+		// Input order, as far as the earliest unfinished job allows
+		while (keep && emitted < ninputs && outs[emitted].done){
+			parallel_write_all(STDOUT_FILENO, outs[emitted].buf, outs[emitted].len);
+			free(outs[emitted].buf);
+			outs[emitted].buf = NULL;
+			emitted++;
+		}
+	}
+
+	osh_arena_free(&a);
+
+	if (osh_job_control && pgid)
+		tcsetpgrp(STDIN_FILENO, osh_shell_pgid);
+
+out:
+	while (keep && outs && emitted < ninputs){
+		if (outs[emitted].done)
+			parallel_write_all(STDOUT_FILENO, outs[emitted].buf, outs[emitted].len);
+		free(outs[emitted].buf);
+		emitted++;
+	}
+
+	if (devnull >= 0)
+		close(devnull);
+	free(outs);
+	free(pfd);
+	free(slots);
+	free(line.buf);
+	// Inputs read from stdin are ours
+	if (sep >= argc){
+		free(inputs);
+		free(store.buf);
+	}
+
+	return failed > 101 ? 101 : failed;
+}
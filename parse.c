@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/parse.h"
+#include "include/lex.h"
+#include "include/alias.h"
+
+static const char *parse_tok_name(enum osh_tok_type type){
+	switch (type){
+	case OSH_TOK_PIPE:
+		return "|";
+	case OSH_TOK_AMP:
+		return "&";
+	case OSH_TOK_IN:
+		return "<";
+	case OSH_TOK_OUT:
+		return ">";
+	case OSH_TOK_APPEND:
+		return ">>";
+	case OSH_TOK_DUP_IN:
+		return "<&";
+	case OSH_TOK_DUP_OUT:
+		return ">&";
+	case OSH_TOK_STRING:
+		return "<<<";
+	default:
+		return "word";
+	}
+}
+
+static int parse_is_redir(enum osh_tok_type type){
+	return type >= OSH_TOK_IN && type <= OSH_TOK_STRING;
+}
+
+static void parse_redir(struct osh_redir *r, const struct osh_tok *op, char *word){
+	switch (op->type){
+	case OSH_TOK_IN:
+		r->type = OSH_REDIR_IN;
+		break;
+	case OSH_TOK_APPEND:
+		r->type = OSH_REDIR_APPEND;
+		break;
+	case OSH_TOK_DUP_IN:
+	case OSH_TOK_DUP_OUT:
+		r->type = OSH_REDIR_DUP;
+		break;
+	case OSH_TOK_STRING:
+		r->type = OSH_REDIR_STRING;
+		break;
+	default:
+		r->type = OSH_REDIR_OUT;
+		break;
+	}
+
+	if (op->fd >= 0)
+		r->fd = op->fd;
+	else
+		r->fd = op->type == OSH_TOK_IN || op->type == OSH_TOK_DUP_IN ||
+			op->type == OSH_TOK_STRING ? 0 : 1;
+	r->word = word;
+}
+
+struct osh_pipeline *osh_parse(struct osh_arena *a, char *s){
+	struct osh_pipeline *pl;
+	struct osh_tok *t;
+	int n, i, c;
+
+	if ((t = osh_lex(a, s, &n, 0)) == NULL)
+		return NULL;
+
+	// Aliases and functions become the words they stand for
+	if ((t = osh_alias_expand(a, t, &n)) == NULL)
+		return NULL;
+
+	if ((pl = osh_arena_alloc(a, sizeof(*pl))) == NULL)
+		return NULL;
+
+	pl->cmds = NULL;
+	pl->ncmds = 0;
+	pl->background = 0;
+	pl->timed = 0;
+	pl->arena = a;
+
+	// time as the first word of a longer line times the whole pipeline
+	if (n > 1 && t[0].type == OSH_TOK_WORD && t[1].type == OSH_TOK_WORD &&
+	    !strcmp(t[0].str, "time")){
+		pl->timed = 1;
+		t++;
+		n--;
+	}
+
+	// A trailing & runs the whole pipeline in the background
+	if (n > 1 && t[n-1].type == OSH_TOK_AMP && t[n-2].type == OSH_TOK_WORD){
+		pl->background = 1;
+		n--;
+	}
+
+	if (n == 0)
+		return pl;
+
+	// Every operator must sit between two words, redirections need theirs
+	for (i = 0; i < n; i++){
+		if (t[i].type == OSH_TOK_WORD)
+			continue;
+
+		if (parse_is_redir(t[i].type)){
+			if (i == n - 1 || t[i+1].type != OSH_TOK_WORD){
+				printf("oshean: syntax error near unexpected token `%s'\n",
+					i == n - 1 ? "newline" : parse_tok_name(t[i+1].type));
+				return NULL;
+			}
+			i++;
+			continue;
+		}
+
+		// & only ends a line, there are no lists to run it in the middle
+		// of one, and it must never stand for a pipe
+		if (t[i].type == OSH_TOK_AMP || i == 0 || i == n - 1 || t[i-1].type != OSH_TOK_WORD){
+			printf("oshean: syntax error near unexpected token `%s'\n",
+				parse_tok_name(t[i].type));
+			return NULL;
+		}
+
+		pl->ncmds++;
+	}
+	pl->ncmds++;
+
+	if ((pl->cmds = osh_arena_alloc(a, pl->ncmds * sizeof(*pl->cmds))) == NULL)
+		return NULL;
+
+	for (i = 0, c = 0; c < pl->ncmds; c++, i++){
+		struct osh_cmd *cmd = &pl->cmds[c];
+		int start = i, j, w = 0, r = 0;
+
+		cmd->argc = cmd->nredirs = 0;
+		for (; i < n && (t[i].type == OSH_TOK_WORD || parse_is_redir(t[i].type)); i++){
+			if (parse_is_redir(t[i].type)){
+				cmd->nredirs++;
+				i++;
+			} else {
+				cmd->argc++;
+			}
+		}
+
+		if ((cmd->argv = osh_arena_alloc(a, (cmd->argc + 1) * sizeof(char*))) == NULL)
+			return NULL;
+
+		cmd->redirs = NULL;
+		if (cmd->nredirs &&
+		    (cmd->redirs = osh_arena_alloc(a, cmd->nredirs * sizeof(*cmd->redirs))) == NULL)
+			return NULL;
+
+		for (j = start; j < i; j++){
+			if (parse_is_redir(t[j].type)){
+				parse_redir(&cmd->redirs[r++], &t[j], t[j+1].str);
+				j++;
+			} else {
+				cmd->argv[w++] = t[j].str;
+			}
+		}
+		cmd->argv[cmd->argc] = NULL;
+	}
+
+	return pl;
+}
+
+char *osh_pipeline_text(struct osh_pipeline *pl){
+	size_t len = 0;
+	char *text, *p;
+	int c, i;
+
+	for (c = 0; c < pl->ncmds; c++){
+		for (i = 0; i < pl->cmds[c].argc; i++)
+			len += strlen(pl->cmds[c].argv[i]) + 3;
+		for (i = 0; i < pl->cmds[c].nredirs; i++)
+			len += strlen(pl->cmds[c].redirs[i].word) + 6;
+	}
+
+	if ((p = text = malloc(len + 1)) == NULL)
+		return NULL;
+
+	for (c = 0; c < pl->ncmds; c++){
+		if (c > 0)
+			p += sprintf(p, " | ");
+
+		for (i = 0; i < pl->cmds[c].argc; i++)
+			p += sprintf(p, i ? " %s" : "%s", pl->cmds[c].argv[i]);
+
+		for (i = 0; i < pl->cmds[c].nredirs; i++){
+			const struct osh_redir *r = &pl->cmds[c].redirs[i];
+			static const char *ops[] = { "<", ">", ">>", ">&", "<<<" };
+			int dflt = r->type == OSH_REDIR_IN || r->type == OSH_REDIR_STRING ? 0 : 1;
+
+			if (p > text)
+				*p++ = ' ';
+			if (r->fd != dflt)
+				p += sprintf(p, "%d", r->fd);
+			p += sprintf(p, "%s%s", ops[r->type], r->word);
+		}
+	}
+	*p = '\0';
+
+	return text;
+}
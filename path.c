@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "include/path.h"
+#include "include/env.h"
+#include "include/stats.h"
+
+// Directories are re-stat'ed at most once per this many nanoseconds, so a
+// burst of commands only pays for one sweep over $PATH
+#define OSH_PATH_RECHECK_NS 1000000000L
+
+struct osh_path_dir {
+	char *dir;
+	struct timespec mtime;
+};
+
+struct osh_path_entry {
+	char *name;
+	char *path;
+	// Index of the $PATH directory the command was found in
+	int dir;
+	unsigned long hits;
+	struct osh_path_entry *next;
+};
+
+// $PATH value the directory list was built from
+static char *path_val;
+static struct osh_path_dir *path_dirs;
+static int path_ndirs;
+static struct timespec path_checked;
+
+static struct osh_path_entry **path_tab;
+static size_t path_tab_size;
+static size_t path_tab_used;
+
+static unsigned long path_hash(const char *s){
+	// FNV-1a
+	unsigned long h = 2166136261UL;
+
+	while (*s){
+		h ^= (unsigned char)*s++;
+		h *= 16777619UL;
+	}
+
+	return h;
+}
+
+static void path_free_entry(struct osh_path_entry *e){
+	free(e->name);
+	free(e->path);
+	free(e);
+}
+
+// Drop every entry found in directory index 'from' or later, a change in
+// directory d can only affect lookups that walked past it
+static void path_flush_from(int from){
+	size_t i;
+
+	for (i = 0; i < path_tab_size; i++){
+		struct osh_path_entry **pe = &path_tab[i];
+
+		while (*pe){
+			struct osh_path_entry *e = *pe;
+
+			if (e->dir >= from){
+				*pe = e->next;
+				path_free_entry(e);
+				path_tab_used--;
+			} else {
+				pe = &e->next;
+			}
+		}
+	}
+}
+
+void osh_path_flush(void){
+	path_flush_from(0);
+}
+
+static void path_dir_mtime(const char *dir, struct timespec *ts){
+	struct stat st;
+
+	if (stat(dir, &st) < 0){
+		ts->tv_sec = 0;
+		ts->tv_nsec = 0;
+		return;
+	}
+
+	*ts = st.st_mtim;
+}
+
+// Split $PATH into the directory list, only when $PATH itself changed
+static void path_load_dirs(const char *val){
+	const char *p;
+	int i;
+
+	for (i = 0; i < path_ndirs; i++)
+		free(path_dirs[i].dir);
+	free(path_dirs);
+	free(path_val);
+
+	path_val = strdup(val);
+	path_ndirs = 1;
+	for (p = val; *p; p++)
+		if (*p == ':')
+			path_ndirs++;
+
+	path_dirs = calloc(path_ndirs, sizeof(*path_dirs));
+
+	if (path_dirs == NULL || path_val == NULL){
+		path_ndirs = 0;
+		return;
+	}
+
+	for (i = 0, p = val; i < path_ndirs; i++){
+		const char *end = strchr(p, ':');
+		size_t len = end ? (size_t)(end - p) : strlen(p);
+
+		// An empty element means the current directory
+		path_dirs[i].dir = len ? strndup(p, len) : strdup(".");
+		path_dir_mtime(path_dirs[i].dir, &path_dirs[i].mtime);
+		p += len + 1;
+	}
+}
+
+// Bring the directory list up to date with $PATH and the directories' mtimes
+static void path_revalidate(void){
+	const char *val = osh_env_get("PATH");
+	struct timespec now;
+	int i;
+
+	if (val == NULL)
+		val = "/usr/local/bin:/usr/bin:/bin";
+
+	if (path_val == NULL || strcmp(path_val, val)){
+		osh_path_flush();
+		path_load_dirs(val);
+		clock_gettime(CLOCK_MONOTONIC, &path_checked);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if ((now.tv_sec - path_checked.tv_sec) * 1000000000L +
+	    (now.tv_nsec - path_checked.tv_nsec) < OSH_PATH_RECHECK_NS)
+		return;
+
+	path_checked = now;
+
+	for (i = 0; i < path_ndirs; i++){
+		struct timespec ts;
+
+		path_dir_mtime(path_dirs[i].dir, &ts);
+
+		if (ts.tv_sec != path_dirs[i].mtime.tv_sec ||
+		    ts.tv_nsec != path_dirs[i].mtime.tv_nsec){
+			path_dirs[i].mtime = ts;
+			path_flush_from(i);
+		}
+	}
+}
+
+static int path_grow(void){
+	size_t size = path_tab_size ? path_tab_size * 2 : 64;
+	struct osh_path_entry **tab;
+	size_t i;
+
+	tab = calloc(size, sizeof(*tab));
+
+	if (tab == NULL)
+		return -1;
+
+	for (i = 0; i < path_tab_size; i++){
+		struct osh_path_entry *e = path_tab[i];
+
+		while (e){
+			struct osh_path_entry *next = e->next;
+			size_t b = path_hash(e->name) & (size - 1);
+
+			e->next = tab[b];
+			tab[b] = e;
+			e = next;
+		}
+	}
+
+	free(path_tab);
+	path_tab = tab;
+	path_tab_size = size;
+
+	return 0;
+}
+
+static struct osh_path_entry *path_find(const char *name){
+	struct osh_path_entry *e;
+
+	if (path_tab_size == 0)
+		return NULL;
+
+	for (e = path_tab[path_hash(name) & (path_tab_size - 1)]; e; e = e->next)
+		if (!strcmp(e->name, name))
+			return e;
+
+	return NULL;
+}
+
+// Walk $PATH for 'name', returns a malloc'd path and the directory index
+static char *path_walk(const char *name, int *dir){
+	struct stat st;
+	size_t nlen = strlen(name);
+	int i;
+
+	for (i = 0; i < path_ndirs; i++){
+		size_t dlen = strlen(path_dirs[i].dir);
+		char *buf = malloc(dlen + 1 + nlen + 1);
+
+		if (buf == NULL)
+			return NULL;
+
+		memcpy(buf, path_dirs[i].dir, dlen);
+		buf[dlen] = '/';
+		memcpy(buf + dlen + 1, name, nlen + 1);
+
+		if (stat(buf, &st) == 0 && S_ISREG(st.st_mode) && access(buf, X_OK) == 0){
+			*dir = i;
+			return buf;
+		}
+
+		free(buf);
+	}
+
+	return NULL;
+}
+
+static struct osh_path_entry *path_insert(const char *name, char *path, int dir){
+	struct osh_path_entry *e;
+	size_t b;
+
+	if (path_tab_used >= path_tab_size && path_grow() < 0)
+		return NULL;
+
+	e = malloc(sizeof(*e));
+
+	if (e == NULL || (e->name = strdup(name)) == NULL){
+		free(e);
+		return NULL;
+	}
+
+	e->path = path;
+	e->dir = dir;
+	e->hits = 0;
+
+	b = path_hash(name) & (path_tab_size - 1);
+	e->next = path_tab[b];
+	path_tab[b] = e;
+	path_tab_used++;
+
+	return e;
+}
+
+char *osh_path_lookup(const char *name){
+	// Last result found through a relative $PATH entry, those depend on
+	// the working directory and are never hashed
+	static char *path_rel;
+	struct osh_path_entry *e;
+	char *path;
+	int dir;
+
+	if (name == NULL || *name == '\0')
+		return NULL;
+
+	// Paths are never looked up
+	if (strchr(name, '/'))
+		return (char*)name;
+
+	path_revalidate();
+
+	if ((e = path_find(name)) != NULL){
+		e->hits++;
+		OSH_STATS_INC(path_hits);
+		return e->path;
+	}
+
+	OSH_STATS_INC(path_misses);
+
+	if ((path = path_walk(name, &dir)) == NULL)
+		return NULL;
+
+	if (path[0] != '/'){
+		free(path_rel);
+		path_rel = path;
+		return path;
+	}
+
+	if ((e = path_insert(name, path, dir)) == NULL){
+		free(path_rel);
+		path_rel = path;
+		return path;
+	}
+
+	e->hits++;
+	return e->path;
+}
+
+int osh_path_dir_count(void){
+	path_revalidate();
+	return path_ndirs;
+}
+
+const char *osh_path_dir(int i){
+	return i >= 0 && i < path_ndirs ? path_dirs[i].dir : NULL;
+}
+
+int osh_path_hash_builtin(int argc, char **args){
+	int ret = 0;
+	size_t i;
+
+	(void)argc;
+
+	path_revalidate();
+
+	if (args[1] == NULL){
+		if (path_tab_used == 0){
+			printf("hash: hash table empty\n");
+			return 0;
+		}
+
+		printf("hits\tcommand\n");
+
+		for (i = 0; i < path_tab_size; i++){
+			struct osh_path_entry *e;
+
+			for (e = path_tab[i]; e; e = e->next)
+				printf("%4lu\t%s\n", e->hits, e->path);
+		}
+
+		return 0;
+	}
+
+	if (!strcmp(args[1], "-r")){
+		osh_path_flush();
+		return 0;
+	}
+
+	for (i = 1; args[i]; i++){
+		char *path;
+		int dir;
+
+		if (strchr(args[i], '/') || path_find(args[i]))
+			continue;
+
+		if ((path = path_walk(args[i], &dir)) == NULL){
+			printf("hash: %s: not found\n", args[i]);
+			ret = 1;
+			continue;
+		}
+
+		if (path[0] != '/' || path_insert(args[i], path, dir) == NULL)
+			free(path);
+	}
+
+	return ret;
+}
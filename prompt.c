@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "include/prompt.h"
+#include "include/config.h"
+#include "include/complete.h"
+#include "include/env.h"
+#include "include/sys.h"
+#include "include/times.h"
+
+#define OSH_PROMPT_MAX_SEGS 8
+
+struct prompt_seg {
+	const char *name;
+	// Bring 'text' up to date, returns 1 when it changed
+	int (*update)(struct prompt_seg *s, int ran);
+	char *text;
+	size_t len;
+	size_t cap;
+};
+
+static struct prompt_seg *prompt_segs[OSH_PROMPT_MAX_SEGS];
+static int prompt_nsegs;
+// Whether the duration segment was asked for, otherwise it waits for
+// $OSH_PROMPT_DURATION
+static int prompt_duration_set;
+
+// Bumped by every cd, cwd and git compare it with what they last saw
+static unsigned long prompt_cwd_gen = 1;
+
+// Last rendered line, handed out as long as no segment changes
+static char *prompt_line;
+static size_t prompt_line_cap;
+static int prompt_line_valid;
+
+// Format into the segment's own buffer, returns 1 when the text differs
+static int seg_set(struct prompt_seg *s, const char *fmt, ...){
+	char tmp[4352];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+	va_end(ap);
+
+	if (n < 0)
+		n = 0;
+	if ((size_t)n >= sizeof(tmp))
+		n = sizeof(tmp) - 1;
+
+	if (s->text && s->len == (size_t)n && !memcmp(s->text, tmp, n))
+		return 0;
+
+	if ((size_t)n + 1 > s->cap){
+		char *t = realloc(s->text, n + 1);
+
+		if (t == NULL)
+			return 0;
+		s->text = t;
+		s->cap = n + 1;
+	}
+
+	memcpy(s->text, tmp, n + 1);
+	s->len = n;
+
+	return 1;
+}
+
+// user@host never changes, looked up on the first render
+static int seg_user(struct prompt_seg *s, int ran){
+	char *user, *host;
+	int changed;
+
+	(void)ran;
+
+	if (s->text)
+		return 0;
+
+	user = oshean_get_user();
+	host = oshean_get_hostname();
+	changed = seg_set(s, "\033[0;34m%s@%s\033[0;37m", user ? user : "?", host ? host : "?");
+	free(host);
+
+	return changed;
+}
+
+static unsigned long seg_cwd_seen;
+static char *seg_cwd_home;
+
+static int seg_cwd(struct prompt_seg *s, int ran){
+	const char *home = osh_env_get("HOME");
+	char *cwd;
+	size_t hlen;
+	int changed;
+
+	(void)ran;
+
+	// $HOME moving changes how the same directory is shown
+	if (seg_cwd_seen == prompt_cwd_gen &&
+	    (home == NULL) == (seg_cwd_home == NULL) &&
+	    (home == NULL || !strcmp(home, seg_cwd_home)))
+		return 0;
+
+	seg_cwd_seen = prompt_cwd_gen;
+	free(seg_cwd_home);
+	seg_cwd_home = home ? strdup(home) : NULL;
+
+	if ((cwd = getcwd(NULL, 0)) == NULL)
+		return seg_set(s, "%s", "");
+
+	hlen = home ? strlen(home) : 0;
+
+	if (hlen > 1 && !strncmp(cwd, home, hlen) && (cwd[hlen] == '/' || cwd[hlen] == '\0'))
+		changed = seg_set(s, "\033[0;36m~%s\033[0;37m", cwd + hlen);
+	else
+		changed = seg_set(s, "\033[0;36m%s\033[0;37m", cwd);
+
+	free(cwd);
+
+	return changed;
+}
+
+static unsigned long seg_git_seen;
+// HEAD of the repository the shell is in, empty outside of one
+static char seg_git_head[4200];
+static struct stat seg_git_st;
+
+static int seg_git(struct prompt_seg *s, int ran){
+	char gitdir[4096], line[256];
+	struct stat st;
+	FILE *fp;
+
+	(void)ran;
+
+	if (seg_git_seen != prompt_cwd_gen){
+		seg_git_seen = prompt_cwd_gen;
+		memset(&seg_git_st, 0, sizeof(seg_git_st));
+
+		if (osh_complete_gitdir(gitdir, sizeof(gitdir)) < 0){
+			seg_git_head[0] = '\0';
+			return seg_set(s, "%s", "");
+		}
+
+		snprintf(seg_git_head, sizeof(seg_git_head), "%s/HEAD", gitdir);
+	}
+
+	if (seg_git_head[0] == '\0')
+		return 0;
+
+	// git replaces HEAD through a lock file, a new inode or mtime means
+	// a checkout happened
+	if (stat(seg_git_head, &st) < 0)
+		return seg_set(s, "%s", "");
+
+	if (st.st_ino == seg_git_st.st_ino && st.st_size == seg_git_st.st_size &&
+	    st.st_mtim.tv_sec == seg_git_st.st_mtim.tv_sec &&
+	    st.st_mtim.tv_nsec == seg_git_st.st_mtim.tv_nsec)
+		return 0;
+
+	seg_git_st = st;
+
+	if ((fp = fopen(seg_git_head, "r")) == NULL)
+		return seg_set(s, "%s", "");
+
+	if (fgets(line, sizeof(line), fp) == NULL)
+		line[0] = '\0';
+	fclose(fp);
+	line[strcspn(line, "\n")] = '\0';
+
+	if (!strncmp(line, "ref: refs/heads/", 16))
+		return seg_set(s, "\033[0;35m(%s)\033[0;37m", line + 16);
+	if (!strncmp(line, "ref: ", 5))
+		return seg_set(s, "\033[0;35m(%s)\033[0;37m", line + 5);
+
+	// Detached, the abbreviated commit
+	return seg_set(s, "\033[0;35m(%.7s)\033[0;37m", line);
+}
+
+static int seg_status_seen = -1;
+
+// Shown only when the last command failed
+static int seg_status(struct prompt_seg *s, int ran){
+	(void)ran;
+
+	if (s->text && seg_status_seen == osh_last_status)
+		return 0;
+
+	seg_status_seen = osh_last_status;
+
+	if (osh_last_status == 0)
+		return seg_set(s, "%s", "");
+
+	return seg_set(s, "\033[0;31m[%d]\033[0;37m", osh_last_status);
+}
+
+static long long seg_duration_seen = -1;
+
+// Wall clock time of the last command, nothing before the first one
+static int seg_duration(struct prompt_seg *s, int ran){
+	char d[32];
+
+	if (!ran || (!prompt_duration_set && osh_env_get("OSH_PROMPT_DURATION") == NULL)){
+		seg_duration_seen = -1;
+		return seg_set(s, "%s", "");
+	}
+
+	if (seg_duration_seen == osh_last_times.real_us)
+		return 0;
+
+	seg_duration_seen = osh_last_times.real_us;
+	osh_times_duration(osh_last_times.real_us, d, sizeof(d));
+
+	return seg_set(s, "[%s]", d);
+}
+
+static struct prompt_seg prompt_all[] = {
+	{ .name = "duration", .update = seg_duration },
+	{ .name = "user", .update = seg_user },
+	{ .name = "cwd", .update = seg_cwd },
+	{ .name = "git", .update = seg_git },
+	{ .name = "status", .update = seg_status },
+	{ .name = NULL }
+};
+
+static void prompt_add(const char *name, size_t len){
+	int i;
+
+	for (i = 0; prompt_all[i].name; i++){
+		if (strlen(prompt_all[i].name) == len && !strncmp(prompt_all[i].name, name, len)){
+			if (prompt_nsegs < OSH_PROMPT_MAX_SEGS)
+				prompt_segs[prompt_nsegs++] = &prompt_all[i];
+			if (!strcmp(prompt_all[i].name, "duration"))
+				prompt_duration_set = 1;
+			return;
+		}
+	}
+
+	fprintf(stderr, "oshean: prompt: unknown segment %.*s\n", (int)len, name);
+}
+
+int osh_prompt_init(void){
+	const char *list = osh_config_get("prompt");
+	int dflt = list == NULL;
+	const char *p;
+
+	prompt_nsegs = 0;
+	prompt_duration_set = 0;
+	prompt_line_valid = 0;
+
+	if (dflt)
+		list = "duration user cwd git status";
+
+	for (p = list; *p; ){
+		size_t len;
+
+		p += strspn(p, " \t,");
+		if ((len = strcspn(p, " \t,")) == 0)
+			break;
+		prompt_add(p, len);
+		p += len;
+	}
+
+	// Unless the config lists it, duration waits for $OSH_PROMPT_DURATION
+	if (dflt)
+		prompt_duration_set = 0;
+
+	return 0;
+}
+
+void osh_prompt_cwd_changed(void){
+	prompt_cwd_gen++;
+}
+
+static int prompt_append(size_t *len, const char *s, size_t n){
+	if (*len + n + 1 > prompt_line_cap){
+		size_t cap = prompt_line_cap ? prompt_line_cap : 128;
+		char *line;
+
+		while (cap < *len + n + 1)
+			cap *= 2;
+		if ((line = realloc(prompt_line, cap)) == NULL)
+			return -1;
+		prompt_line = line;
+		prompt_line_cap = cap;
+	}
+
+	memcpy(prompt_line + *len, s, n);
+	*len += n;
+	prompt_line[*len] = '\0';
+
+	return 0;
+}
+
+const char *osh_prompt_render(int ran){
+	size_t len = 0;
+	int i, changed = 0, first = 1;
+
+	for (i = 0; i < prompt_nsegs; i++)
+		changed |= prompt_segs[i]->update(prompt_segs[i], ran);
+
+	if (!changed && prompt_line_valid)
+		return prompt_line;
+
+	prompt_append(&len, "<", 1);
+
+	for (i = 0; i < prompt_nsegs; i++){
+		if (prompt_segs[i]->len == 0)
+			continue;
+		if (!first)
+			prompt_append(&len, " ", 1);
+		prompt_append(&len, prompt_segs[i]->text, prompt_segs[i]->len);
+		first = 0;
+	}
+
+	prompt_line_valid = prompt_append(&len, "> ", 2) == 0;
+
+	return prompt_line ? prompt_line : "> ";
+}
+
+void osh_prompt_free(void){
+	int i;
+
+	for (i = 0; prompt_all[i].name; i++){
+		free(prompt_all[i].text);
+		prompt_all[i].text = NULL;
+		prompt_all[i].len = prompt_all[i].cap = 0;
+	}
+
+	free(seg_cwd_home);
+	seg_cwd_home = NULL;
+	free(prompt_line);
+	prompt_line = NULL;
+	prompt_line_cap = 0;
+	prompt_line_valid = 0;
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "include/sh.h"
+#include "include/arena.h"
+
+// Read size for scripts that can't be mapped, pipes and terminals
+#define OSH_SCRIPT_BLOCK 65536
+
+// Run every complete line of buf, returns the number of bytes consumed.
+// The line terminators are overwritten in place. When 'sync' is a seekable
+// descriptor the children share, its offset is moved past the current line
+// before running it so they start reading where the script continues, and
+// whatever they consumed is skipped afterwards.
+static size_t script_run_lines(struct osh_arena *a, char *buf, size_t len,
+		int last, int sync, off_t base, int *status){
+	char *p = buf, *end = buf + len;
+
+	while (p < end){
+		char *nl = memchr(p, '\n', end - p);
+		char *line = p;
+
+		if (nl == NULL){
+			if (!last)
+				break;
+
+			// Unterminated last line, may end right at the mapping's edge
+			osh_arena_reset(a);
+			line = osh_arena_strndup(a, p, end - p);
+			p = end;
+		} else {
+			*nl = '\0';
+			p = nl + 1;
+			osh_arena_reset(a);
+		}
+
+		if (sync >= 0)
+			lseek(sync, base + (p - buf), SEEK_SET);
+
+		if (line)
+			*status = osh_eval_line(a, line);
+
+		if (sync >= 0){
+			off_t off = lseek(sync, 0, SEEK_CUR);
+
+			if (off > base + (p - buf))
+				p = off - base < (off_t)len ? buf + (off - base) : end;
+		}
+	}
+
+	return p - buf;
+}
+
+// Block reads for descriptors that can't be mapped
+static int script_run_stream(struct osh_arena *a, int fd){
+	char *buf = NULL;
+	size_t len = 0, cap = 0;
+	int status = 0;
+
+	for (;;){
+		ssize_t nread;
+		size_t used;
+
+		if (cap - len < OSH_SCRIPT_BLOCK){
+			char *nbuf = realloc(buf, cap + OSH_SCRIPT_BLOCK);
+
+			if (nbuf == NULL){
+				printf("NULL Memory Allocation\n");
+				status = 1;
+				break;
+			}
+
+			buf = nbuf;
+			cap += OSH_SCRIPT_BLOCK;
+		}
+
+		if ((nread = read(fd, buf + len, cap - len)) < 0){
+			if (errno == EINTR)
+				continue;
+			printf("%s\n", strerror(errno));
+			status = 1;
+			break;
+		}
+
+		len += nread;
+		used = script_run_lines(a, buf, len, nread == 0, -1, 0, &status);
+		memmove(buf, buf + used, len - used);
+		len -= used;
+
+		if (nread == 0)
+			break;
+	}
+
+	free(buf);
+	return status;
+}
+
+static int script_run(int fd, int shared){
+	struct osh_arena a;
+	struct stat st;
+	int status = 0;
+
+	osh_arena_init(&a);
+	osh_init_shell(0);
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+		off_t base = shared ? lseek(fd, 0, SEEK_CUR) : 0;
+		size_t len = st.st_size - (base > 0 ? base : 0);
+		char *map;
+
+		if (len == 0){
+			osh_arena_free(&a);
+			return 0;
+		}
+
+		// Private and writable, the lexer works in place and only the
+		// pages it touches get copied
+		map = mmap(NULL, len + (base > 0 ? base : 0), PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+
+		if (map != MAP_FAILED){
+			script_run_lines(&a, map + (base > 0 ? base : 0), len, 1,
+				shared ? fd : -1, base > 0 ? base : 0, &status);
+			munmap(map, len + (base > 0 ? base : 0));
+			osh_arena_free(&a);
+			return status;
+		}
+	}
+
+	status = script_run_stream(&a, fd);
+	osh_arena_free(&a);
+
+	return status;
+}
+
+int osh_run_script(const char *path){
+	int fd, status;
+
+	if ((fd = open(path, O_RDONLY|O_CLOEXEC)) < 0){
+		printf("oshean: %s: %s\n", path, strerror(errno));
+		return 127;
+	}
+
+	status = script_run(fd, 0);
+	close(fd);
+
+	return status;
+}
+
+int osh_run_fd(int fd){
+	// Commands of the script inherit this descriptor
+	return script_run(fd, 1);
+}
+
+int osh_run_string(const char *cmd){
+	struct osh_arena a;
+	int status = 0;
+	char *buf;
+
+	osh_arena_init(&a);
+	osh_init_shell(0);
+
+	if ((buf = strdup(cmd)) == NULL){
+		printf("NULL Memory Allocation\n");
+		return 1;
+	}
+
+	script_run_lines(&a, buf, strlen(buf), 1, -1, 0, &status);
+
+	free(buf);
+	osh_arena_free(&a);
+
+	return status;
+}
@@ -10,57 +10,60 @@
 #include "include/cmd.h"
 #include "include/sys.h"
 #include "include/std.h"
+#include "include/path.h"
+#include "include/env.h"
+#include "include/parse.h"
+#include "include/arena.h"
+#include "include/job.h"
+#include "include/times.h"
+#include "include/config.h"
+#include "include/hist.h"
+#include "include/complete.h"
+#include "include/prompt.h"
+#include "include/alias.h"
+#include "include/cache.h"
+#include "include/stats.h"
 #include "include/linenoise.h"
 #include "include/utf8.h"
 
-// hints and completions
-char *hints(const char *buff, int *color, int *bold){
-	*color = 2;
-	*bold = 0;
+// History entries kept when the config sets no history_size
+#define OSH_HISTORY_SIZE 100000
 
-	if (!strcmp(buff, "l")){
-		return "s";
-	}
+extern char **environ;
 
-	if (!strcmp(buff, "p")){
-		return "wd";
-	}
+void osh_init_shell(int interactive){
+	// Shell owned copy of the environment
+	osh_env_init(environ);
 
-        if (!strcmp(buff, "c")){
-		return "d";
-	}
+	// Process groups and terminal hand over
+	cmd_init_oshean(interactive);
+}
 
-	if (!strcmp(buff, "v")){
-		return "im";
-	}
+int osh_eval_line(struct osh_arena *a, char *line){
+	struct osh_times_mark m;
+	struct osh_pipeline *pl;
+	int status;
 
-	if (!strcmp(buff, "na")){
-		return "no";
-	}
-				
-	return NULL;
-}
+	// Syntax errors were already reported by the parser
+	if ((pl = osh_parse(a, line)) == NULL)
+		return osh_last_status = 2;
 
-void completion(const char *buff, linenoiseCompletions *lc){
-	if (!strcmp(&buff[0], "l")){
-		linenoiseAddCompletion(lc, "ls");
-	}
+	// Comment only lines
+	if (pl->ncmds == 0)
+		return 0;
 
-	if (!strcmp(&buff[0], "p")){
-		linenoiseAddCompletion(lc, "pwd");
-	}
+	osh_times_start(&m);
+	status = cmd_exec_oshean(pl);
+	osh_times_stop(&m);
+	osh_last_status = status;
 
-	if (!strcmp(&buff[0], "c")){
-		linenoiseAddCompletion(lc, "cd");
-	}
+	if (pl->timed)
+		osh_times_print(&osh_last_times);
 
-	if (!strcmp(&buff[0], "v")){
-		linenoiseAddCompletion(lc, "vim");
-	}
+	// Background children that finished meanwhile
+	osh_job_reap();
 
-	if (!strcmp(buff, "na")){
-		linenoiseAddCompletion(lc, "nano");
-	}
+	return status;
 }
 
 int spawn_oshean(){
@@ -68,54 +71,55 @@ int spawn_oshean(){
 	size_t size = 0;
 	// Character number
 	ssize_t chars;
-	// User and hostname
-	char *user, *hostname;
-	// Input before space trimming
+	// Home directory the shell starts in
+	const char *home;
+	// Line as linenoise hands it over, malloc'd
+	char *line;
+	// Input before space trimming, copied into the line arena
 	char *input_cmd_oshean_bf_tr;
-	// Prompt value
-	char *prompt;
-	// Home path
-	char *home_p;
+	// Rendered prompt
+	const char *prompt;
 	// Regular n value used in loop
 	int n;
-	// Command line arguments
-	char *args[80];
-
-	// memory allocation
-	prompt = (char*)malloc(40);
-	home_p = (char*)malloc(40);
-
-	// User check, if gets error -> exit
-	if ((user = oshean_get_user()) == 0){
-		printf("Exiting due to user %s\n", user);
-		exit(1);
-	}
-	// Hostname check like over user check
-	if ((hostname = oshean_get_hostname()) == 0){
-		printf("Exiting due to hostname %s\n", hostname);
-		exit(1);
-	}
-
-	// Prompt formatting
-	if (sprintf(prompt, "<\033[0;34m%s@%s\033[0;37m> ", user, hostname)  < 0){
-		printf("Exiting due to sprintf, sh.c:88\n");
-		exit(1);
-	}
-
-	if (sprintf(home_p, "/home/%s", user) < 0){
-		printf("Exiting due to sprintf, sh.c:93\n");
-		exit(1);
-	}
-
-	if (chdir(home_p) < 0){
-		printf("%s\n", strerror(errno));
-	}
+	// Per line working memory, the line itself and everything made from
+	// it, reset at the top of every iteration
+	struct osh_arena line_arena;
+	// Whether anything ran yet, nothing to report before that
+	int ran = 0;
+	long history_size;
+	// Time to the first prompt is counted from here
+	struct timespec start, now;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	osh_arena_init(&line_arena);
+	osh_init_shell(1);
+	osh_config_load();
+	osh_config_env();
+	osh_alias_init();
+	osh_cache_init();
+	osh_stats_init();
+
+	// $HOME, wherever it is, the password database without one
+	if ((home = oshean_get_home()) != NULL && chdir(home) < 0){
+		printf("%s: %s\n", home, strerror(errno));
+	}
+
+	// Prompt segments from the config
+	osh_prompt_init();
 
 	// linenoise settings
 	linenoiseSetMultiLine(1);
-	linenoiseSetHintsCallback(hints);
-	linenoiseSetCompletionCallback(completion);
-	linenoiseHistorySetMaxLen(100);
+	linenoiseSetHintsProvider(osh_complete_hint);
+	linenoiseSetFreeHintsCallback(free);
+	linenoiseSetCompletionCallback(osh_complete);
+	// Work that can wait for the first prompt: the history file is read
+	// and $PATH listed for completion while it waits for a key
+	linenoiseSetIdleCallback(osh_complete_idle);
+	history_size = osh_config_long("history_size", OSH_HISTORY_SIZE);
+	linenoiseHistorySetMaxLen(history_size);
+	osh_hist_init(history_size);
+	// Children are reaped while the user types
+	linenoiseSetWatchFd(osh_job_fd(), osh_job_reap);
 
 	// UTF-8 encoding functions
 #ifdef UTF8
@@ -128,10 +132,21 @@ int spawn_oshean(){
 	// Prompt input
 	for (;;){
 		errno = 0;
+		osh_arena_reset(&line_arena);
+
+		// Report jobs that finished or stopped since the last prompt
+		osh_job_notify();
 
-		input_cmd_oshean_bf_tr = linenoise(prompt);
+		// Segments only recompute when what they show changed
+		prompt = osh_prompt_render(ran);
+
+		if (osh_startup_us == 0){
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			osh_startup_us = (now.tv_sec - start.tv_sec) * 1000000LL +
+				(now.tv_nsec - start.tv_nsec) / 1000;
+		}
 
-		if (!input_cmd_oshean_bf_tr){
+		if ((line = linenoise(prompt)) == NULL){
 			// Equalivent to CTRL-D
 			if (errno != EAGAIN)
 				break;
@@ -139,63 +154,38 @@ int spawn_oshean(){
 			continue;
 		}
 
+		// From here on nothing needs freeing, whichever way the
+		// iteration ends
+		input_cmd_oshean_bf_tr = osh_arena_strndup(&line_arena, line, strlen(line));
+		free(line);
+		if (input_cmd_oshean_bf_tr == NULL)
+			continue;
+
 		// Space check again after trim 
 		if (!strcmp(input_cmd_oshean_bf_tr, ""))
 			continue;
 
+		// Enter to exec is timed from here
+		OSH_STATS_ENTER();
+
 		// Trim the string and return address
 		char *input_cmd_oshean = osh_trim(input_cmd_oshean_bf_tr);
 
 		// Add command to history
-		linenoiseHistoryAdd(input_cmd_oshean);
-
-		// Set args[80] value
-		osh_set_args(args, input_cmd_oshean);
-
-		// Space check again after trim
-		if (!strcmp(input_cmd_oshean, ""))
-			continue;
-
-		// cd builtin command
-		if (!strcmp(args[0], "cd")){
-			if (chdir(args[1]) < 0){
-				printf("%s\n", strerror(errno));
-			}
-			continue;
-		}
-
-		// ZWFzdGVyIGVnZy4uLg==	
-		if (!strcmp(input_cmd_oshean, "Hello")){
-                	printf("Hello, hello? Uh, I wanted to record a message for you to help you get settled "
-                	"in your tutorial. Um, I actually developer of oshean. "
-                        "I'm finishing up my last commits now, as a matter of fact. "
-                        "So, I know it can be a bit weird, "
-                        "but I'm here to tell you there's nothing to worry about usage. "
-                        "Uh, you'll do fine. "
-                        "So, let's just focus on getting you through commands. Okay?\n");
-			
-			continue;
-		}
+		osh_hist_add(input_cmd_oshean);
 
-		// clear screen, basically
-		if (!strcmp(input_cmd_oshean, "clear")){
-			linenoiseClearScreen();
-			continue;
-		}
-		
 		// Check errors and execute command
-		if ((n = cmd_exec_oshean(input_cmd_oshean, args)) != 0){
+		ran = 1;
+		if ((n = osh_eval_line(&line_arena, input_cmd_oshean)) != 0){
 			printf("RET: %d\n", n);
 		}
-
-		// Free the memory
-		free(input_cmd_oshean_bf_tr);
 	}
 
 	// avoid memory leaks
-	free(prompt);
-	free(home_p);
-	free(user);
-	free(hostname);
-	free(input_cmd_oshean_bf_tr);
+	osh_stats_exit();
+	osh_prompt_free();
+	osh_cache_free();
+	osh_alias_free();
+	osh_config_free();
+	osh_arena_free(&line_arena);
 }
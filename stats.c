@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "include/stats.h"
+#include "include/cmd.h"
+#include "include/config.h"
+#include "include/env.h"
+#include "include/linenoise.h"
+#include "include/times.h"
+
+// Where the exit dump goes, NULL for none
+static char *stats_dump_path;
+
+#ifdef OSH_STATS
+struct osh_stats osh_stats;
+
+long long osh_stats_now(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void osh_stats_record(struct osh_stats_hist *h, long long start_ns){
+	unsigned long long ns = osh_stats_now() - start_ns;
+	unsigned long long us = ns / 1000;
+	int b = 0;
+
+	while (us && b < OSH_STATS_BUCKETS - 1){
+		us >>= 1;
+		b++;
+	}
+
+	h->n++;
+	h->sum_ns += ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+	h->bucket[b]++;
+}
+
+// First launch or builtin after Enter, later ones of the line don't count
+void osh_stats_exec(void){
+	if (osh_stats.enter_ns == 0)
+		return;
+
+	osh_stats_record(&osh_stats.enter_exec, osh_stats.enter_ns);
+	osh_stats.enter_ns = 0;
+}
+
+static void stats_print_hist(FILE *f, const char *name, const struct osh_stats_hist *h){
+	char avg[32], max[32];
+	int b;
+
+	if (h->n == 0){
+		fprintf(f, "%s: 0\n", name);
+		return;
+	}
+
+	osh_times_duration(h->sum_ns / h->n / 1000, avg, sizeof(avg));
+	osh_times_duration(h->max_ns / 1000, max, sizeof(max));
+	fprintf(f, "%s: %lu avg %s max %s\n", name, h->n, avg, max);
+
+	for (b = 0; b < OSH_STATS_BUCKETS; b++){
+		if (h->bucket[b] == 0)
+			continue;
+
+		if (b == 0)
+			fprintf(f, "  <1us: %lu\n", h->bucket[b]);
+		else if (b == 1)
+			fprintf(f, "  1us: %lu\n", h->bucket[b]);
+		else if (b == OSH_STATS_BUCKETS - 1)
+			fprintf(f, "  >=%luus: %lu\n", 1UL << (b - 1), h->bucket[b]);
+		else
+			fprintf(f, "  %lu-%luus: %lu\n", 1UL << (b - 1), (1UL << b) - 1, h->bucket[b]);
+	}
+}
+#endif
+
+// Resident set of the shell right now, -1 when /proc doesn't say
+static long stats_rss_kb(void){
+	FILE *f = fopen("/proc/self/statm", "r");
+	long size, rss = -1;
+
+	if (f == NULL)
+		return -1;
+	if (fscanf(f, "%ld %ld", &size, &rss) != 2)
+		rss = -1;
+	fclose(f);
+
+	return rss < 0 ? -1 : rss * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static void stats_print(FILE *f){
+	long rss = stats_rss_kb();
+
+	fprintf(f, "spawn: %lu\n", osh_launch_stats.spawn);
+	fprintf(f, "fork: %lu\n", osh_launch_stats.fork);
+	fprintf(f, "history: %d\n", linenoiseHistoryLen());
+	fprintf(f, "startup: %lldus\n", osh_startup_us);
+	if (rss >= 0)
+		fprintf(f, "rss: %ldk\n", rss);
+
+#ifdef OSH_STATS
+	fprintf(f, "builtin: %lu\n", osh_stats.builtin);
+	fprintf(f, "path_hits: %lu\n", osh_stats.path_hits);
+	fprintf(f, "path_misses: %lu\n", osh_stats.path_misses);
+	stats_print_hist(f, "enter_exec", &osh_stats.enter_exec);
+	stats_print_hist(f, "complete", &osh_stats.complete);
+	stats_print_hist(f, "hint", &osh_stats.hint);
+	stats_print_hist(f, "refresh", &osh_stats.refresh);
+	fprintf(f, "refresh_bytes: %llu\n", osh_stats.refresh_bytes);
+#endif
+}
+
+void osh_stats_exit(void){
+	FILE *f;
+
+	if (stats_dump_path == NULL)
+		return;
+
+	if (!strcmp(stats_dump_path, "-")){
+		stats_print(stderr);
+	} else if ((f = fopen(stats_dump_path, "a")) != NULL){
+		// Appended, one block per shell
+		fprintf(f, "pid: %d\n", (int)getpid());
+		stats_print(f);
+		fclose(f);
+	}
+
+	free(stats_dump_path);
+	stats_dump_path = NULL;
+}
+
+void osh_stats_init(void){
+	const char *path = osh_config_get("stats_dump");
+
+	const char *home = osh_env_get("HOME");
+
+	if (path == NULL || stats_dump_path != NULL)
+		return;
+
+	if (!strncmp(path, "~/", 2) && home != NULL){
+		size_t len = strlen(home) + strlen(path);
+
+		if ((stats_dump_path = malloc(len)) != NULL)
+			snprintf(stats_dump_path, len, "%s%s", home, path + 1);
+	} else {
+		stats_dump_path = strdup(path);
+	}
+}
+
+int osh_stats_builtin(int argc, char **argv){
+	if (argc > 1 && !strcmp(argv[1], "-r")){
+		memset(&osh_launch_stats, 0, sizeof(osh_launch_stats));
+#ifdef OSH_STATS
+		memset(&osh_stats, 0, sizeof(osh_stats));
+#endif
+		return 0;
+	}
+
+	stats_print(stdout);
+#ifndef OSH_STATS
+	printf("built without OSH_STATS, the rest needs cmake -DOSH_STATS=ON\n");
+#endif
+
+	return 0;
+}
@@ -22,15 +22,3 @@ char *rtrim(char *s){
 char *osh_trim(char *s){
 	return rtrim(ltrim(s));
 }
-
-char *osh_set_args(char **arg, char *s){
-	int i = 1;
-	
-	arg[0] = strtok(s, " ");
-
-	while (arg[i] = strtok(NULL, " ")){
-		i++;
-	}
-
-	arg[i+1] = NULL;
-}
@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include "include/sys.h"
+#include "include/env.h"
 
 char *oshean_get_user(){
 	struct passwd *pw;
@@ -17,6 +18,19 @@ char *oshean_get_user(){
 	return pw->pw_name;
 }
 
+const char *oshean_get_home(){
+	const char *home = osh_env_get("HOME");
+	struct passwd *pw;
+
+	if (home != NULL && *home != '\0')
+		return home;
+
+	if ((pw = getpwuid(getuid())) == NULL)
+		return NULL;
+
+	return pw->pw_dir;
+}
+
 char *oshean_get_hostname(){
 	char *buff;
 	buff = malloc(HOST_NAME_MAX+1);
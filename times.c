@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/times.h"
+
+struct osh_times osh_last_times;
+int osh_last_status;
+long long osh_startup_us;
+
+static long long times_tv_us(const struct timeval *tv){
+	return tv->tv_sec * 1000000LL + tv->tv_usec;
+}
+
+void osh_times_start(struct osh_times_mark *m){
+	memset(&osh_last_times, 0, sizeof(osh_last_times));
+	clock_gettime(CLOCK_MONOTONIC, &m->start);
+	getrusage(RUSAGE_SELF, &m->self);
+}
+
+void osh_times_stop(const struct osh_times_mark *m){
+	struct timespec now;
+	struct rusage ru;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	getrusage(RUSAGE_SELF, &ru);
+
+	osh_last_times.real_us = (now.tv_sec - m->start.tv_sec) * 1000000LL +
+		(now.tv_nsec - m->start.tv_nsec) / 1000;
+	osh_last_times.user_us += times_tv_us(&ru.ru_utime) - times_tv_us(&m->self.ru_utime);
+	osh_last_times.sys_us += times_tv_us(&ru.ru_stime) - times_tv_us(&m->self.ru_stime);
+	osh_last_times.nvcsw += ru.ru_nvcsw - m->self.ru_nvcsw;
+	osh_last_times.nivcsw += ru.ru_nivcsw - m->self.ru_nivcsw;
+
+	// Builtin only lines have no child to take the peak from
+	if (osh_last_times.maxrss_kb == 0)
+		osh_last_times.maxrss_kb = ru.ru_maxrss;
+}
+
+static void times_line(const char *name, long long us){
+	fprintf(stderr, "%s\t%lldm%lld.%06llds\n", name, us / 60000000LL,
+		us / 1000000LL % 60, us % 1000000LL);
+}
+
+void osh_times_print(const struct osh_times *t){
+	times_line("real", t->real_us);
+	times_line("user", t->user_us);
+	times_line("sys", t->sys_us);
+	fprintf(stderr, "maxrss\t%ldk\n", t->maxrss_kb);
+	fprintf(stderr, "ctxsw\t%ld voluntary, %ld involuntary\n", t->nvcsw, t->nivcsw);
+}
+
+void osh_times_duration(long long us, char *buf, size_t len){
+	if (us < 1000)
+		snprintf(buf, len, "%lldus", us);
+	else if (us < 1000000)
+		snprintf(buf, len, "%.1fms", us / 1000.0);
+	else if (us < 60000000)
+		snprintf(buf, len, "%.2fs", us / 1000000.0);
+	else
+		snprintf(buf, len, "%lldm%llds", us / 60000000LL, us / 1000000LL % 60);
+}
+
+#define TIMES_VAR(n) (len == sizeof(n) - 1 && !memcmp(name, n, len))
+
+const char *osh_times_var(const char *name, size_t len, char *buf, size_t buflen){
+	long long v;
+
+	if (TIMES_VAR("?"))
+		v = osh_last_status;
+	else if (TIMES_VAR("OSH_REAL_US"))
+		v = osh_last_times.real_us;
+	else if (TIMES_VAR("OSH_USER_US"))
+		v = osh_last_times.user_us;
+	else if (TIMES_VAR("OSH_SYS_US"))
+		v = osh_last_times.sys_us;
+	else if (TIMES_VAR("OSH_MAXRSS_KB"))
+		v = osh_last_times.maxrss_kb;
+	else if (TIMES_VAR("OSH_VCSW"))
+		v = osh_last_times.nvcsw;
+	else if (TIMES_VAR("OSH_IVCSW"))
+		v = osh_last_times.nivcsw;
+	else if (TIMES_VAR("OSH_STARTUP_US"))
+		v = osh_startup_us;
+	else
+		return NULL;
+
+	snprintf(buf, buflen, "%lld", v);
+	return buf;
+}